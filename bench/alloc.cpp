@@ -0,0 +1,128 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <vector>
+
+// Counts heap allocations made while building and destroying a tree, and
+// reports the memory held per node, for increasing heights. Node records,
+// interaction lists and expansion coefficients live in per-level arenas and
+// one coefficient buffer, and the translations accumulate in place
+// (M2MInto, M2LInto, L2LInto), so a build allocates only bookkeeping that does
+// not grow with the number of nodes. For comparison, the "by-value" column
+// counts the allocations the same M2M, M2L and L2L passes make through the
+// value-returning translations.
+//
+// usage: bench/alloc [num_sources] [max_height]
+
+static std::atomic<std::size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  std::size_t align = static_cast<std::size_t>(alignment);
+  std::size_t rounded = (size + align - 1) / align * align;
+  if (void *ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+// Replays the tree's translations through the value-returning API and returns
+// the number of allocations made; results are discarded.
+static std::size_t byValueAllocations(const NaiveFmmTree<GravityKernel> &tree,
+                                      int p) {
+  std::size_t before = allocations.load();
+
+  for (int level = tree.height() - 1; level >= 2; level--) {
+    for (auto *node : tree.level(level)) {
+      MultipoleExpansion me(p, node->box.center);
+      for (auto *child : node->children) {
+        Vector2 shift = child->box.center - node->box.center;
+        me += child->multipole.M2M(Complex(shift.x, shift.y));
+      }
+    }
+  }
+
+  for (int level = 2; level <= tree.height(); level++) {
+    for (auto *node : tree.level(level)) {
+      LocalExpansion local(p, node->box.center);
+      Vector2 shift = node->parent->box.center - node->box.center;
+      local += node->parent->local.L2L(Complex(shift.x, shift.y));
+      for (auto *interaction : node->interaction_list) {
+        LocalExpansion le(p, node->box.center);
+        le.M2L(interaction->multipole);
+        local += le;
+      }
+    }
+  }
+
+  return allocations.load() - before;
+}
+
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int max_height = argc > 2 ? std::atoi(argv[2]) : 7;
+  int p = 5;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  std::cout << "N = " << num_sources << ", p = " << p << std::endl;
+  std::cout << std::setw(7) << "height" << std::setw(10) << "nodes"
+            << std::setw(14) << "by-value" << std::setw(14) << "build allocs"
+            << std::setw(12) << "per node"
+            << std::setw(16) << "teardown allocs" << std::setw(16)
+            << "bytes per node" << std::endl;
+
+  for (int height = 2; height <= max_height; height++) {
+    std::size_t before = allocations.load();
+    auto *fmm_tree = new NaiveFmmTree<GravityKernel>(p, sources, height);
+    std::size_t build = allocations.load() - before - 1;
+
+    FmmMemoryUsage usage = fmm_tree->memory_usage();
+    std::size_t by_value = byValueAllocations(*fmm_tree, p);
+
+    before = allocations.load();
+    delete fmm_tree;
+    std::size_t teardown = allocations.load() - before;
+
+    std::cout << std::setw(7) << height << std::setw(10) << usage.num_nodes
+              << std::setw(14) << by_value << std::setw(14) << build
+              << std::setw(12) << static_cast<double>(build) / usage.num_nodes
+              << std::setw(16) << teardown << std::setw(16) << usage.per_node()
+              << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include "../src/directsum.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Direct summation: the serial pair loop the tests used before against the
+// default DirectSum engine, with the difference of their potential sums as a
+// checksum.
+//
+// usage: bench/directsum [num_sources]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  double checksum = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    double potential = 0.0;
+    for (int j = 0; j < num_sources; j++) {
+      if (i != j) {
+        potential +=
+            GravityKernel::potential(sources[j], sources[i].position);
+      }
+    }
+    checksum += potential;
+  }
+  auto looped = std::chrono::steady_clock::now();
+  std::vector<double> engine =
+      DirectSum<GravityKernel>(sources).evaluateSources();
+  auto end = std::chrono::steady_clock::now();
+  for (double potential : engine) {
+    checksum -= potential;
+  }
+  std::cout << "N = " << num_sources << " pair loop "
+            << std::chrono::duration<double>(looped - start).count()
+            << " s, DirectSum "
+            << std::chrono::duration<double>(end - looped).count()
+            << " s (checksum difference " << checksum << ")" << std::endl;
+
+  return 0;
+}
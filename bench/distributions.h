@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../src/point.h"
+#include "../src/vector.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Source distributions for the benchmarks, reproducible from a seed. All
+// strengths are uniform in [0, 1).
+enum class Distribution : uint8_t {
+  Uniform,  // unit square
+  Plummer,  // projected Plummer sphere, scale radius 0.05
+  Clusters, // 16 Gaussian clusters, sigma 0.01, centers in the unit square
+  Line,     // the diagonal of the unit square
+  Ring      // circle of radius 0.5
+};
+
+inline const char *distributionName(Distribution distribution) {
+  switch (distribution) {
+  case Distribution::Uniform:
+    return "uniform";
+  case Distribution::Plummer:
+    return "plummer";
+  case Distribution::Clusters:
+    return "clusters";
+  case Distribution::Line:
+    return "line";
+  case Distribution::Ring:
+    return "ring";
+  }
+  return "?";
+}
+
+inline constexpr Distribution all_distributions[] = {
+    Distribution::Uniform, Distribution::Plummer, Distribution::Clusters,
+    Distribution::Line, Distribution::Ring};
+
+inline std::vector<Point> makeSources(Distribution distribution,
+                                      std::size_t num_sources,
+                                      std::uint32_t seed = 42) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  constexpr double pi = 3.14159265358979323846;
+
+  std::vector<Vector2> centers;
+  if (distribution == Distribution::Clusters) {
+    for (int c = 0; c < 16; c++) {
+      centers.push_back(Vector2(unit(gen), unit(gen)));
+    }
+  }
+  std::normal_distribution<double> normal(0.0, 0.01);
+  std::uniform_int_distribution<std::size_t> cluster(0, 15);
+
+  std::vector<Point> sources;
+  sources.reserve(num_sources);
+  for (std::size_t i = 0; i < num_sources; i++) {
+    Vector2 position = Vector2::zeros();
+    switch (distribution) {
+    case Distribution::Uniform:
+      position = Vector2(unit(gen), unit(gen));
+      break;
+    case Distribution::Plummer: {
+      // surface density ~ (1 + R^2/a^2)^-2 has enclosed mass
+      // R^2 / (R^2 + a^2); u is capped so that R stays within 30a
+      constexpr double a = 0.05;
+      double u = 0.999 * unit(gen);
+      double radius = a * std::sqrt(u / (1.0 - u));
+      double angle = 2.0 * pi * unit(gen);
+      position = Vector2(0.5 + radius * std::cos(angle),
+                         0.5 + radius * std::sin(angle));
+      break;
+    }
+    case Distribution::Clusters: {
+      Vector2 center = centers[cluster(gen)];
+      position = Vector2(center.x + normal(gen), center.y + normal(gen));
+      break;
+    }
+    case Distribution::Line: {
+      double t = unit(gen);
+      position = Vector2(t, t);
+      break;
+    }
+    case Distribution::Ring: {
+      double angle = 2.0 * pi * unit(gen);
+      position = Vector2(0.5 + 0.5 * std::cos(angle),
+                         0.5 + 0.5 * std::sin(angle));
+      break;
+    }
+    }
+    sources.push_back(Point(position, unit(gen)));
+  }
+  return sources;
+}
@@ -0,0 +1,112 @@
+#include "../src/local.h"
+#include "../src/multipole.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Per-call times of the expansion kernels, runtime-order loops (the
+// *Dynamic methods) against the fixed-order instantiations that the
+// expansion methods dispatch to for p = 4..32. P2M is timed on a leaf of
+// leaf_size sources.
+//
+// usage: bench/fixedorder [repetitions] [leaf_size]
+template <class F> double timePerCall(int repetitions, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repetitions; r++) {
+    f();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count() /
+         repetitions * 1e9;
+}
+
+int main(int argc, char **argv) {
+  int repetitions = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int leaf_size = argc > 2 ? std::atoi(argv[2]) : 32;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(-0.5, 0.5);
+  std::vector<double> xs, ys, strengths;
+  for (int i = 0; i < leaf_size; i++) {
+    xs.push_back(dist(gen));
+    ys.push_back(dist(gen));
+    strengths.push_back(dist(gen) + 0.5);
+  }
+  Complex child_shift(0.5, -0.5);
+  Complex m2l_shift(3.0, -2.0);
+  Vector2 target(0.3, -0.2);
+
+  std::cout << "repetitions " << repetitions << ", P2M leaf " << leaf_size
+            << ", times in ns per call (dynamic / fixed)" << std::endl;
+  std::cout << std::setw(4) << "p";
+  for (const char *kernel : {"P2M", "M2M", "M2L", "L2L", "L2P"}) {
+    std::cout << std::setw(15) << kernel;
+  }
+  std::cout << std::endl;
+
+  double sink = 0.0;
+  for (int p : {4, 8, 12, 16, 20, 24, 32}) {
+    MultipoleExpansion multipole(p, Vector2::zeros());
+    LocalExpansion local(p, Vector2::zeros());
+    multipole.buildExpansion(xs.data(), ys.data(), strengths.data(),
+                             leaf_size);
+    multipole.M2LInto(m2l_shift, local.coeffs);
+    std::vector<Complex> out(p + 1);
+
+    double times[5][2];
+    for (int fixed = 0; fixed < 2; fixed++) {
+      MultipoleExpansion scratch(p, Vector2::zeros());
+      times[0][fixed] = timePerCall(repetitions / 10, [&] {
+        scratch.clear();
+        if (fixed) {
+          scratch.buildExpansion(xs.data(), ys.data(), strengths.data(),
+                                 leaf_size);
+        } else {
+          scratch.buildExpansionDynamic(xs.data(), ys.data(),
+                                        strengths.data(), leaf_size);
+        }
+      });
+      times[1][fixed] = timePerCall(repetitions, [&] {
+        if (fixed) {
+          multipole.M2MInto(child_shift, out);
+        } else {
+          multipole.M2MIntoDynamic(child_shift, out);
+        }
+      });
+      times[2][fixed] = timePerCall(repetitions, [&] {
+        if (fixed) {
+          multipole.M2LInto(m2l_shift, out);
+        } else {
+          multipole.M2LIntoDynamic(m2l_shift, out);
+        }
+      });
+      times[3][fixed] = timePerCall(repetitions, [&] {
+        if (fixed) {
+          local.L2LInto(child_shift, out);
+        } else {
+          local.L2LIntoDynamic(child_shift, out);
+        }
+      });
+      times[4][fixed] = timePerCall(repetitions, [&] {
+        sink += fixed ? local.evaluate(target) : local.evaluateDynamic(target);
+      });
+      sink += scratch.coeffs[p].real() + out[p].real();
+    }
+
+    std::cout << std::setw(4) << p << std::fixed << std::setprecision(0);
+    for (auto &time : times) {
+      std::cout << std::setw(8) << time[0] << " /" << std::setw(5) << time[1];
+    }
+    std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+  }
+  std::cout << "(checksum " << sink << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "../src/fmmtree3.h"
+#include "../src/harmonics.h"
+#include "../src/multipole3.h"
+#include "../src/point3.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Rotation-based M2L of MultipoleExpansion3 per translation against p, with
+// the time over p^3, which stays flat for an O(p^3) translation; then build
+// and evaluate times of FmmTree3 for 1 / r.
+//
+// usage: bench/fmm3 [num_sources] [height] [num_threads]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 200000;
+  int height = argc > 2 ? std::atoi(argv[2]) : 4;
+  int num_threads = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::cout << std::setw(4) << "p" << std::setw(12) << "M2L [us]"
+            << std::setw(16) << "/ p^3 [ns]" << std::endl;
+  for (int p : {4, 8, 16, 32}) {
+    Vector3 shift(2.0, -1.0, 1.0);
+    HarmonicRotation rotation(p, shift);
+    MultipoleExpansion3 multipole(p, Vector3(2.0, -1.0, 1.0));
+    for (Complex &c : multipole.coeffs) {
+      c = Complex(dist(gen), dist(gen));
+    }
+    std::vector<Complex> local(numHarmonics(p));
+
+    int repeats = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (seconds(start) < 0.5) {
+      multipole.M2LInto(rotation, shift.norm(), local);
+      repeats++;
+    }
+    double per_translation = seconds(start) / repeats;
+    std::cout << std::setw(4) << p << std::setw(12) << 1e6 * per_translation
+              << std::setw(16) << 1e9 * per_translation / (p * p * p)
+              << std::endl;
+  }
+
+  std::vector<Point3> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(
+        Point3(Vector3(dist(gen), dist(gen), dist(gen)), dist(gen)));
+  }
+  FmmOptions options;
+  options.num_threads = num_threads;
+
+  std::cout << "N = " << num_sources << ", height = " << height
+            << ", threads = " << num_threads << std::endl;
+  std::cout << std::setw(4) << "p" << std::setw(12) << "build [s]"
+            << std::setw(14) << "evaluate [s]" << std::endl;
+  for (int p : {4, 8, 12}) {
+    auto start = std::chrono::steady_clock::now();
+    FmmTree3<CoulombKernel> tree(p, sources, height, options);
+    double build = seconds(start);
+    start = std::chrono::steady_clock::now();
+    std::vector<double> potentials = tree.evaluateSources();
+    double evaluate = seconds(start);
+    std::cout << std::setw(4) << p << std::setw(12) << build << std::setw(14)
+              << evaluate << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Leapfrog (kick-drift-kick) integration of N unit-total-mass particles under
+// the log potential, rebuilding the tree every step against NaiveFmmTree::
+// update, both with batched M2L. A rebuild also rebuilds the M2L operators,
+// as the fitted box changes every step. Accelerations are -grad(potential).
+// Also reports how far the updated tree's final accelerations are from a
+// fresh tree's at the same positions, relative to the largest acceleration.
+//
+// usage: bench/leapfrog [num_sources] [steps] [height]
+
+struct State {
+  std::vector<Vector2> positions;
+  std::vector<Vector2> velocities;
+};
+
+static void kick(State &state, const std::vector<PotentialGradient> &field,
+                 double dt) {
+  for (std::size_t i = 0; i < state.velocities.size(); i++) {
+    state.velocities[i] -= field[i].gradient * dt;
+  }
+}
+
+static void drift(State &state, double dt) {
+  for (std::size_t i = 0; i < state.positions.size(); i++) {
+    state.positions[i] += state.velocities[i] * dt;
+  }
+}
+
+static std::vector<Point> toPoints(const State &state,
+                                   const std::vector<double> &masses) {
+  std::vector<Point> points;
+  for (std::size_t i = 0; i < masses.size(); i++) {
+    points.push_back(Point(state.positions[i], masses[i]));
+  }
+  return points;
+}
+
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 5000;
+  int steps = argc > 2 ? std::atoi(argv[2]) : 1000;
+  int height = argc > 3 ? std::atoi(argv[3]) : 5;
+  int p = 8;
+  double dt = 1e-3;
+  FmmOptions options;
+  options.m2l = M2LMode::Batched;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  std::normal_distribution<double> speed(0.0, 0.1);
+
+  State initial;
+  std::vector<double> masses(num_sources, 1.0 / num_sources);
+  for (int i = 0; i < num_sources; i++) {
+    initial.positions.push_back(Vector2(dist(gen), dist(gen)));
+    initial.velocities.push_back(Vector2(speed(gen), speed(gen)));
+  }
+
+  std::cout << "N = " << num_sources << ", steps = " << steps
+            << ", p = " << p << ", height = " << height << std::endl;
+
+  State state = initial;
+  auto rebuild = [&] {
+    NaiveFmmTree<GravityKernel> fmm_tree(p, toPoints(state, masses), height,
+                                         options);
+    return fmm_tree.evaluateSourcesWithGradient();
+  };
+
+  // rebuild every step
+  auto start = std::chrono::steady_clock::now();
+  std::vector<PotentialGradient> field = rebuild();
+  for (int step = 0; step < steps; step++) {
+    kick(state, field, 0.5 * dt);
+    drift(state, dt);
+    field = rebuild();
+    kick(state, field, 0.5 * dt);
+  }
+  double rebuild_time = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  // one tree, updated every step
+  state = initial;
+  start = std::chrono::steady_clock::now();
+  NaiveFmmTree<GravityKernel> fmm_tree(p, toPoints(state, masses), height,
+                                       options);
+  field = fmm_tree.evaluateSourcesWithGradient();
+  for (int step = 0; step < steps; step++) {
+    kick(state, field, 0.5 * dt);
+    drift(state, dt);
+    fmm_tree.update(state.positions, masses);
+    field = fmm_tree.evaluateSourcesWithGradient();
+    kick(state, field, 0.5 * dt);
+  }
+  double update_time = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  std::vector<PotentialGradient> fresh = rebuild();
+  double max_field = 0.0;
+  double max_diff = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    max_field = std::max(max_field, fresh[i].gradient.norm());
+    max_diff =
+        std::max(max_diff, (field[i].gradient - fresh[i].gradient).norm());
+  }
+
+  std::cout << "rebuild: " << rebuild_time << " s (" << rebuild_time / steps
+            << " s/step)" << std::endl;
+  std::cout << "update:  " << update_time << " s (" << update_time / steps
+            << " s/step)" << std::endl;
+  std::cout << "speedup: " << rebuild_time / update_time << std::endl;
+  std::cout << "final acceleration diff (update vs fresh tree): "
+            << max_diff / max_field << std::endl;
+
+  return 0;
+}
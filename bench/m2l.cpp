@@ -0,0 +1,108 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using Tree = NaiveFmmTree<GravityKernel>;
+using Node = Tree::Node;
+
+// Compares the per-pair le.M2L(...) loop against the batched GEMM engine over
+// every interaction-list pair of a uniform tree, at p = 5, 10, 20 and 40.
+// The per-pair loop is timed on a prefix of the pairs (at most ~2 s) and
+// reported per translation. The difference column compares the cached
+// operator with the per-pair recurrence on the first pairs.
+//
+// usage: bench/m2l [num_sources] [height]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int height = argc > 2 ? std::atoi(argv[2]) : 6;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  std::cout << "N = " << num_sources << ", height = " << height << std::endl;
+  std::cout << std::setw(4) << "p" << std::setw(10) << "pairs"
+            << std::setw(16) << "per-pair [us]" << std::setw(16)
+            << "batched [us]" << std::setw(12) << "speedup" << std::setw(14)
+            << "max rel diff" << std::endl;
+
+  for (int p : {5, 10, 20, 40}) {
+    Tree fmm_tree(p, sources, height);
+    M2LOperatorCache cache(p, fmm_tree.root()->box.half_side, height);
+
+    std::vector<std::pair<const Node *, Node *>> pairs;
+    std::vector<std::vector<M2LBatch<Node>>> batches(height + 1);
+    for (int level = 2; level <= height; level++) {
+      for (Node *node : fmm_tree.level(level)) {
+        for (Node *interaction : node->interaction_list) {
+          pairs.push_back({interaction, node});
+        }
+      }
+      batches[level] = groupInteractions(fmm_tree.level(level));
+    }
+
+    // per-pair recurrence, on as many pairs as fit in the time budget
+    std::size_t timed_pairs = 0;
+    double max_difference = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (timed_pairs < pairs.size() && elapsed < 2.0) {
+      auto [source, target] = pairs[timed_pairs++];
+      GravityKernel::Local le(p, target->box.center);
+      le.M2L(source->multipole);
+      target->local += le;
+      elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    }
+    double per_pair = elapsed / timed_pairs;
+
+    for (std::size_t i = 0; i < std::min<std::size_t>(timed_pairs, 100); i++) {
+      auto [source, target] = pairs[i];
+      GravityKernel::Local le(p, target->box.center);
+      le.M2L(source->multipole);
+
+      double side = 2.0 * target->box.half_side;
+      Vector2 offset = (source->box.center - target->box.center) / side;
+      int level = std::lround(std::log2(2.0 * cache.root_half_side() / side));
+      std::vector<Complex> cached(p + 1);
+      cache.apply(level, std::lround(offset.x), std::lround(offset.y),
+                  source->multipole.coeffs.data(), cached.data());
+      for (int l = 0; l <= p; l++) {
+        double scale = std::max(std::abs(le.coeffs[l]), 1e-300);
+        double difference = std::abs(cached[l] - le.coeffs[l]) / scale;
+        max_difference = std::max(max_difference, difference);
+      }
+    }
+
+    // batched GEMM engine over every pair
+    ThreadPool pool(1);
+    start = std::chrono::steady_clock::now();
+    for (int level = 2; level <= height; level++) {
+      batchedM2L(cache, level, batches[level], pool);
+    }
+    double batched = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() /
+                     pairs.size();
+
+    std::cout << std::setw(4) << p << std::setw(10) << pairs.size()
+              << std::setw(16) << 1e6 * per_pair << std::setw(16)
+              << 1e6 * batched << std::setw(12) << per_pair / batched
+              << std::setw(14) << max_difference << std::endl;
+  }
+
+  return 0;
+}
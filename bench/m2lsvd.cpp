@@ -0,0 +1,129 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using Tree = NaiveFmmTree<GravityKernel>;
+using Node = Tree::Node;
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// M2L time and accuracy of M2LMode::Compressed against the tolerance, at
+// p = 10, 20 and 40. The baselines are the per-pair LocalExpansion::M2L
+// recurrence (timed on a prefix of the pairs, at most ~2 s) and the dense
+// batched GEMM engine. Times are per interaction-list pair over all levels;
+// "setup" is the one-off compression of the operators. The error is the max
+// source potential difference from a Direct tree, relative to the largest
+// potential.
+//
+// usage: bench/m2lsvd [num_sources] [height]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int height = argc > 2 ? std::atoi(argv[2]) : 6;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+  ThreadPool pool(1);
+
+  std::cout << "N = " << num_sources << ", height = " << height << std::endl;
+  for (int p : {10, 20, 40}) {
+    Tree direct(p, sources, height);
+    std::vector<double> expected = direct.evaluateSources();
+    double max_potential = 0.0;
+    for (double potential : expected) {
+      max_potential = std::max(max_potential, std::abs(potential));
+    }
+
+    std::size_t num_pairs = 0;
+    std::vector<std::pair<const Node *, Node *>> pairs;
+    for (int level = 2; level <= height; level++) {
+      for (Node *node : direct.level(level)) {
+        for (Node *interaction : node->interaction_list) {
+          pairs.push_back({interaction, node});
+        }
+      }
+    }
+    num_pairs = pairs.size();
+
+    // per-pair recurrence, on as many pairs as fit in the time budget
+    std::size_t timed_pairs = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (timed_pairs < num_pairs && seconds(start) < 2.0) {
+      auto [source, target] = pairs[timed_pairs++];
+      GravityKernel::Local le(p, target->box.center);
+      le.M2L(source->multipole);
+      target->local += le;
+    }
+    double per_pair = seconds(start) / timed_pairs;
+
+    FmmOptions options;
+    options.m2l = M2LMode::Batched;
+    Tree batched_tree(p, sources, height, options);
+    std::vector<std::vector<M2LBatch<Node>>> batches(height + 1);
+    for (int level = 2; level <= height; level++) {
+      batches[level] = groupInteractions(batched_tree.level(level));
+    }
+    start = std::chrono::steady_clock::now();
+    for (int level = 2; level <= height; level++) {
+      batchedM2L(*batched_tree.m2l_cache(), level, batches[level], pool);
+    }
+    double batched = seconds(start) / num_pairs;
+
+    std::cout << std::endl
+              << "p = " << p << ", " << num_pairs << " pairs: per-pair M2L "
+              << 1e6 * per_pair << " us, batched " << 1e6 * batched << " us"
+              << std::endl;
+    std::cout << std::setw(10) << "tolerance" << std::setw(8) << "rank"
+              << std::setw(12) << "setup [ms]" << std::setw(12) << "M2L [us]"
+              << std::setw(12) << "vs M2L" << std::setw(12) << "vs batched"
+              << std::setw(12) << "rel error" << std::endl;
+
+    for (double tolerance : {1e-2, 1e-4, 1e-6, 1e-8, 1e-10, 1e-12, 1e-14}) {
+      start = std::chrono::steady_clock::now();
+      CompressedM2LOperators operators(*batched_tree.m2l_cache(), tolerance);
+      double setup = seconds(start);
+
+      options.m2l = M2LMode::Compressed;
+      options.m2l_cache = batched_tree.m2l_cache();
+      options.m2l_tolerance = tolerance;
+      options.m2l_compressed =
+          std::make_shared<const CompressedM2LOperators>(operators);
+      Tree compressed(p, sources, height, options);
+      std::vector<double> potentials = compressed.evaluateSources();
+      double error = 0.0;
+      for (std::size_t i = 0; i < potentials.size(); i++) {
+        error = std::max(error, std::abs(potentials[i] - expected[i]));
+      }
+
+      start = std::chrono::steady_clock::now();
+      for (int level = 2; level <= height; level++) {
+        compressedM2L(operators, level, batched_tree.level(level),
+                      batches[level], pool);
+      }
+      double time = seconds(start) / num_pairs;
+
+      std::cout << std::setw(10) << tolerance << std::setw(8)
+                << operators.rank(height) << std::setw(12) << 1e3 * setup
+                << std::setw(12) << 1e6 * time << std::setw(12)
+                << per_pair / time << std::setw(12) << batched / time
+                << std::setw(12) << error / max_potential << std::endl;
+    }
+  }
+
+  return 0;
+}
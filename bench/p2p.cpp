@@ -0,0 +1,84 @@
+#include "../src/p2p.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Near-field microbenchmark: a block of targets against a block of sources,
+// scalar GravityKernel::potential loop against the vectorized p2p_batch hook.
+// Reports interactions per second and the deviation from the scalar path
+// relative to sum_j |q_j log r_ij|.
+//
+// usage: bench/p2p [block_size] [repetitions]
+int main(int argc, char **argv) {
+  int block = argc > 1 ? std::atoi(argv[1]) : 256;
+  int repetitions = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<double> xs(block), ys(block), strengths(block);
+  std::vector<Point> sources;
+  for (int j = 0; j < block; j++) {
+    xs[j] = dist(gen);
+    ys[j] = dist(gen);
+    strengths[j] = dist(gen);
+    sources.push_back(Point(Vector2(xs[j], ys[j]), strengths[j]));
+  }
+
+  double interactions = static_cast<double>(block) * block * repetitions;
+
+  std::vector<double> scalar(block, 0.0);
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repetitions; r++) {
+    for (int i = 0; i < block; i++) {
+      Vector2 target(xs[i], ys[i]);
+      double result = 0.0;
+      for (const Point &source : sources) {
+        result += GravityKernel::potential(source, target);
+      }
+      scalar[i] = result;
+    }
+  }
+  double scalar_time = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  std::vector<double> batched(block);
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repetitions; r++) {
+    std::fill(batched.begin(), batched.end(), 0.0);
+    GravityKernel::p2p_batch(xs.data(), ys.data(), strengths.data(), block,
+                             xs.data(), ys.data(), batched.data(), block);
+  }
+  double batched_time = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  double max_deviation = 0.0;
+  for (int i = 0; i < block; i++) {
+    double magnitude = 0.0;
+    for (const Point &source : sources) {
+      Vector2 target(xs[i], ys[i]);
+      magnitude += std::abs(GravityKernel::potential(source, target));
+    }
+    max_deviation =
+        std::max(max_deviation, std::abs(batched[i] - scalar[i]) / magnitude);
+  }
+
+  std::cout << "block " << block << " x " << block << ", vector width "
+            << logP2PWidth() << std::endl;
+  std::cout << "scalar:  " << interactions / scalar_time / 1e6
+            << " M interactions/s" << std::endl;
+  std::cout << "batched: " << interactions / batched_time / 1e6
+            << " M interactions/s (" << scalar_time / batched_time << "x)"
+            << std::endl;
+  std::cout << "max relative deviation: " << max_deviation << std::endl;
+
+  return 0;
+}
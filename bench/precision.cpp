@@ -0,0 +1,87 @@
+#include "../src/directsum.h"
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Build (P2M, M2M, M2L, L2L) and evaluate (L2P, P2P) times, coefficient
+// memory and accuracy of double, mixed (float multipoles and translations
+// into double locals) and float expansions on a scaled uniform tree. The
+// error is the max difference from a direct sum over a sample of the
+// sources, relative to the largest sampled potential.
+//
+// usage: bench/precision [num_sources] [height] [samples]
+template <class Kernel>
+void run(const char *name, int p, const std::vector<Point> &sources,
+         int height, const DirectSumSample &reference, double max_potential) {
+  FmmOptions options;
+  options.scaled = true;
+
+  auto start = std::chrono::steady_clock::now();
+  NaiveFmmTree<Kernel> tree(p, sources, height, options);
+  double build = seconds(start);
+  start = std::chrono::steady_clock::now();
+  std::vector<double> potentials = tree.evaluateSources();
+  double evaluate = seconds(start);
+
+  double error = 0.0;
+  for (std::size_t i = 0; i < reference.indices.size(); i++) {
+    error = std::max(error, std::abs(potentials[reference.indices[i]] -
+                                     reference.potentials[i]));
+  }
+
+  std::cout << std::setw(8) << name << std::setw(4) << p << std::setw(12)
+            << 1e3 * build << std::setw(14) << 1e3 * evaluate << std::setw(12)
+            << tree.memory_usage().coefficients / 1024 << std::setw(12)
+            << error / max_potential << std::endl;
+}
+
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int height = argc > 2 ? std::atoi(argv[2]) : 6;
+  std::size_t samples = argc > 3 ? std::atoi(argv[3]) : 1000;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  DirectSum<GravityKernel> direct(sources);
+  DirectSumSample reference = direct.sampleSources(samples);
+  double max_potential = 0.0;
+  for (double potential : reference.potentials) {
+    max_potential = std::max(max_potential, std::abs(potential));
+  }
+
+  std::cout << "N = " << num_sources << ", height = " << height << ", "
+            << reference.indices.size() << " sampled sources" << std::endl;
+  std::cout << std::setw(8) << "config" << std::setw(4) << "p"
+            << std::setw(12) << "build [ms]" << std::setw(14)
+            << "evaluate [ms]" << std::setw(12) << "coeffs [KB]"
+            << std::setw(12) << "rel error" << std::endl;
+  for (int p : {6, 10, 16, 24}) {
+    run<GravityKernel>("double", p, sources, height, reference,
+                       max_potential);
+    run<MixedGravityKernel>("mixed", p, sources, height, reference,
+                            max_potential);
+    run<FloatGravityKernel>("float", p, sources, height, reference,
+                            max_potential);
+  }
+
+  return 0;
+}
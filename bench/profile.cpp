@@ -0,0 +1,90 @@
+// the tree below is instantiated in this file, so this turns on its
+// instrumentation without a PROFILE=1 build of the library
+#ifndef FMM_PROFILE
+#define FMM_PROFILE
+#endif
+
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/profile.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Per-phase, per-level breakdown of one tree construction and
+// evaluateSources on uniform sources: summed seconds, operation counts and
+// GFlop/s of the estimated flops (Mpairs/s for P2P). Optionally writes the
+// profiler's JSON summary and a Chrome trace of every timed scope.
+//
+// usage: bench/profile [num_sources] [height] [p] [levels|tasks]
+//                      [summary.json] [trace.json]
+
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int height = argc > 2 ? std::atoi(argv[2]) : 6;
+  int p = argc > 3 ? std::atoi(argv[3]) : 12;
+  FmmOptions options;
+  options.m2l = M2LMode::Batched;
+  if (argc > 4 && std::strcmp(argv[4], "tasks") == 0) {
+    options.schedule = FmmSchedule::TaskGraph;
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  Profiler &profiler = Profiler::instance();
+  profiler.reset();
+  double start = profiler.now();
+  NaiveFmmTree<GravityKernel> fmm_tree(p, sources, height, options);
+  std::vector<double> potentials = fmm_tree.evaluateSources();
+  double wall = profiler.now() - start;
+
+  std::cout << "N = " << num_sources << ", height = " << height
+            << ", p = " << p << ", "
+            << (options.schedule == FmmSchedule::TaskGraph ? "task graph"
+                                                           : "levels")
+            << ", wall " << wall << " s" << std::endl;
+  std::cout << std::setw(10) << "phase" << std::setw(7) << "level"
+            << std::setw(12) << "seconds" << std::setw(10) << "calls"
+            << std::setw(16) << "interactions" << std::setw(10) << "rate"
+            << std::endl;
+  for (const auto &[key, counters] : profiler.totals()) {
+    std::cout << std::setw(10) << profilePhaseName(key.first) << std::setw(7)
+              << key.second << std::fixed << std::setprecision(6)
+              << std::setw(12) << counters.seconds << std::setw(10)
+              << counters.calls << std::setw(16) << counters.interactions
+              << std::setprecision(2);
+    if (counters.seconds > 0.0 && counters.flops > 0.0) {
+      std::cout << std::setw(10) << counters.flops / counters.seconds * 1e-9
+                << " GFlop/s";
+    } else if (counters.seconds > 0.0 && key.first == ProfilePhase::P2P) {
+      std::cout << std::setw(10)
+                << counters.interactions / counters.seconds * 1e-6
+                << " Mpairs/s";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+  }
+
+  if (argc > 5) {
+    std::ofstream out(argv[5]);
+    profiler.writeJson(out);
+  }
+  if (argc > 6) {
+    std::ofstream out(argv[6]);
+    profiler.writeChromeTrace(out);
+  }
+  std::cout << "(checksum " << potentials[0] << ")" << std::endl;
+
+  return 0;
+}
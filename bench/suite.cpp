@@ -0,0 +1,416 @@
+#include "../src/adaptivetree.h"
+#include "../src/directsum.h"
+#include "../src/fmmtree.h"
+#include "../src/planner.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+#include "distributions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Reproducible benchmark suite: fixed seeds, distributions and tree
+// parameters, so that two commits run the same configurations. Sweeps
+//   sizes    every distribution, N = 10^3 .. max_n, both trees, p = 10
+//   orders   uniform N = 10^5, p = 4 .. 24, both trees
+//   heights  uniform N = 10^6, uniform tree heights 3 .. 8
+//   threads  uniform N = 10^6, uniform tree, 1 .. max_threads threads
+// with N capped at max_n. The uniform tree (NaiveFmmTree, batched M2L) takes
+// its height and the adaptive tree its leaf capacity from FmmPlanner with a
+// fixed cost model, not a measured one, so the plans do not vary between
+// hosts or runs. Uniform-tree runs whose near field exceeds max_pairs
+// source-target pairs (the clustered distributions at large N) are skipped.
+//
+// Each run reports construction and evaluateSources times, throughput, the
+// peak RSS during the run (VmHWM, reset before each run on Linux; otherwise
+// the process peak), the tree's own storage and the error on a sampled
+// direct sum: max and RMS absolute error over the sampled sources, relative
+// to the max and RMS reference potential. A table goes to stdout and CSV
+// rows to the --out file, which --compare diffs against a baseline.
+//
+// usage: bench/suite [--max-n N] [--max-threads T] [--samples S]
+//                    [--max-pairs P] [--out results.csv]
+//        bench/suite --compare baseline.csv results.csv [threshold]
+
+namespace {
+
+struct RunConfig {
+  std::string sweep;
+  Distribution distribution;
+  std::size_t num_sources;
+  bool adaptive;
+  int p;
+  int height; // uniform tree; 0 takes the planned height
+  int threads;
+};
+
+struct RunResult {
+  std::string status = "ok";
+  int height = 0; // depth of the adaptive tree
+  std::size_t leaf_capacity = 0;
+  double build = 0.0;
+  double evaluate = 0.0;
+  double peak_rss = 0.0; // MiB
+  double tree_memory = 0.0; // MiB, uniform tree only
+  double near_pairs = 0.0;
+  double max_error = 0.0;
+  double rms_error = 0.0;
+};
+
+constexpr const char *csv_header =
+    "sweep,distribution,tree,n,p,height,leaf_capacity,threads,status,"
+    "build_s,evaluate_s,sources_per_s,peak_rss_mib,tree_mib,near_pairs,"
+    "max_error,rms_error";
+// leading CSV columns that identify a configuration
+constexpr int num_key_columns = 8;
+
+// p2p about 2 ns per pair and a cached M2L about 3 ns per coefficient pair,
+// near this code's measured costs with AVX2/AVX-512
+FmmCostModel referenceCosts(int p) {
+  return FmmCostModel{2e-9, 3e-9 * (p + 1) * (p + 1)};
+}
+
+double readStatusMiB(const char *field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  std::size_t length = std::strlen(field);
+  while (std::getline(status, line)) {
+    if (line.compare(0, length, field) == 0 && line[length] == ':') {
+      return std::atof(line.c_str() + length + 1) / 1024.0; // kB
+    }
+  }
+  return -1.0;
+}
+
+// restarts VmHWM at the current RSS (Linux 4.0+)
+bool resetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  return static_cast<bool>(clear_refs);
+}
+
+double peakRssMiB(bool reset) {
+  double hwm = reset ? readStatusMiB("VmHWM") : -1.0;
+  if (hwm >= 0.0) {
+    return hwm;
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0; // kB on Linux
+}
+
+double seconds(std::chrono::steady_clock::time_point start,
+               std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+
+void sampleErrors(const std::vector<double> &potentials,
+                  const DirectSumSample &reference, RunResult &result) {
+  double max_reference = 0.0, error2 = 0.0, reference2 = 0.0;
+  for (std::size_t s = 0; s < reference.indices.size(); s++) {
+    double expected = reference.potentials[s];
+    double error = std::abs(potentials[reference.indices[s]] - expected);
+    max_reference = std::max(max_reference, std::abs(expected));
+    result.max_error = std::isfinite(error)
+                           ? std::max(result.max_error, error)
+                           : INFINITY;
+    error2 += error * error;
+    reference2 += expected * expected;
+  }
+  result.max_error /= max_reference;
+  result.rms_error = std::sqrt(error2 / reference2);
+}
+
+class Suite {
+public:
+  std::size_t samples = 200;
+  int num_threads = 1; // direct sums
+  double max_pairs = 2e10;
+
+  RunResult run(const RunConfig &config) {
+    const std::vector<Point> &sources = sourcesFor(config);
+    const DirectSumSample &reference = referenceFor(config);
+    FmmPlan plan = FmmPlanner<GravityKernel>::plan(sources, 1e-6,
+                                                   referenceCosts(config.p));
+
+    RunResult result;
+    std::vector<double> potentials;
+    if (config.adaptive) {
+      result.leaf_capacity = plan.leaf_capacity;
+      bool reset = resetPeakRss();
+      auto start = std::chrono::steady_clock::now();
+      AdaptiveFmmTree<GravityKernel> fmm_tree(config.p, sources,
+                                              plan.leaf_capacity);
+      auto built = std::chrono::steady_clock::now();
+      potentials = fmm_tree.evaluateSources();
+      auto end = std::chrono::steady_clock::now();
+      result.peak_rss = peakRssMiB(reset);
+      result.height = fmm_tree.depth();
+      result.build = seconds(start, built);
+      result.evaluate = seconds(built, end);
+    } else {
+      result.height = config.height > 0 ? config.height : plan.height;
+      result.near_pairs =
+          FmmPlanner<GravityKernel>::nearPairs(sources, result.height);
+      if (result.near_pairs > max_pairs) {
+        result.status = "skipped";
+        return result;
+      }
+      FmmOptions options;
+      options.num_threads = config.threads;
+      options.m2l = M2LMode::Batched;
+
+      bool reset = resetPeakRss();
+      auto start = std::chrono::steady_clock::now();
+      NaiveFmmTree<GravityKernel> fmm_tree(config.p, sources, result.height,
+                                           options);
+      auto built = std::chrono::steady_clock::now();
+      potentials = fmm_tree.evaluateSources();
+      auto end = std::chrono::steady_clock::now();
+      result.peak_rss = peakRssMiB(reset);
+      result.tree_memory = fmm_tree.memory_usage().total() / 1048576.0;
+      result.build = seconds(start, built);
+      result.evaluate = seconds(built, end);
+    }
+
+    sampleErrors(potentials, reference, result);
+    return result;
+  }
+
+private:
+  Distribution distribution_ = Distribution::Uniform;
+  std::vector<Point> sources_;
+  std::map<std::pair<Distribution, std::size_t>, DirectSumSample>
+      references_;
+
+  const std::vector<Point> &sourcesFor(const RunConfig &config) {
+    if (sources_.size() != config.num_sources ||
+        distribution_ != config.distribution) {
+      sources_.clear();
+      sources_.shrink_to_fit();
+      sources_ = makeSources(config.distribution, config.num_sources);
+      distribution_ = config.distribution;
+    }
+    return sources_;
+  }
+
+  const DirectSumSample &referenceFor(const RunConfig &config) {
+    auto key = std::make_pair(config.distribution, config.num_sources);
+    auto it = references_.find(key);
+    if (it == references_.end()) {
+      DirectSum<GravityKernel> direct(sources_, {.num_threads = num_threads});
+      it = references_.emplace(key, direct.sampleSources(samples, 7)).first;
+    }
+    return it->second;
+  }
+};
+
+std::vector<RunConfig> makeSweeps(std::size_t max_n, int max_threads) {
+  std::vector<RunConfig> configs;
+  auto capped = [&](std::size_t n) { return std::min(n, max_n); };
+
+  for (std::size_t n = 1000; n <= max_n; n *= 10) {
+    for (Distribution distribution : all_distributions) {
+      for (bool adaptive : {false, true}) {
+        configs.push_back({"sizes", distribution, n, adaptive, 10, 0, 1});
+      }
+    }
+  }
+  for (int p = 4; p <= 24; p += 4) {
+    for (bool adaptive : {false, true}) {
+      configs.push_back({"orders", Distribution::Uniform, capped(100000),
+                         adaptive, p, 0, 1});
+    }
+  }
+  for (int height = 3; height <= 8; height++) {
+    configs.push_back({"heights", Distribution::Uniform, capped(1000000),
+                       false, 10, height, 1});
+  }
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    configs.push_back({"threads", Distribution::Uniform, capped(1000000),
+                       false, 10, 0, threads});
+  }
+  return configs;
+}
+
+std::string csvRow(const RunConfig &config, const RunResult &result) {
+  std::ostringstream row;
+  row << std::setprecision(6) << config.sweep << ","
+      << distributionName(config.distribution) << ","
+      << (config.adaptive ? "adaptive" : "uniform") << ","
+      << config.num_sources << "," << config.p << "," << result.height << ","
+      << result.leaf_capacity << "," << config.threads << "," << result.status;
+  if (result.status != "ok") {
+    row << ",,,,,," << result.near_pairs << ",,";
+    return row.str();
+  }
+  double total = result.build + result.evaluate;
+  row << "," << result.build << "," << result.evaluate << ","
+      << config.num_sources / total << "," << result.peak_rss << ",";
+  if (!config.adaptive) {
+    row << result.tree_memory;
+  }
+  row << ",";
+  if (!config.adaptive) {
+    row << result.near_pairs;
+  }
+  row << "," << result.max_error << "," << result.rms_error;
+  return row.str();
+}
+
+std::vector<std::string> splitCsv(const std::string &line) {
+  std::vector<std::string> fields;
+  std::stringstream stream(line);
+  std::string field;
+  while (std::getline(stream, field, ',')) {
+    fields.push_back(field);
+  }
+  if (!line.empty() && line.back() == ',') {
+    fields.push_back("");
+  }
+  return fields;
+}
+
+// key -> fields of every row in a results file
+std::map<std::string, std::vector<std::string>>
+readResults(const char *path) {
+  std::map<std::string, std::vector<std::string>> rows;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields = splitCsv(line);
+    if (fields.size() <= num_key_columns || fields[0] == "sweep") {
+      continue;
+    }
+    std::string key;
+    for (int c = 0; c < num_key_columns; c++) {
+      key += fields[c] + (c + 1 < num_key_columns ? "," : "");
+    }
+    rows[key] = fields;
+  }
+  return rows;
+}
+
+// Prints build + evaluate time and max error of the configurations in both
+// files; returns 1 when a run got slower than threshold (relative) or its
+// error grew more than tenfold
+int compare(const char *baseline_path, const char *results_path,
+            double threshold) {
+  auto baseline = readResults(baseline_path);
+  auto results = readResults(results_path);
+  auto time = [](const std::vector<std::string> &fields) {
+    return std::atof(fields[9].c_str()) + std::atof(fields[10].c_str());
+  };
+  auto error = [](const std::vector<std::string> &fields) {
+    return std::atof(fields[15].c_str());
+  };
+
+  int regressions = 0;
+  std::cout << std::left << std::setw(52) << "configuration" << std::right
+            << std::setw(12) << "time [s]" << std::setw(12) << "baseline"
+            << std::setw(8) << "ratio" << std::setw(12) << "error"
+            << std::setw(12) << "baseline" << std::endl;
+  for (const auto &[key, fields] : results) {
+    auto it = baseline.find(key);
+    if (it == baseline.end() || fields[8] != "ok" || it->second[8] != "ok") {
+      continue;
+    }
+    double ratio = time(fields) / time(it->second);
+    bool slower = ratio > 1.0 + threshold;
+    bool less_accurate = error(fields) > 10.0 * error(it->second);
+    regressions += slower || less_accurate;
+    std::cout << std::left << std::setw(52) << key << std::right
+              << std::setprecision(3) << std::setw(12) << time(fields)
+              << std::setw(12) << time(it->second) << std::setw(8) << ratio
+              << std::setw(12) << error(fields) << std::setw(12)
+              << error(it->second) << (slower ? " slower" : "")
+              << (less_accurate ? " less accurate" : "") << std::endl;
+  }
+  std::cout << regressions << " regression(s) beyond " << threshold * 100
+            << "% time or 10x error" << std::endl;
+  return regressions > 0 ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 3 && std::strcmp(argv[1], "--compare") == 0) {
+    return compare(argv[2], argv[3], argc > 4 ? std::atof(argv[4]) : 0.1);
+  }
+
+  std::size_t max_n = 10000000;
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string out_path;
+  Suite suite;
+  suite.num_threads = max_threads;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--max-n") == 0) {
+      max_n = std::atof(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--max-threads") == 0) {
+      max_threads = std::atoi(argv[i + 1]);
+      suite.num_threads = max_threads;
+    } else if (std::strcmp(argv[i], "--samples") == 0) {
+      suite.samples = std::atoi(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--max-pairs") == 0) {
+      suite.max_pairs = std::atof(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--out") == 0) {
+      out_path = argv[i + 1];
+    } else {
+      std::cerr << "unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  std::ofstream out;
+  if (!out_path.empty()) {
+    out.open(out_path);
+    out << csv_header << std::endl;
+  }
+
+  std::cout << std::setw(8) << "sweep" << std::setw(10) << "dist"
+            << std::setw(9) << "tree" << std::setw(10) << "N" << std::setw(4)
+            << "p" << std::setw(4) << "h" << std::setw(4) << "T"
+            << std::setw(11) << "build [s]" << std::setw(11) << "eval [s]"
+            << std::setw(11) << "Msrc/s" << std::setw(10) << "RSS [MiB]"
+            << std::setw(11) << "max error" << std::endl;
+  for (const RunConfig &config : makeSweeps(max_n, max_threads)) {
+    RunResult result = suite.run(config);
+    if (out.is_open()) {
+      out << csvRow(config, result) << std::endl;
+    }
+
+    std::cout << std::setprecision(3) << std::setw(8) << config.sweep
+              << std::setw(10) << distributionName(config.distribution)
+              << std::setw(9) << (config.adaptive ? "adaptive" : "uniform")
+              << std::setw(10) << config.num_sources << std::setw(4)
+              << config.p << std::setw(4) << result.height << std::setw(4)
+              << config.threads;
+    if (result.status != "ok") {
+      std::cout << "  " << result.status << " (" << result.near_pairs
+                << " near-field pairs)" << std::endl;
+      continue;
+    }
+    std::cout << std::setw(11) << result.build << std::setw(11)
+              << result.evaluate << std::setw(11)
+              << config.num_sources / (result.build + result.evaluate) * 1e-6
+              << std::setw(10) << result.peak_rss << std::setw(11)
+              << result.max_error << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Evaluation on a grid of targets that are not sources: a loop over
+// evaluate() against one evaluateTargets() call. The grid is traversed row by
+// row, so consecutive targets are far apart in Morton order. Reports targets
+// per second and the largest difference between the two paths.
+//
+// usage: bench/targets [num_sources] [grid_side] [height] [num_threads]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int grid_side = argc > 2 ? std::atoi(argv[2]) : 1000;
+  int height = argc > 3 ? std::atoi(argv[3]) : 7;
+  int num_threads = argc > 4 ? std::atoi(argv[4]) : 1;
+  int p = 10;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  std::vector<Vector2> targets;
+  for (int i = 0; i < grid_side; i++) {
+    for (int j = 0; j < grid_side; j++) {
+      targets.push_back(
+          Vector2((j + 0.5) / grid_side, (i + 0.5) / grid_side));
+    }
+  }
+
+  FmmOptions options;
+  options.num_threads = num_threads;
+  NaiveFmmTree<GravityKernel> fmm_tree(p, sources, height, options);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<double> looped(targets.size());
+  for (std::size_t i = 0; i < targets.size(); i++) {
+    looped[i] = fmm_tree.evaluate(targets[i]);
+  }
+  double loop_time = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+  start = std::chrono::steady_clock::now();
+  std::vector<double> batched = fmm_tree.evaluateTargets(targets);
+  double batch_time = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  double max_diff = 0.0;
+  for (std::size_t i = 0; i < targets.size(); i++) {
+    max_diff = std::max(max_diff, std::abs(looped[i] - batched[i]) /
+                                      std::abs(looped[i]));
+  }
+
+  std::cout << "N = " << num_sources << ", targets = " << targets.size()
+            << ", p = " << p << ", height = " << height
+            << ", threads = " << num_threads << std::endl;
+  std::cout << "evaluate() loop:  " << targets.size() / loop_time
+            << " targets/s" << std::endl;
+  std::cout << "evaluateTargets:  " << targets.size() / batch_time
+            << " targets/s" << std::endl;
+  std::cout << "speedup: " << loop_time / batch_time << std::endl;
+  std::cout << "max rel diff: " << max_diff << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Compares the level-synchronous schedule against the task graph schedule
+// (build + evaluateSources) and breaks the task graph run down into busy time
+// per task kind and remaining idle time.
+//
+// usage: bench/taskgraph [num_sources] [max_threads]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int max_threads = argc > 2
+                        ? std::atoi(argv[2])
+                        : std::max(1u, std::thread::hardware_concurrency());
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  int height = ceil(std::log(num_sources) / std::log(4));
+  int p = 5;
+
+  std::cout << "N = " << num_sources << ", height = " << height
+            << ", p = " << p << std::endl;
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    FmmOptions options;
+    options.num_threads = threads;
+
+    auto start = std::chrono::steady_clock::now();
+    NaiveFmmTree<GravityKernel> levels_tree(p, sources, height, options);
+    std::vector<double> expected = levels_tree.evaluateSources();
+    auto end = std::chrono::steady_clock::now();
+    double levels_time = std::chrono::duration<double>(end - start).count();
+
+    options.schedule = FmmSchedule::TaskGraph;
+    start = std::chrono::steady_clock::now();
+    NaiveFmmTree<GravityKernel> graph_tree(p, sources, height, options);
+    std::vector<double> potentials = graph_tree.evaluateSources();
+    end = std::chrono::steady_clock::now();
+    double graph_time = std::chrono::duration<double>(end - start).count();
+
+    double max_difference = 0.0;
+    for (int i = 0; i < num_sources; i++) {
+      max_difference =
+          std::max(max_difference, std::abs(potentials[i] - expected[i]));
+    }
+
+    const TaskGraphProfile &profile = graph_tree.task_profile();
+    std::cout << std::endl
+              << "threads: " << threads << ", levels: " << levels_time
+              << " s, task graph: " << graph_time
+              << " s, max difference: " << max_difference << std::endl;
+    std::cout << "  graph run: " << profile.wall_time << " s wall, "
+              << profile.records.size() << " tasks, idle "
+              << 100.0 * profile.idleTime() /
+                     (profile.num_workers * profile.wall_time)
+              << "%" << std::endl;
+    for (int k = 0; k < num_task_kinds; k++) {
+      TaskKind kind = static_cast<TaskKind>(k);
+      std::cout << "  " << std::setw(4) << taskKindName(kind) << " busy "
+                << profile.busyTime(kind) << " s" << std::endl;
+    }
+  }
+
+  return 0;
+}
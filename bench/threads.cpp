@@ -0,0 +1,64 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "../test/kernels.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Times tree construction (upward and downward passes) and evaluateSources
+// for increasing thread counts and reports the speedup over one thread.
+//
+// usage: bench/threads [num_sources] [max_threads]
+int main(int argc, char **argv) {
+  int num_sources = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int max_threads = argc > 2
+                        ? std::atoi(argv[2])
+                        : std::max(1u, std::thread::hardware_concurrency());
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  int height = ceil(std::log(num_sources) / std::log(4));
+  int p = 5;
+
+  std::cout << "N = " << num_sources << ", height = " << height
+            << ", p = " << p << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "build [s]"
+            << std::setw(12) << "eval [s]" << std::setw(12) << "speedup"
+            << std::endl;
+
+  double baseline = 0.0;
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    FmmOptions options;
+    options.num_threads = threads;
+
+    auto start = std::chrono::steady_clock::now();
+    NaiveFmmTree<GravityKernel> fmm_tree(p, sources, height, options);
+    auto built = std::chrono::steady_clock::now();
+    std::vector<double> potentials = fmm_tree.evaluateSources();
+    auto end = std::chrono::steady_clock::now();
+
+    double build = std::chrono::duration<double>(built - start).count();
+    double eval = std::chrono::duration<double>(end - built).count();
+    if (threads == 1) {
+      baseline = build + eval;
+    }
+
+    std::cout << std::setw(8) << threads << std::setw(12) << build
+              << std::setw(12) << eval << std::setw(12)
+              << baseline / (build + eval) << std::endl;
+  }
+
+  return 0;
+}
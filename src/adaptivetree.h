@@ -0,0 +1,333 @@
+#pragma once
+
+#include "fmmtree.h"
+#include "point.h"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+template <class Kernel> struct AdaptiveFmmNode2 {
+  using Multipole = typename Kernel::Multipole;
+  using Local = typename Kernel::Local;
+
+  AdaptiveFmmNode2(int p, Box2 box, NodeType type, int level)
+      : box(box), type(type), level(level), multipole(p, box.center),
+        local(p, box.center) {}
+
+  Box2 box;
+  NodeType type;
+  int level;
+  std::vector<Point> points;  // for leaf nodes
+  std::size_t num_points = 0; // points in the subtree
+
+  AdaptiveFmmNode2 *parent = nullptr;
+  AdaptiveFmmNode2 *children[4] = {nullptr, nullptr, nullptr, nullptr};
+
+  Multipole multipole;
+  Local local;
+
+  // same-level adjacent nodes, including the node itself
+  std::vector<AdaptiveFmmNode2 *> colleagues;
+  // U: adjacent leaves, including the node itself (leaves only, P2P)
+  std::vector<AdaptiveFmmNode2 *> u_list;
+  // V: well-separated children of the parent's colleagues (M2L)
+  std::vector<AdaptiveFmmNode2 *> v_list;
+  // W: well-separated descendants of colleagues whose parent is adjacent
+  // (leaves only, M2P)
+  std::vector<AdaptiveFmmNode2 *> w_list;
+  // X: leaves that have this node in their W list (P2L)
+  std::vector<AdaptiveFmmNode2 *> x_list;
+
+  bool is_leaf() const { return type == NodeType::Leaf; }
+};
+
+// Adaptive FMM tree implementation: a box is split only while it holds more
+// than leaf_capacity points
+template <class Kernel> struct AdaptiveFmmTree {
+  using Multipole = typename Kernel::Multipole;
+  using Local = typename Kernel::Local;
+
+  using Node = AdaptiveFmmNode2<Kernel>;
+
+  AdaptiveFmmTree(int p, const std::vector<Point> &sources,
+                  std::size_t leaf_capacity, int max_depth = 30);
+  // order and leaf capacity from a plan (see FmmPlanner)
+  AdaptiveFmmTree(const FmmPlan &plan, const std::vector<Point> &sources,
+                  int max_depth = 30)
+      : AdaptiveFmmTree(plan.p, sources, plan.leaf_capacity, max_depth) {}
+  ~AdaptiveFmmTree();
+
+  Node *root() const { return root_; }
+  int depth() const { return static_cast<int>(levels_.size()) - 1; }
+  std::size_t num_leaves() const { return leaves_.size(); }
+
+  double evaluate(Vector2 point) const;
+  std::vector<double> evaluateSources() const;
+  PotentialGradient evaluateWithGradient(Vector2 point) const;
+  std::vector<PotentialGradient> evaluateSourcesWithGradient() const;
+
+protected:
+  int p_;
+  Node *root_;
+  std::size_t leaf_capacity_;
+  int max_depth_;
+  std::vector<std::vector<Node *>> levels_;
+  std::vector<Node *> leaves_;
+  const std::vector<Point> &sources_;
+
+private:
+  Node *getLeaf(Vector2 position) const;
+  void buildChildNodes(Node *node);
+  void computeColleagues(Node *node);
+  void computeLeafLists(Node *leaf);
+  void descendNeighbor(Node *leaf, Node *node);
+};
+
+template <class Kernel>
+typename AdaptiveFmmTree<Kernel>::Node *
+AdaptiveFmmTree<Kernel>::getLeaf(Vector2 position) const {
+  Node *node = root_;
+  while (!node->is_leaf()) {
+    node = node->children[getQuadrant(node->box, position)];
+  }
+  return node;
+}
+
+template <class Kernel>
+AdaptiveFmmTree<Kernel>::AdaptiveFmmTree(int p,
+                                         const std::vector<Point> &sources,
+                                         std::size_t leaf_capacity,
+                                         int max_depth)
+    : p_(p), leaf_capacity_(leaf_capacity), max_depth_(max_depth),
+      sources_(sources) {
+  Box2 root_box = computeBoundingBox(sources);
+  root_ = new Node(p_, root_box, NodeType::Leaf, 0);
+  root_->points = sources;
+  root_->num_points = sources.size();
+  levels_.push_back({root_});
+
+  for (std::size_t level = 0; level < levels_.size(); level++) {
+    for (std::size_t i = 0; i < levels_[level].size(); i++) {
+      Node *node = levels_[level][i];
+      buildChildNodes(node);
+      computeColleagues(node);
+      if (node->is_leaf()) {
+        leaves_.push_back(node);
+      }
+    }
+  }
+
+  for (Node *leaf : leaves_) {
+    computeLeafLists(leaf);
+  }
+
+  // step 1: form multipole expansions at each leaf node
+  for (Node *leaf : leaves_) {
+    leaf->multipole.buildExpansion(leaf->points);
+  }
+
+  // step 2: form multipole expansions up the tree by combining child multipole
+  // expansions
+  for (int level = depth() - 1; level >= 1; level--) {
+    for (Node *node : levels_[level]) {
+      if (node->is_leaf()) {
+        continue;
+      }
+      for (Node *child : node->children) {
+        Vector2 shift = child->box.center - node->box.center;
+        child->multipole.M2MInto(Complex(shift.x, shift.y),
+                                 node->multipole.coeffs);
+      }
+    }
+  }
+
+  // step 3: form local expansions down the tree from the parent local
+  // expansion, the V list (M2L) and the X list (P2L)
+  for (int level = 2; level <= depth(); level++) {
+    for (Node *node : levels_[level]) {
+      if (node->parent->level >= 2) {
+        Vector2 shift = node->parent->box.center - node->box.center;
+        node->parent->local.L2LInto(Complex(shift.x, shift.y),
+                                    node->local.coeffs);
+      }
+
+      for (Node *interaction : node->v_list) {
+        Vector2 shift = interaction->box.center - node->box.center;
+        interaction->multipole.M2LInto(Complex(shift.x, shift.y),
+                                       node->local.coeffs);
+      }
+
+      for (Node *source : node->x_list) {
+        node->local.P2L(source->points);
+      }
+    }
+  }
+}
+
+template <class Kernel> AdaptiveFmmTree<Kernel>::~AdaptiveFmmTree() {
+  for (const std::vector<Node *> &level : levels_) {
+    for (Node *node : level) {
+      delete node;
+    }
+  }
+}
+
+template <class Kernel>
+void AdaptiveFmmTree<Kernel>::buildChildNodes(Node *node) {
+  if (node->points.size() <= leaf_capacity_ || node->level == max_depth_) {
+    node->type = NodeType::Leaf;
+    return;
+  }
+
+  if (levels_.size() == static_cast<std::size_t>(node->level) + 1) {
+    levels_.emplace_back();
+  }
+
+  node->type = NodeType::Internal;
+  for (int q = 0; q < 4; q++) {
+    Box2 child_box = getChildBox(node->box, q);
+    Node *child = new Node(p_, child_box, NodeType::Leaf, node->level + 1);
+    child->parent = node;
+    node->children[q] = child;
+    levels_[node->level + 1].push_back(child);
+  }
+
+  for (const Point &p : node->points) {
+    node->children[getQuadrant(node->box, p.position)]->points.push_back(p);
+  }
+  for (Node *child : node->children) {
+    child->num_points = child->points.size();
+  }
+  node->points.clear();
+  node->points.shrink_to_fit();
+}
+
+// compute colleagues and V list for node, assuming parent node has already
+// been computed
+template <class Kernel>
+void AdaptiveFmmTree<Kernel>::computeColleagues(Node *node) {
+  Node *parent = node->parent;
+  if (parent == nullptr) {
+    node->colleagues.push_back(node);
+    return;
+  }
+
+  for (Node *parent_colleague : parent->colleagues) {
+    if (parent_colleague->is_leaf()) {
+      continue;
+    }
+    for (Node *child : parent_colleague->children) {
+      if (adjacent(node->box, child->box)) {
+        node->colleagues.push_back(child);
+      } else if (child->num_points > 0) {
+        node->v_list.push_back(child);
+      }
+    }
+  }
+}
+
+// compute U and W lists for leaf, and the matching U and X entries of the
+// smaller boxes it reaches, assuming colleagues have already been computed
+template <class Kernel>
+void AdaptiveFmmTree<Kernel>::computeLeafLists(Node *leaf) {
+  for (Node *colleague : leaf->colleagues) {
+    if (colleague == leaf || colleague->is_leaf()) {
+      leaf->u_list.push_back(colleague);
+    } else {
+      descendNeighbor(leaf, colleague);
+    }
+  }
+}
+
+template <class Kernel>
+void AdaptiveFmmTree<Kernel>::descendNeighbor(Node *leaf, Node *node) {
+  for (Node *child : node->children) {
+    if (!adjacent(leaf->box, child->box)) {
+      if (child->num_points > 0) {
+        leaf->w_list.push_back(child);
+      }
+      if (leaf->num_points > 0) {
+        child->x_list.push_back(leaf);
+      }
+    } else if (child->is_leaf()) {
+      leaf->u_list.push_back(child);
+      child->u_list.push_back(leaf);
+    } else {
+      descendNeighbor(leaf, child);
+    }
+  }
+}
+
+template <class Kernel>
+double AdaptiveFmmTree<Kernel>::evaluate(Vector2 point) const {
+  Node *leaf = getLeaf(point);
+
+  double result = leaf->local.evaluate(point);
+
+  for (Node *far : leaf->w_list) {
+    result += far->multipole.evaluate(point);
+  }
+
+  for (Node *near_neighbor : leaf->u_list) {
+    for (const Point &p : near_neighbor->points) {
+      if (p.position == point) {
+        continue;
+      }
+      result += Kernel::potential(p, point);
+    }
+  }
+
+  return result;
+}
+
+template <class Kernel>
+std::vector<double> AdaptiveFmmTree<Kernel>::evaluateSources() const {
+  int num_sources = sources_.size();
+  std::vector<double> potentials(num_sources);
+
+  for (int i = 0; i < num_sources; i++) {
+    potentials[i] = evaluate(sources_[i].position);
+  }
+
+  return potentials;
+}
+
+template <class Kernel>
+PotentialGradient
+AdaptiveFmmTree<Kernel>::evaluateWithGradient(Vector2 point) const {
+  Node *leaf = getLeaf(point);
+
+  PotentialGradient result = leaf->local.evaluateWithGradient(point);
+
+  for (Node *far : leaf->w_list) {
+    PotentialGradient m2p = far->multipole.evaluateWithGradient(point);
+    result.potential += m2p.potential;
+    result.gradient += m2p.gradient;
+  }
+
+  for (Node *near_neighbor : leaf->u_list) {
+    for (const Point &p : near_neighbor->points) {
+      if (p.position == point) {
+        continue;
+      }
+      result.potential += Kernel::potential(p, point);
+      result.gradient += Kernel::gradient(p, point);
+    }
+  }
+
+  return result;
+}
+
+template <class Kernel>
+std::vector<PotentialGradient>
+AdaptiveFmmTree<Kernel>::evaluateSourcesWithGradient() const {
+  int num_sources = sources_.size();
+  std::vector<PotentialGradient> results(num_sources);
+
+  for (int i = 0; i < num_sources; i++) {
+    results[i] = evaluateWithGradient(sources_[i].position);
+  }
+
+  return results;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// Contiguous storage for a fixed number of objects constructed in place. The
+// memory is one aligned block allocated up front and released at once, so
+// filling and tearing down the arena costs a single allocation.
+template <class T, std::size_t Alignment = 64> class Arena {
+public:
+  Arena() = default;
+
+  explicit Arena(std::size_t capacity) : capacity_(capacity) {
+    if (capacity_ > 0) {
+      data_ = static_cast<T *>(::operator new(
+          capacity_ * sizeof(T), std::align_val_t{Alignment}));
+    }
+  }
+
+  ~Arena() { release(); }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  Arena(Arena &&other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        capacity_(std::exchange(other.capacity_, 0)) {}
+
+  Arena &operator=(Arena &&other) noexcept {
+    if (this != &other) {
+      release();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, 0);
+    }
+    return *this;
+  }
+
+  template <class... Args> T *emplace(Args &&...args) {
+    if (size_ == capacity_) {
+      throw std::length_error("Arena capacity exceeded");
+    }
+    T *object = new (data_ + size_) T(std::forward<Args>(args)...);
+    size_++;
+    return object;
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return capacity_; }
+  std::size_t bytes() const { return capacity_ * sizeof(T); }
+
+  T &operator[](std::size_t i) { return data_[i]; }
+  const T &operator[](std::size_t i) const { return data_[i]; }
+  T *begin() { return data_; }
+  T *end() { return data_ + size_; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+
+private:
+  T *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+
+  void release() {
+    while (size_ > 0) {
+      data_[--size_].~T();
+    }
+    if (data_ != nullptr) {
+      ::operator delete(data_, std::align_val_t{Alignment});
+      data_ = nullptr;
+    }
+    capacity_ = 0;
+  }
+};
+
+// Fixed-size, zero-initialized, aligned array of trivially copyable values
+template <class T, std::size_t Alignment = 64> class AlignedBuffer {
+public:
+  AlignedBuffer() = default;
+
+  explicit AlignedBuffer(std::size_t size) : size_(size) {
+    if (size_ > 0) {
+      data_ = static_cast<T *>(
+          ::operator new(size_ * sizeof(T), std::align_val_t{Alignment}));
+      for (std::size_t i = 0; i < size_; i++) {
+        new (data_ + i) T();
+      }
+    }
+  }
+
+  ~AlignedBuffer() { release(); }
+
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+  AlignedBuffer(AlignedBuffer &&other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+
+  AlignedBuffer &operator=(AlignedBuffer &&other) noexcept {
+    if (this != &other) {
+      release();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t bytes() const { return size_ * sizeof(T); }
+  T *data() { return data_; }
+  const T *data() const { return data_; }
+  T &operator[](std::size_t i) { return data_[i]; }
+  const T &operator[](std::size_t i) const { return data_[i]; }
+
+private:
+  T *data_ = nullptr;
+  std::size_t size_ = 0;
+
+  void release() {
+    if (data_ != nullptr) {
+      ::operator delete(data_, std::align_val_t{Alignment});
+      data_ = nullptr;
+    }
+    size_ = 0;
+  }
+};
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "p2p.h"
+#include "point.h"
+#include "threadpool.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <span>
+#include <vector>
+
+// Neumaier's compensated sum: the rounding error of every addition is kept in
+// a separate term, so the result is accurate to about one rounding of the
+// exact sum, independent of the number of terms
+struct CompensatedSum {
+  double sum = 0.0;
+  double compensation = 0.0;
+
+  void add(double x) {
+    double t = sum + x;
+    if (std::abs(sum) >= std::abs(x)) {
+      compensation += (sum - t) + x;
+    } else {
+      compensation += (x - t) + sum;
+    }
+    sum = t;
+  }
+  double value() const { return sum + compensation; }
+};
+
+struct DirectSumOptions {
+  int num_threads = 1;
+  // targets per parallel task and sources per tile: a tile's three arrays
+  // (24 KiB at 1024 sources) stay in L1 while the task's targets pass over it
+  std::size_t target_block = 64;
+  std::size_t source_tile = 1024;
+};
+
+// Potentials at a subset of the sources
+struct DirectSumSample {
+  std::vector<std::size_t> indices; // ascending
+  std::vector<double> potentials;
+};
+
+// O(N M) evaluation of all source-target pairs, as the accuracy reference
+// for the trees and for problems too small for the FMM to pay off. Targets
+// are split into blocks across the thread pool; each block runs over the
+// sources one tile at a time with Kernel::p2p_batch (the scalar
+// Kernel::potential loop for kernels without it) and adds each tile's partial
+// sums into a compensated sum per target, so the rounding error grows with
+// the tile size rather than with N. Coincident pairs contribute zero, which
+// drops each source's self term in evaluateSources.
+template <class Kernel> class DirectSum {
+public:
+  explicit DirectSum(const std::vector<Point> &sources,
+                     DirectSumOptions options = {});
+
+  std::size_t num_sources() const { return xs_.size(); }
+
+  double evaluate(Vector2 point) const;
+  std::vector<double> evaluateSources() const;
+  std::vector<double> evaluateTargets(std::span<const Vector2> targets) const;
+  // potentials at count sources drawn without replacement, reproducibly from
+  // seed; all sources when count >= N
+  DirectSumSample sampleSources(std::size_t count,
+                                std::uint32_t seed = 42) const;
+  PotentialGradient evaluateWithGradient(Vector2 point) const;
+  std::vector<PotentialGradient> evaluateSourcesWithGradient() const;
+
+private:
+  DirectSumOptions options_;
+  mutable ThreadPool pool_;
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<double> strengths_;
+
+  void potentials(const double *tx, const double *ty, double *out,
+                  std::size_t nt) const;
+  void gradients(const double *tx, const double *ty, PotentialGradient *out,
+                 std::size_t nt) const;
+  // partial[i] += potential at target i from sources [begin, end)
+  void tilePotentials(const double *tx, const double *ty, std::size_t nt,
+                      std::size_t begin, std::size_t end,
+                      double *partial) const;
+};
+
+template <class Kernel>
+DirectSum<Kernel>::DirectSum(const std::vector<Point> &sources,
+                             DirectSumOptions options)
+    : options_(options), pool_(options.num_threads) {
+  options_.target_block = std::max<std::size_t>(1, options_.target_block);
+  options_.source_tile = std::max<std::size_t>(1, options_.source_tile);
+  xs_.reserve(sources.size());
+  ys_.reserve(sources.size());
+  strengths_.reserve(sources.size());
+  for (const Point &source : sources) {
+    xs_.push_back(source.position.x);
+    ys_.push_back(source.position.y);
+    strengths_.push_back(source.strength);
+  }
+}
+
+template <class Kernel>
+double DirectSum<Kernel>::evaluate(Vector2 point) const {
+  double result = 0.0;
+  potentials(&point.x, &point.y, &result, 1);
+  return result;
+}
+
+template <class Kernel>
+std::vector<double> DirectSum<Kernel>::evaluateSources() const {
+  std::vector<double> result(num_sources());
+  potentials(xs_.data(), ys_.data(), result.data(), num_sources());
+  return result;
+}
+
+template <class Kernel>
+std::vector<double>
+DirectSum<Kernel>::evaluateTargets(std::span<const Vector2> targets) const {
+  std::vector<double> tx, ty;
+  tx.reserve(targets.size());
+  ty.reserve(targets.size());
+  for (const Vector2 &target : targets) {
+    tx.push_back(target.x);
+    ty.push_back(target.y);
+  }
+  std::vector<double> result(targets.size());
+  potentials(tx.data(), ty.data(), result.data(), targets.size());
+  return result;
+}
+
+template <class Kernel>
+DirectSumSample DirectSum<Kernel>::sampleSources(std::size_t count,
+                                                 std::uint32_t seed) const {
+  DirectSumSample sample;
+  std::vector<std::size_t> all(num_sources());
+  std::iota(all.begin(), all.end(), 0);
+  std::mt19937 gen(seed);
+  std::sample(all.begin(), all.end(), std::back_inserter(sample.indices),
+              count, gen);
+
+  std::vector<double> tx, ty;
+  for (std::size_t i : sample.indices) {
+    tx.push_back(xs_[i]);
+    ty.push_back(ys_[i]);
+  }
+  sample.potentials.resize(sample.indices.size());
+  potentials(tx.data(), ty.data(), sample.potentials.data(), tx.size());
+  return sample;
+}
+
+template <class Kernel>
+PotentialGradient
+DirectSum<Kernel>::evaluateWithGradient(Vector2 point) const {
+  PotentialGradient result;
+  gradients(&point.x, &point.y, &result, 1);
+  return result;
+}
+
+template <class Kernel>
+std::vector<PotentialGradient>
+DirectSum<Kernel>::evaluateSourcesWithGradient() const {
+  std::vector<PotentialGradient> result(num_sources());
+  gradients(xs_.data(), ys_.data(), result.data(), num_sources());
+  return result;
+}
+
+template <class Kernel>
+void DirectSum<Kernel>::tilePotentials(const double *tx, const double *ty,
+                                       std::size_t nt, std::size_t begin,
+                                       std::size_t end,
+                                       double *partial) const {
+  if constexpr (HasP2PBatch<Kernel>) {
+    Kernel::p2p_batch(&xs_[begin], &ys_[begin], &strengths_[begin],
+                      end - begin, tx, ty, partial, nt);
+  } else {
+    for (std::size_t i = 0; i < nt; i++) {
+      Vector2 target(tx[i], ty[i]);
+      for (std::size_t j = begin; j < end; j++) {
+        partial[i] += Kernel::potential(
+            Point(Vector2(xs_[j], ys_[j]), strengths_[j]), target);
+      }
+    }
+  }
+}
+
+template <class Kernel>
+void DirectSum<Kernel>::potentials(const double *tx, const double *ty,
+                                   double *out, std::size_t nt) const {
+  std::size_t block = options_.target_block;
+  std::size_t tile = options_.source_tile;
+  std::size_t ns = num_sources();
+
+  pool_.parallel_for((nt + block - 1) / block, [&](std::size_t b) {
+    std::size_t first = b * block;
+    std::size_t count = std::min(block, nt - first);
+    std::vector<CompensatedSum> sums(count);
+    std::vector<double> partial(count);
+
+    for (std::size_t begin = 0; begin < ns; begin += tile) {
+      std::fill(partial.begin(), partial.end(), 0.0);
+      tilePotentials(tx + first, ty + first, count, begin,
+                     std::min(ns, begin + tile), partial.data());
+      for (std::size_t i = 0; i < count; i++) {
+        sums[i].add(partial[i]);
+      }
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      out[first + i] = sums[i].value();
+    }
+  });
+}
+
+template <class Kernel>
+void DirectSum<Kernel>::gradients(const double *tx, const double *ty,
+                                  PotentialGradient *out,
+                                  std::size_t nt) const {
+  std::size_t block = options_.target_block;
+  std::size_t tile = options_.source_tile;
+  std::size_t ns = num_sources();
+
+  pool_.parallel_for((nt + block - 1) / block, [&](std::size_t b) {
+    std::size_t first = b * block;
+    std::size_t count = std::min(block, nt - first);
+    std::vector<CompensatedSum> sums(3 * count);
+    std::vector<double> potential(count), gx(count), gy(count);
+
+    for (std::size_t begin = 0; begin < ns; begin += tile) {
+      std::size_t end = std::min(ns, begin + tile);
+      std::fill(potential.begin(), potential.end(), 0.0);
+      std::fill(gx.begin(), gx.end(), 0.0);
+      std::fill(gy.begin(), gy.end(), 0.0);
+      if constexpr (HasP2PGradientBatch<Kernel>) {
+        Kernel::p2p_gradient_batch(&xs_[begin], &ys_[begin],
+                                   &strengths_[begin], end - begin,
+                                   tx + first, ty + first, potential.data(),
+                                   gx.data(), gy.data(), count);
+      } else {
+        for (std::size_t i = 0; i < count; i++) {
+          Vector2 target(tx[first + i], ty[first + i]);
+          for (std::size_t j = begin; j < end; j++) {
+            Point source(Vector2(xs_[j], ys_[j]), strengths_[j]);
+            potential[i] += Kernel::potential(source, target);
+            Vector2 gradient = Kernel::gradient(source, target);
+            gx[i] += gradient.x;
+            gy[i] += gradient.y;
+          }
+        }
+      }
+      for (std::size_t i = 0; i < count; i++) {
+        sums[3 * i].add(potential[i]);
+        sums[3 * i + 1].add(gx[i]);
+        sums[3 * i + 2].add(gy[i]);
+      }
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      out[first + i].potential = sums[3 * i].value();
+      out[first + i].gradient =
+          Vector2(sums[3 * i + 1].value(), sums[3 * i + 2].value());
+    }
+  });
+}
@@ -0,0 +1,135 @@
+#include "eigen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr int max_sweeps = 100;
+
+// Householder QR of the m x n row-major matrix A, m >= n, in place: leaves
+// R in the upper triangle of the first n rows
+void householderR(int m, int n, Complex *A) {
+  std::vector<Complex> v(m);
+  for (int j = 0; j < n; j++) {
+    double norm = 0.0;
+    for (int i = j; i < m; i++) {
+      norm += std::norm(A[i * n + j]);
+    }
+    norm = std::sqrt(norm);
+    if (norm == 0.0) {
+      continue;
+    }
+    // v = x - alpha e_1 with alpha = -e^(i arg x_1) |x|, which never cancels
+    Complex x1 = A[j * n + j];
+    Complex phase = std::abs(x1) > 0.0 ? x1 / std::abs(x1) : Complex(1.0);
+    Complex alpha = -phase * norm;
+    double v_norm = 0.0;
+    for (int i = j; i < m; i++) {
+      v[i] = A[i * n + j] - (i == j ? alpha : Complex(0.0));
+      v_norm += std::norm(v[i]);
+    }
+    v_norm = std::sqrt(v_norm);
+    for (int i = j; i < m; i++) {
+      v[i] /= v_norm;
+    }
+
+    // columns k > j <- (I - 2 v v^H) columns
+    for (int k = j + 1; k < n; k++) {
+      Complex w = 0.0;
+      for (int i = j; i < m; i++) {
+        w += std::conj(v[i]) * A[i * n + k];
+      }
+      w *= 2.0;
+      for (int i = j; i < m; i++) {
+        A[i * n + k] -= v[i] * w;
+      }
+    }
+    A[j * n + j] = alpha;
+    for (int i = j + 1; i < m; i++) {
+      A[i * n + j] = 0.0;
+    }
+  }
+}
+
+} // namespace
+
+void singularValueDecomposition(int m, int n, Complex *A,
+                                double *singular_values, Complex *V) {
+  // A = Q R shares its singular values and right singular vectors with R
+  householderR(m, n, A);
+  std::vector<Complex> R(A, A + n * n);
+
+  std::fill(V, V + n * n, Complex(0.0));
+  for (int i = 0; i < n; i++) {
+    V[i * n + i] = 1.0;
+  }
+
+  // rotate pairs of columns of R until each pair is orthogonal to rounding
+  bool rotated = true;
+  int sweep = 0;
+  while (rotated) {
+    if (++sweep > max_sweeps) {
+      throw std::runtime_error("Jacobi SVD did not converge");
+    }
+    rotated = false;
+    for (int p = 0; p < n - 1; p++) {
+      for (int q = p + 1; q < n; q++) {
+        double rpp = 0.0, rqq = 0.0;
+        Complex rpq = 0.0;
+        for (int i = 0; i < n; i++) {
+          rpp += std::norm(R[i * n + p]);
+          rqq += std::norm(R[i * n + q]);
+          rpq += std::conj(R[i * n + p]) * R[i * n + q];
+        }
+        double r = std::abs(rpq);
+        if (r <= 1e-15 * std::sqrt(rpp * rqq)) {
+          continue;
+        }
+        rotated = true;
+        // J = diag(1, e^-i phi) G, with phi the phase of (R^H R)(p, q) and G
+        // the real Jacobi rotation zeroing the off-diagonal of the resulting
+        // real 2x2 block of R^H R; R <- R J, V <- V J
+        Complex phase = rpq / r;
+        double theta = (rqq - rpp) / (2.0 * r);
+        double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                   (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        double c = 1.0 / std::sqrt(t * t + 1.0);
+        double s = t * c;
+        Complex jpp = c, jpq = s;
+        Complex jqp = -s * std::conj(phase), jqq = c * std::conj(phase);
+
+        for (int i = 0; i < n; i++) {
+          Complex rip = R[i * n + p], riq = R[i * n + q];
+          R[i * n + p] = rip * jpp + riq * jqp;
+          R[i * n + q] = rip * jpq + riq * jqq;
+          Complex vip = V[i * n + p], viq = V[i * n + q];
+          V[i * n + p] = vip * jpp + viq * jqp;
+          V[i * n + q] = vip * jpq + viq * jqq;
+        }
+      }
+    }
+  }
+
+  // the singular values are the column norms; sort by descending value
+  std::vector<double> norms(n, 0.0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      norms[j] += std::norm(R[i * n + j]);
+    }
+  }
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return norms[a] > norms[b]; });
+  std::vector<Complex> vectors(V, V + n * n);
+  for (int j = 0; j < n; j++) {
+    singular_values[j] = std::sqrt(norms[order[j]]);
+    for (int i = 0; i < n; i++) {
+      V[i * n + j] = vectors[i * n + order[j]];
+    }
+  }
+}
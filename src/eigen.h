@@ -0,0 +1,14 @@
+#pragma once
+
+#include <complex>
+
+using Complex = std::complex<double>;
+
+// Singular values and right singular vectors of the m x n row-major matrix A,
+// m >= n: a Householder QR, then one-sided Jacobi rotations of the columns
+// of R. Neither step forms A^H A, so singular values are resolved down to
+// rounding in A rather than in its square. The singular values are returned
+// in descending order in singular_values, and the right singular vectors as
+// the matching columns of the row-major n x n matrix V. A is overwritten.
+void singularValueDecomposition(int m, int n, Complex *A,
+                                double *singular_values, Complex *V);
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "point.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Expansion kernels with the order p as a template parameter. Trip counts are
+// compile-time constants, the binomials come from constexpr tables, and the
+// complex arithmetic is written out on real and imaginary parts (std::complex
+// multiplication carries an inf/NaN fixup that blocks vectorization). Sums
+// accumulate over the output index, so the loops vectorize without
+// reassociating floating-point additions. Coefficients use the layout, shift
+// conventions and radius scaling of MultipoleExpansion and LocalExpansion:
+// the translations take the radii of their input and output expansions, 1
+// for unscaled coefficients. The kernels compute in the real type R of their
+// input coefficients, float or double; M2L may accumulate into a local
+// expansion of another type, with its log term kept in double.
+namespace fixed_order {
+
+// orders with an instantiation; dispatch() reports the others
+constexpr int min_order = 4;
+constexpr int max_order = 32;
+
+template <int P, class R = double>
+using Matrix = std::array<std::array<R, P + 1>, P + 1>;
+
+// binomial(n, k) for n, k <= 2p from Pascal's triangle; exact in double up to
+// n = 56, which covers the M2L of p = 28. For p = 29..32 the largest ones
+// exceed 2^53 and are rounded, to within 1 ulp up to n = 64.
+template <int P> constexpr auto pascal() {
+  std::array<std::array<double, 2 * P + 1>, 2 * P + 1> c{};
+  for (int n = 0; n <= 2 * P; n++) {
+    c[n][0] = 1.0;
+    for (int k = 1; k <= n; k++) {
+      c[n][k] = c[n - 1][k - 1] + (k < n ? c[n - 1][k] : 0.0);
+    }
+  }
+  return c;
+}
+
+// Translation tables in R, indexed [k][l] for a source coefficient k and an
+// output coefficient l so the inner loops run over contiguous l
+template <int P, class R = double> struct Tables {
+  // binomial(l - 1, k - 1) for 1 <= k <= l
+  static constexpr Matrix<P, R> m2m = [] {
+    constexpr auto c = pascal<P>();
+    Matrix<P, R> m{};
+    for (int k = 1; k <= P; k++) {
+      for (int l = k; l <= P; l++) {
+        m[k][l] = R(c[l - 1][k - 1]);
+      }
+    }
+    return m;
+  }();
+
+  // (-1)^k binomial(l + k - 1, k - 1) for k, l >= 1
+  static constexpr Matrix<P, R> m2l = [] {
+    constexpr auto c = pascal<P>();
+    Matrix<P, R> m{};
+    for (int k = 1; k <= P; k++) {
+      for (int l = 1; l <= P; l++) {
+        m[k][l] = R((k % 2 == 0 ? 1.0 : -1.0) * c[l + k - 1][k - 1]);
+      }
+    }
+    return m;
+  }();
+
+  // binomial(k, l) for l <= k
+  static constexpr Matrix<P, R> l2l = [] {
+    constexpr auto c = pascal<P>();
+    Matrix<P, R> m{};
+    for (int k = 0; k <= P; k++) {
+      for (int l = 0; l <= k; l++) {
+        m[k][l] = R(c[k][l]);
+      }
+    }
+    return m;
+  }();
+
+  // (-1)^k
+  static constexpr std::array<R, P + 1> sign = [] {
+    std::array<R, P + 1> s{};
+    for (int k = 0; k <= P; k++) {
+      s[k] = k % 2 == 0 ? 1.0 : -1.0;
+    }
+    return s;
+  }();
+
+  // 1 / k, with 0 at k = 0
+  static constexpr std::array<R, P + 1> inverse = [] {
+    std::array<R, P + 1> r{};
+    for (int k = 1; k <= P; k++) {
+      r[k] = R(1.0 / k);
+    }
+    return r;
+  }();
+};
+
+// z^0 .. z^P as real and imaginary parts
+template <int P, class R> inline void powers(Complex z, R *re, R *im) {
+  re[0] = 1.0;
+  im[0] = 0.0;
+  R zr = z.real(), zi = z.imag();
+  for (int k = 1; k <= P; k++) {
+    re[k] = re[k - 1] * zr - im[k - 1] * zi;
+    im[k] = re[k - 1] * zi + im[k - 1] * zr;
+  }
+}
+
+// coeffs[k] * ratio^k as real and imaginary parts
+template <int P, class R>
+inline void split(const std::complex<R> *coeffs, double ratio, R *re, R *im) {
+  R power = 1.0;
+  for (int k = 0; k <= P; k++) {
+    re[k] = coeffs[k].real() * power;
+    im[k] = coeffs[k].imag() * power;
+    power *= R(ratio);
+  }
+}
+
+// out[k] += re[k] + i im[k] for k = first..P
+template <int P, class R, class O>
+inline void accumulate(const R *re, const R *im, std::complex<O> *out,
+                       int first = 0) {
+  for (int k = first; k <= P; k++) {
+    out[k] += std::complex<O>(re[k], im[k]);
+  }
+}
+
+// P2M (Theorem 2.1.1) of n sources, source(i) returning the i-th Point.
+// Sources are taken in blocks with per-lane partial sums, so the power
+// recurrence vectorizes across the block.
+template <int P, class SourceAt, class R>
+void p2m(Complex center, std::size_t n, SourceAt source,
+         std::complex<R> *coeffs, double scale = 1.0) {
+  constexpr auto &inverse = Tables<P, R>::inverse;
+  double inv_scale = 1.0 / scale;
+  constexpr int block = 8;
+  R sum_re[P + 1][block] = {}, sum_im[P + 1][block] = {};
+
+  for (std::size_t begin = 0; begin < n; begin += block) {
+    R zr[block], zi[block], q[block], pr[block], pi[block];
+    for (int i = 0; i < block; i++) {
+      if (begin + i < n) {
+        const Point &point = source(begin + i);
+        zr[i] = (point.position.x - center.real()) * inv_scale;
+        zi[i] = (point.position.y - center.imag()) * inv_scale;
+        q[i] = point.strength;
+      } else {
+        zr[i] = zi[i] = q[i] = 0.0;
+      }
+      pr[i] = q[i];
+      pi[i] = 0.0;
+      sum_re[0][i] += q[i];
+    }
+    for (int k = 1; k <= P; k++) {
+      for (int i = 0; i < block; i++) {
+        R re = pr[i] * zr[i] - pi[i] * zi[i];
+        R im = pr[i] * zi[i] + pi[i] * zr[i];
+        pr[i] = re;
+        pi[i] = im;
+        sum_re[k][i] += re;
+        sum_im[k][i] += im;
+      }
+    }
+  }
+
+  for (int i = 0; i < block; i++) {
+    coeffs[0] += sum_re[0][i];
+  }
+  for (int k = 1; k <= P; k++) {
+    R re = 0.0, im = 0.0;
+    for (int i = 0; i < block; i++) {
+      re += sum_re[k][i];
+      im += sum_im[k][i];
+    }
+    coeffs[k] -= std::complex<R>(re, im) * inverse[k];
+  }
+}
+
+// M2M (Lemma 2.2.1), shift = source center - target center, in units of
+// the target radius
+template <int P, class R>
+void m2m(const std::complex<R> *in, Complex shift, std::complex<R> *out,
+         double in_scale = 1.0, double out_scale = 1.0) {
+  constexpr auto &binomial = Tables<P, R>::m2m;
+  constexpr auto &inverse = Tables<P, R>::inverse;
+  R sr[P + 1], si[P + 1], ar[P + 1], ai[P + 1];
+  powers<P>(shift / out_scale, sr, si);
+  split<P>(in, in_scale / out_scale, ar, ai);
+
+  R re[P + 1], im[P + 1];
+  R a0 = ar[0];
+  re[0] = a0;
+  im[0] = 0.0;
+  for (int l = 1; l <= P; l++) {
+    re[l] = -a0 * sr[l] * inverse[l];
+    im[l] = -a0 * si[l] * inverse[l];
+  }
+  for (int k = 1; k <= P; k++) {
+    for (int l = k; l <= P; l++) {
+      R b = binomial[k][l];
+      re[l] += b * (ar[k] * sr[l - k] - ai[k] * si[l - k]);
+      im[l] += b * (ar[k] * si[l - k] + ai[k] * sr[l - k]);
+    }
+  }
+  accumulate<P>(re, im, out);
+}
+
+// M2L (Lemma 2.2.2), shift = source center - target center, in units of
+// the target radius apart from the log term, which is summed in double
+template <int P, class R, class O>
+void m2l(const std::complex<R> *in, Complex shift, std::complex<O> *out,
+         double in_scale = 1.0, double out_scale = 1.0) {
+  constexpr auto &binomial = Tables<P, R>::m2l;
+  constexpr auto &sign = Tables<P, R>::sign;
+  constexpr auto &inverse = Tables<P, R>::inverse;
+  R sr[P + 1], si[P + 1], ar[P + 1], ai[P + 1];
+  powers<P>(out_scale / shift, sr, si);
+  split<P>(in, in_scale / out_scale, ar, ai);
+
+  // b_k = a_k shift^-k, so that
+  // out[l] = shift^-l (-a_0 / l + sum_k (-1)^k binomial(l + k - 1, k - 1) b_k)
+  R br[P + 1], bi[P + 1];
+  for (int k = 0; k <= P; k++) {
+    br[k] = ar[k] * sr[k] - ai[k] * si[k];
+    bi[k] = ar[k] * si[k] + ai[k] * sr[k];
+  }
+
+  Complex out0 = Complex(in[0]) * std::log(-shift);
+  R re[P + 1], im[P + 1];
+  for (int l = 0; l <= P; l++) {
+    re[l] = -ar[0] * inverse[l];
+    im[l] = -ai[0] * inverse[l];
+  }
+  for (int k = 1; k <= P; k++) {
+    out0 += double(sign[k]) * Complex(br[k], bi[k]);
+    for (int l = 1; l <= P; l++) {
+      re[l] += binomial[k][l] * br[k];
+      im[l] += binomial[k][l] * bi[k];
+    }
+  }
+  for (int l = 1; l <= P; l++) {
+    R r = re[l] * sr[l] - im[l] * si[l];
+    im[l] = re[l] * si[l] + im[l] * sr[l];
+    re[l] = r;
+  }
+  out[0] += std::complex<O>(out0);
+  accumulate<P>(re, im, out, 1);
+}
+
+// L2L (Lemma 2.2.3), shift = source center - target center, in units of
+// the target radius
+template <int P, class R>
+void l2l(const std::complex<R> *in, Complex shift, std::complex<R> *out,
+         double in_scale = 1.0, double out_scale = 1.0) {
+  constexpr auto &binomial = Tables<P, R>::l2l;
+  R sr[P + 1], si[P + 1], ar[P + 1], ai[P + 1];
+  powers<P>(-shift / out_scale, sr, si);
+  split<P>(in, out_scale / in_scale, ar, ai);
+
+  // out[l] = sum_k binomial(k, l) a_k (-shift)^(k - l), k = l..p
+  R re[P + 1] = {}, im[P + 1] = {};
+  for (int k = 0; k <= P; k++) {
+    for (int l = 0; l <= k; l++) {
+      R b = binomial[k][l];
+      re[l] += b * (ar[k] * sr[k - l] - ai[k] * si[k - l]);
+      im[l] += b * (ar[k] * si[k - l] + ai[k] * sr[k - l]);
+    }
+  }
+  accumulate<P>(re, im, out);
+}
+
+// L2P: Re of the local expansion at z = (point - center) / scale, by
+// Horner's rule
+template <int P, class R>
+double l2p(const std::complex<R> *coeffs, Complex center, Vector2 point,
+           double scale = 1.0) {
+  double inv_scale = 1.0 / scale;
+  R zr = (point.x - center.real()) * inv_scale;
+  R zi = (point.y - center.imag()) * inv_scale;
+  R re = coeffs[P].real(), im = coeffs[P].imag();
+  for (int l = P - 1; l >= 0; l--) {
+    R r = re * zr - im * zi + coeffs[l].real();
+    im = re * zi + im * zr + coeffs[l].imag();
+    re = r;
+  }
+  return re;
+}
+
+// Calls f(std::integral_constant<int, p>{}) when p has an instantiation and
+// returns whether it did
+template <class F> bool dispatch(int p, F &&f) {
+  if (p < min_order || p > max_order) {
+    return false;
+  }
+  [&]<int... I>(std::integer_sequence<int, I...>) {
+    (void)((p == min_order + I &&
+            (f(std::integral_constant<int, min_order + I>{}), true)) ||
+           ...);
+  }(std::make_integer_sequence<int, max_order - min_order + 1>{});
+  return true;
+}
+
+} // namespace fixed_order
+
+// Multipole expansion of compile-time order P, with inline coefficients
+template <int P> struct MultipoleExpansionP {
+  static constexpr int p = P;
+  Complex center;
+  double scale = 1.0; // radius, as for MultipoleExpansion
+  std::array<Complex, P + 1> coeffs{};
+
+  explicit MultipoleExpansionP(Vector2 center, double scale = 1.0)
+      : center(center.x, center.y), scale(scale) {}
+
+  void clear() { coeffs.fill(0.0); }
+
+  void buildExpansion(const std::vector<Point> &sources) {
+    fixed_order::p2m<P>(
+        center, sources.size(),
+        [&](std::size_t i) -> const Point & { return sources[i]; },
+        coeffs.data(), scale);
+  }
+
+  // translations accumulate into out, an expansion of radius out_scale;
+  // shift is this center minus the target center
+  void M2MInto(const Complex &shift, std::span<Complex, P + 1> out,
+               double out_scale = 1.0) const {
+    fixed_order::m2m<P>(coeffs.data(), shift, out.data(), scale, out_scale);
+  }
+  void M2LInto(const Complex &shift, std::span<Complex, P + 1> out,
+               double out_scale = 1.0) const {
+    fixed_order::m2l<P>(coeffs.data(), shift, out.data(), scale, out_scale);
+  }
+};
+
+// Local expansion of compile-time order P, with inline coefficients
+template <int P> struct LocalExpansionP {
+  static constexpr int p = P;
+  Complex center;
+  double scale = 1.0; // radius, as for LocalExpansion
+  std::array<Complex, P + 1> coeffs{};
+
+  explicit LocalExpansionP(Vector2 center, double scale = 1.0)
+      : center(center.x, center.y), scale(scale) {}
+
+  void clear() { coeffs.fill(0.0); }
+
+  double evaluate(Vector2 point) const {
+    return fixed_order::l2p<P>(coeffs.data(), center, point, scale);
+  }
+
+  void L2LInto(const Complex &shift, std::span<Complex, P + 1> out,
+               double out_scale = 1.0) const {
+    fixed_order::l2l<P>(coeffs.data(), shift, out.data(), scale, out_scale);
+  }
+};
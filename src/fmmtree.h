@@ -1,10 +1,30 @@
 #pragma once
 
+#include "arena.h"
+#include "gemm.h"
+#include "lattice.h"
+#include "m2lcache.h"
+#include "m2lcompressed.h"
+#include "morton.h"
+#include "p2p.h"
 #include "point.h"
+#include "profile.h"
+#include "staticvector.h"
+#include "taskgraph.h"
+#include "threadpool.h"
+#include "treeimage.h"
 
+#include <algorithm>
 #include <cmath>
 #include <complex>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 using Complex = std::complex<double>;
@@ -15,12 +35,43 @@ template <class Kernel> struct FmmNode2 {
   using Multipole = typename Kernel::Multipole;
   using Local = typename Kernel::Local;
 
+  using MultipoleCoefficient = typename Multipole::Coefficient;
+  using LocalCoefficient = typename Local::Coefficient;
+
+  // whether both expansions hold double coefficients, which the cached,
+  // batched and compressed M2L operators and saved images require
+  static constexpr bool double_coefficients =
+      std::is_same_v<MultipoleCoefficient, Complex> &&
+      std::is_same_v<LocalCoefficient, Complex>;
+
+  // bytes of the p + 1 multipole and p + 1 local coefficients of a node
+  static std::size_t coefficientBytes(int p) {
+    return (p + 1) * (sizeof(MultipoleCoefficient) + sizeof(LocalCoefficient));
+  }
+
   FmmNode2(int p, Box2 box, NodeType type)
       : box(box), type(type), multipole(p, box.center), local(p, box.center) {}
 
+  // expansions viewing the coefficientBytes(p) at coefficients: the
+  // multipole first, then the local expansion; zeroed unless zero is false
+  FmmNode2(int p, Box2 box, NodeType type, std::byte *coefficients,
+           bool zero = true)
+      : box(box), type(type),
+        multipole(p, box.center,
+                  reinterpret_cast<MultipoleCoefficient *>(coefficients),
+                  zero),
+        local(p, box.center,
+              reinterpret_cast<LocalCoefficient *>(
+                  coefficients + (p + 1) * sizeof(MultipoleCoefficient)),
+              zero) {}
+
   Box2 box;
   NodeType type;
-  std::vector<Point> points; // for leaf nodes
+  std::size_t index = 0; // position within its level
+
+  // for leaf nodes, range of the tree's Morton-ordered sources
+  std::size_t point_begin = 0;
+  std::size_t point_end = 0;
 
   FmmNode2 *parent = nullptr;
   FmmNode2 *children[4] = {nullptr, nullptr, nullptr, nullptr};
@@ -28,12 +79,277 @@ template <class Kernel> struct FmmNode2 {
   Multipole multipole;
   Local local;
 
-  std::vector<FmmNode2 *> near_neighbors;
-  std::vector<FmmNode2 *> interaction_list;
+  StaticVector<FmmNode2 *, 9> near_neighbors;
+  StaticVector<FmmNode2 *, 27> interaction_list;
+  // periodic trees only: the image each list entry is taken at (see
+  // imageIndex); empty for free-space trees
+  StaticVector<uint8_t, 9> near_images;
+  StaticVector<uint8_t, 27> interaction_images;
 
   bool is_leaf() const { return type == NodeType::Leaf; }
 };
 
+// image of a periodic cell at cell offset (dx, dy), |dx|, |dy| <= 1
+inline uint8_t imageIndex(int dx, int dy) { return 3 * (dy + 1) + dx + 1; }
+
+// translation of the image of entry i of a node's list, for a cell of side
+// period; zero for free-space trees, whose image lists are empty
+template <std::size_t N>
+Vector2 imageShift(const StaticVector<uint8_t, N> &images, std::size_t i,
+                   double period) {
+  if (images.empty()) {
+    return Vector2::zeros();
+  }
+  return Vector2(images[i] % 3 - 1, images[i] / 3 - 1) * period;
+}
+
+enum class FmmSchedule : uint8_t {
+  // one parallel loop per stage and level, with a barrier in between
+  Levels,
+  // a single dependency-driven task graph for P2M, M2M, M2L, L2L, L2P and
+  // P2P, so that the near field fills the gaps left by the tree passes; the
+  // source potentials are computed during construction
+  TaskGraph
+};
+
+enum class M2LMode : uint8_t {
+  // per-pair Local::M2L recurrence
+  Direct,
+  // matrix-vector products with precomputed per-(level, offset) operators
+  Cached,
+  // the pairs of a level that share an operator are applied together as one
+  // complex GEMM (per-node cached products under FmmSchedule::TaskGraph,
+  // where a per-level batch would reintroduce the level barrier)
+  Batched,
+  // Batched, on operators compressed to FmmOptions::m2l_tolerance (see
+  // CompressedM2LOperators); per-node cached products under
+  // FmmSchedule::TaskGraph, as for Batched
+  Compressed
+};
+
+// Interaction-list pairs of one level that share a translation operator
+template <class Node> struct M2LBatch {
+  int offset_index;
+  std::vector<const Node *> sources;
+  std::vector<Node *> targets;
+};
+
+// Groups the interaction-list pairs of one level of a uniform tree by the
+// offset between source and target box, the source taken at its image in a
+// periodic tree of cell side period
+template <class Node>
+std::vector<M2LBatch<Node>>
+groupInteractions(const std::vector<Node *> &nodes, double period = 0.0) {
+  std::vector<M2LBatch<Node>> batches(M2LOperatorCache::num_offsets);
+  for (int i = 0; i < M2LOperatorCache::num_offsets; i++) {
+    batches[i].offset_index = i;
+  }
+
+  for (Node *node : nodes) {
+    double side = 2.0 * node->box.half_side;
+    for (std::size_t i = 0; i < node->interaction_list.size(); i++) {
+      Node *interaction = node->interaction_list[i];
+      Vector2 offset = (interaction->box.center +
+                        imageShift(node->interaction_images, i, period) -
+                        node->box.center) /
+                       side;
+      int slot = M2LOperatorCache::offsetIndex(std::lround(offset.x),
+                                               std::lround(offset.y));
+      batches[slot].sources.push_back(interaction);
+      batches[slot].targets.push_back(node);
+    }
+  }
+  return batches;
+}
+
+// Applies each batch as complex GEMMs over blocks of pairs: the source
+// coefficients are packed into a contiguous n x pairs block, multiplied by
+// the batch's n x n operator, matrix(offset_index), and scattered into the
+// target coefficients. A target occurs at most once per batch, so the blocks
+// of a batch run in parallel. Each node's coefficients are a row-major
+// n x width block, at source_block(node) for the source and
+// target_block(node) for the target.
+template <class Node, class Matrix, class SourceBlock, class TargetBlock>
+void batchedTranslate(int n, Matrix matrix,
+                      const std::vector<M2LBatch<Node>> &batches,
+                      ThreadPool &pool, int width, SourceBlock source_block,
+                      TargetBlock target_block) {
+  const std::size_t block = std::max(1, 256 / width);
+
+  for (const M2LBatch<Node> &batch : batches) {
+    std::size_t num_pairs = batch.sources.size();
+    std::size_t num_blocks = (num_pairs + block - 1) / block;
+    const Complex *T = matrix(batch.offset_index);
+
+    pool.parallel_for(num_blocks, [&](std::size_t b) {
+      std::size_t begin = b * block;
+      int pairs = std::min(block, num_pairs - begin);
+      int cols = pairs * width;
+
+      thread_local std::vector<Complex> packed;
+      thread_local std::vector<Complex> result;
+      packed.resize(n * cols);
+      result.assign(n * cols, 0.0);
+
+      for (int j = 0; j < pairs; j++) {
+        const Complex *coeffs = source_block(batch.sources[begin + j]);
+        for (int k = 0; k < n; k++) {
+          std::copy(coeffs + k * width, coeffs + (k + 1) * width,
+                    &packed[k * cols + j * width]);
+        }
+      }
+
+      complexGemm(n, cols, n, T, n, packed.data(), cols, result.data(), cols);
+
+      for (int j = 0; j < pairs; j++) {
+        Complex *coeffs = target_block(batch.targets[begin + j]);
+        for (int l = 0; l < n; l++) {
+          for (int r = 0; r < width; r++) {
+            coeffs[l * width + r] += result[l * cols + j * width + r];
+          }
+        }
+      }
+    });
+  }
+}
+
+// batchedTranslate with the cached M2L operators of level, from multipole
+// coefficient blocks of (p+1) x width to local ones
+template <class Node, class SourceBlock, class TargetBlock>
+void batchedM2L(const M2LOperatorCache &cache, int level,
+                const std::vector<M2LBatch<Node>> &batches, ThreadPool &pool,
+                int width, SourceBlock source_block,
+                TargetBlock target_block) {
+  batchedTranslate(
+      cache.p() + 1,
+      [&](int offset_index) { return cache.matrix(level, offset_index); },
+      batches, pool, width, source_block, target_block);
+}
+
+template <class Node>
+void batchedM2L(const M2LOperatorCache &cache, int level,
+                const std::vector<M2LBatch<Node>> &batches, ThreadPool &pool) {
+  batchedM2L(
+      cache, level, batches, pool, 1,
+      [](const Node *node) { return node->multipole.coeffs.data(); },
+      [](Node *node) { return node->local.coeffs.data(); });
+}
+
+// M2L for all of nodes, one whole level of a uniform tree indexed by
+// Node::index, with the compressed operators: the multipoles are projected
+// onto the level's basis in blocks of nodes, the batches are applied to the
+// projections with the rank x rank cores, and the sums are expanded into the
+// local coefficients, all as complex GEMMs
+template <class Node>
+void compressedM2L(const CompressedM2LOperators &operators, int level,
+                   const std::vector<Node *> &nodes,
+                   const std::vector<M2LBatch<Node>> &batches,
+                   ThreadPool &pool) {
+  constexpr std::size_t block = 64;
+  int n = operators.p() + 1;
+  int r = operators.rank(level);
+  std::size_t num_blocks = (nodes.size() + block - 1) / block;
+  std::vector<Complex> compressed(nodes.size() * r, 0.0);
+  std::vector<Complex> sums(nodes.size() * r, 0.0);
+
+  pool.parallel_for(num_blocks, [&](std::size_t b) {
+    std::size_t begin = b * block;
+    int count = std::min(block, nodes.size() - begin);
+    thread_local std::vector<Complex> packed;
+    packed.resize(count * n);
+    for (int i = 0; i < count; i++) {
+      const Complex *coeffs = nodes[begin + i]->multipole.coeffs.data();
+      std::copy(coeffs, coeffs + n, &packed[i * n]);
+    }
+    complexGemm(count, r, n, packed.data(), n,
+                operators.compressMatrix(level), r, &compressed[begin * r],
+                r);
+  });
+
+  batchedTranslate(
+      r,
+      [&](int offset_index) { return operators.core(level, offset_index); },
+      batches, pool, 1,
+      [&](const Node *node) { return &compressed[node->index * r]; },
+      [&](const Node *node) { return &sums[node->index * r]; });
+
+  pool.parallel_for(num_blocks, [&](std::size_t b) {
+    std::size_t begin = b * block;
+    int count = std::min(block, nodes.size() - begin);
+    thread_local std::vector<Complex> result;
+    result.assign(count * n, 0.0);
+    complexGemm(count, n, r, &sums[begin * r], r,
+                operators.expandMatrix(level), n, result.data(), n);
+    for (int i = 0; i < count; i++) {
+      Complex *coeffs = nodes[begin + i]->local.coeffs.data();
+      for (int l = 0; l < n; l++) {
+        coeffs[l] += result[i * n + l];
+      }
+    }
+  });
+}
+
+// Execution options for NaiveFmmTree
+struct FmmOptions {
+  // threads used for the upward/downward passes and evaluateSources; the
+  // nodes of a level are independent, so each level is split across the pool
+  int num_threads = 1;
+  FmmSchedule schedule = FmmSchedule::Levels;
+
+  // modes other than Direct need double-precision expansions
+  M2LMode m2l = M2LMode::Direct;
+  // operators from an earlier tree with the same p and root box; rebuilt when
+  // missing or incompatible
+  std::shared_ptr<const M2LOperatorCache> m2l_cache;
+  // M2LMode::Compressed: singular values dropped relative to the largest,
+  // which leaves relative errors of about 5 to 50 times this in the
+  // potentials, and compressed operators from an earlier tree, rebuilt like
+  // m2l_cache
+  double m2l_tolerance = 1e-12;
+  std::shared_ptr<const CompressedM2LOperators> m2l_compressed;
+
+  // scale each box's expansions by its radius (half side) so that their
+  // coefficients stay O(1) at high p and for very small or large boxes
+  bool scaled = false;
+
+  // Periodic boundary conditions: the sources are one cell of an infinite
+  // lattice of images of this square cell, which becomes the root box.
+  // Sources and targets outside it are wrapped into it. The lists take the
+  // nearest images at every level, down from the root's 3x3 block, and
+  // the farther images reach the root's local expansion through a
+  // LatticeSumOperator. The cell must be charge neutral and the tree at
+  // least one level deep; save() and the multi-RHS evaluateSources are
+  // free-space only.
+  std::optional<Box2> periodic_cell;
+};
+
+// Tree parameters chosen by FmmPlanner. A plan is plain values, so it can be
+// stored and passed to later trees to reproduce the same configuration.
+struct FmmPlan {
+  double tolerance = 0.0;
+  int p = 5;
+  int height = 0;                 // NaiveFmmTree
+  std::size_t leaf_capacity = 32; // AdaptiveFmmTree
+};
+
+// Storage held by a tree, in bytes
+struct FmmMemoryUsage {
+  std::size_t num_nodes = 0;
+  std::size_t nodes = 0;        // per-level node arenas
+  // multipole and local coefficients, unless mapped from a saved image
+  std::size_t coefficients = 0;
+  std::size_t levels = 0;       // per-level node pointer lists
+  std::size_t sources = 0;      // Morton-ordered sources and permutation
+
+  std::size_t total() const { return nodes + coefficients + levels + sources; }
+  // node record plus its expansion coefficients
+  double per_node() const {
+    return num_nodes == 0 ? 0.0
+                          : static_cast<double>(nodes + coefficients) /
+                                num_nodes;
+  }
+};
+
 // Balanced FMM tree implementation
 template <class Kernel> struct NaiveFmmTree {
   using Multipole = typename Kernel::Multipole;
@@ -41,108 +357,1170 @@ template <class Kernel> struct NaiveFmmTree {
 
   using Node = FmmNode2<Kernel>;
 
-  NaiveFmmTree(int p, const std::vector<Point> &sources, int height);
-  ~NaiveFmmTree();
+  NaiveFmmTree(int p, const std::vector<Point> &sources, int height,
+               FmmOptions options = {});
+  // order and height from a plan (see FmmPlanner)
+  NaiveFmmTree(const FmmPlan &plan, const std::vector<Point> &sources,
+               FmmOptions options = {})
+      : NaiveFmmTree(plan.p, sources, plan.height, options) {}
+  // A tree saved by save() with the same Kernel. The image is mapped and the
+  // nodes are linked from its index arrays, so no geometry is recomputed;
+  // saved expansions are used in place, copy-on-write, and otherwise built
+  // from the saved sources. p, the height and options.scaled come from the
+  // image. Under FmmSchedule::TaskGraph the expansions are always recomputed,
+  // as the source potentials come out of the same pass. Throws
+  // std::runtime_error for a missing or malformed image.
+  explicit NaiveFmmTree(const std::string &path, FmmOptions options = {});
 
   Node *root() const { return root_; }
   int height() const { return height_; }
+  const std::vector<Node *> &level(int level) const { return levels_[level]; }
   std::size_t num_leaves() const { return std::pow(4, height_); }
+  std::size_t num_sources() const { return order_.size(); }
 
   double evaluate(Vector2 point) const;
   std::vector<double> evaluateSources() const;
+  // Numeric phase for several strength vectors over this tree's geometry
+  // (nodes, lists and source binning), without rebuilding it. strengths[r][i]
+  // is the strength of source i in right-hand side r; the result holds one
+  // potential vector per right-hand side. Every node carries a (p+1) x K
+  // block of coefficients, so each M2M, M2L and L2L is a complex GEMM over
+  // the K right-hand sides.
+  std::vector<std::vector<double>>
+  evaluateSources(const std::vector<std::vector<double>> &strengths) const;
+  // potentials at arbitrary targets, in the order given: the targets are
+  // binned into leaves with one Morton sort and each leaf's block of targets
+  // gets one L2P and one P2P pass per near neighbor
+  std::vector<double> evaluateTargets(std::span<const Vector2> targets) const;
+  // potential and its gradient, from the derivative of the local expansion
+  // and the kernel's gradient near field
+  PotentialGradient evaluateWithGradient(Vector2 point) const;
+  std::vector<PotentialGradient> evaluateSourcesWithGradient() const;
+
+  // per-task timings of the last task graph run (FmmSchedule::TaskGraph)
+  const TaskGraphProfile &task_profile() const { return task_profile_; }
+  // M2L operators used by M2LMode::Cached, to be passed to later trees
+  std::shared_ptr<const M2LOperatorCache> m2l_cache() const {
+    return options_.m2l_cache;
+  }
+  // operators used by M2LMode::Compressed, likewise
+  std::shared_ptr<const CompressedM2LOperators> m2l_compressed() const {
+    return options_.m2l_compressed;
+  }
+
+  FmmMemoryUsage memory_usage() const;
+
+  // Writes the geometry (node boxes, parent and child indices, near-neighbor
+  // and interaction lists, leaf ranges and the Morton-ordered sources) and,
+  // with expansions, the coefficients, in the format of treeimage.h. Images
+  // hold double coefficients, so other precisions save the geometry only.
+  void save(const std::string &path, bool expansions = true) const;
+
+  // Moves the sources to new positions and strengths, indexed like the
+  // construction sources, and recomputes the expansions on the existing
+  // nodes and lists. Only sources that cross a leaf boundary are re-binned
+  // and only the multipoles of changed leaves and their ancestors are
+  // rebuilt (all of them under FmmSchedule::TaskGraph); the downward pass is
+  // redone in full. The root box is re-fit, keeping the tree structure, only
+  // when a source leaves it.
+  void update(std::span<const Vector2> positions,
+              std::span<const double> strengths);
 
 protected:
   int p_;
   Node *root_;
   int height_;
   std::vector<std::vector<Node *>> levels_;
-  const std::vector<Point> &sources_;
+  // nodes live in one arena per level and their expansion coefficients in one
+  // aligned buffer, Node::coefficientBytes(p) per node in creation order
+  std::vector<Arena<Node>> node_arenas_;
+  AlignedBuffer<std::byte> coefficients_;
+  // coefficients_, or the mapped image's expansions of a loaded tree
+  std::byte *coefficient_data_ = nullptr;
+  std::unique_ptr<FmmTreeImage> image_;
+  std::size_t num_nodes_ = 0;
+  FmmOptions options_;
+  mutable ThreadPool pool_;
+  TaskGraphProfile task_profile_;
+  std::vector<double> source_potentials_; // FmmSchedule::TaskGraph only
+  // M2LMode::Batched and M2LMode::Compressed
+  std::vector<std::vector<M2LBatch<Node>>> m2l_batches_;
+  // far images of a periodic tree
+  std::optional<LatticeSumOperator> lattice_;
+  // multi-RHS evaluateSources: the operators and, unless m2l_batches_ has
+  // them, the per-level batches, built by the first call and kept
+  mutable std::mutex multi_rhs_mutex_;
+  mutable std::shared_ptr<const M2LOperatorCache> multi_rhs_cache_;
+  mutable std::vector<std::vector<M2LBatch<Node>>> multi_rhs_batches_;
+
+  // sources in Morton order of their leaves, as structure of arrays
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<double> strengths_;
+  std::vector<std::size_t> order_; // sorted position -> source index
+  std::vector<uint64_t> keys_;     // sorted position -> leaf index
 
 private:
   std::size_t getLeafIndex(Vector2 position) const;
+  bool periodic() const { return options_.periodic_cell.has_value(); }
+  // side of the periodic cell, 0 for free-space trees
+  double period() const {
+    return periodic() ? 2.0 * root_->box.half_side : 0.0;
+  }
+  // position moved into the periodic cell; unchanged for free-space trees
+  Vector2 wrap(Vector2 position) const;
+  void checkNeutral(double total, double magnitude) const;
+  Node *newNode(int level, Box2 box, bool zero = true);
   void buildChildNodes(Node *node, int level);
   void computeNodeLists(Node *node);
+  void sortSources(const std::vector<Point> &sources);
+  template <class Source>
+  void binSources(std::vector<uint64_t> keys, Source source);
+  void refit(std::span<const Vector2> positions);
+  void buildGeometry(const std::vector<Point> &sources);
+  void linkGeometry(const FmmTreeImageContents &image);
+  void prepareM2L();
+  void computeExpansions(std::vector<uint8_t> dirty_leaves = {});
+
+  void buildLeafExpansion(Node *leaf);
+  double nearField(const Node *leaf, Vector2 point,
+                   const double *strength) const;
+  void nearFieldSources(const Node *leaf, double *out) const;
+  void nearFieldTargets(const Node *leaf, const double *strength,
+                        const double *tx, const double *ty, double *out,
+                        std::size_t num_targets) const;
+  void nearFieldTargets(const Node *leaf, const double *strengths,
+                        std::size_t num_rhs, const double *tx,
+                        const double *ty, double *out,
+                        std::size_t num_targets) const;
+  std::shared_ptr<const M2LOperatorCache> prepareMultiRhs() const;
+  PotentialGradient nearFieldWithGradient(const Node *leaf,
+                                          Vector2 point) const;
+  void nearFieldSourcesWithGradient(const Node *leaf, double *potential,
+                                    double *gx, double *gy) const;
+  void translateChildren(Node *node);
+  void translateParent(Node *node);
+  void translateInteractions(Node *node, int level);
+  void translateLattice();
+  void runTaskGraph();
+
+  // operation counts for the profiler
+  std::size_t numInteractions(int level) const;
+  std::size_t numNearSources(const Node *leaf) const;
 };
 
 template <class Kernel>
 std::size_t NaiveFmmTree<Kernel>::getLeafIndex(Vector2 position) const {
-  std::size_t index = 0;
-  Box2 bbox = root_->box;
-  for (int level = 0; level < height_; level++) {
-    uint32_t quadrant = getQuadrant(bbox, position);
-    index = (index << 2) | quadrant;
-    bbox = getChildBox(bbox, quadrant);
+  return mortonKey(root_->box, height_, position);
+}
+
+template <class Kernel>
+Vector2 NaiveFmmTree<Kernel>::wrap(Vector2 position) const {
+  if (!periodic()) {
+    return position;
+  }
+  double side = period();
+  Vector2 low = root_->box.center - Vector2(1.0, 1.0) * root_->box.half_side;
+  return Vector2(position.x - side * std::floor((position.x - low.x) / side),
+                 position.y - side * std::floor((position.y - low.y) / side));
+}
+
+// the lattice sum of a periodic tree diverges unless the strengths cancel
+template <class Kernel>
+void NaiveFmmTree<Kernel>::checkNeutral(double total,
+                                        double magnitude) const {
+  if (std::abs(total) > 1e-12 * magnitude) {
+    throw std::invalid_argument("periodic sources must sum to zero strength");
   }
-  return index;
 }
 
 template <class Kernel>
 NaiveFmmTree<Kernel>::NaiveFmmTree(int p, const std::vector<Point> &sources,
-                                   int height)
-    : p_(p), height_(height), sources_(sources) {
+                                   int height, FmmOptions options)
+    : p_(p), height_(height), options_(options), pool_(options.num_threads) {
+  if (periodic()) {
+    if (height_ < 1 || options_.periodic_cell->half_side <= 0.0) {
+      throw std::invalid_argument("periodic trees need a cell and height >= "
+                                  "1");
+    }
+    double total = 0.0;
+    double magnitude = 0.0;
+    for (const Point &source : sources) {
+      total += source.strength;
+      magnitude += std::abs(source.strength);
+    }
+    checkNeutral(total, magnitude);
+  }
   if (height_ == 0) {
     return;
   }
-  levels_.resize(height_ + 1);
+  buildGeometry(sources);
+  computeExpansions();
+}
+
+// geometry phase: nodes, near and interaction lists, source binning and the
+// M2L operators and batches, none of which depend on the strengths
+template <class Kernel>
+void NaiveFmmTree<Kernel>::buildGeometry(const std::vector<Point> &sources) {
+  {
+    FMM_PROFILE_SCOPE(TreeBuild, -1);
+    levels_.resize(height_ + 1);
+    std::size_t total_nodes = 0;
+    for (int level = 0; level <= height_; level++) {
+      std::size_t level_nodes = std::size_t(1) << (2 * level);
+      node_arenas_.emplace_back(level_nodes);
+      levels_[level].reserve(level_nodes);
+      total_nodes += level_nodes;
+    }
+    coefficients_ = AlignedBuffer<std::byte>(Node::coefficientBytes(p_) *
+                                             total_nodes);
+    coefficient_data_ = coefficients_.data();
+
+    root_ = newNode(0, periodic() ? *options_.periodic_cell
+                                  : computeBoundingBox(sources));
+    for (int level = 0; level <= height_; level++) {
+      for (Node *node : levels_[level]) {
+        buildChildNodes(node, level);
+      }
+    }
+    FMM_PROFILE_WORK(TreeBuild, -1, num_nodes_, 0.0, 0);
+  }
+
+  {
+    // parents before children, as computeNodeLists expects
+    FMM_PROFILE_SCOPE(Lists, -1);
+    for (int level = 0; level <= height_; level++) {
+      for (Node *node : levels_[level]) {
+        computeNodeLists(node);
+      }
+    }
+    prepareM2L();
+    FMM_PROFILE_WORK(Lists, -1, num_nodes_, 0.0, 0);
+  }
+
+  FMM_PROFILE_SCOPE(Binning, -1);
+  sortSources(sources);
+  FMM_PROFILE_WORK(Binning, -1, 1, 0.0, sources.size());
+}
+
+// M2L operators and, for batched and compressed M2L, the per-level batches
+// of the interaction lists
+template <class Kernel> void NaiveFmmTree<Kernel>::prepareM2L() {
+  if (periodic()) {
+    lattice_.emplace(p_, root_->box.half_side);
+  }
+  if (options_.m2l != M2LMode::Direct && !Node::double_coefficients) {
+    throw std::invalid_argument("M2L operators need double-precision "
+                                "expansions");
+  }
+  if (options_.m2l != M2LMode::Direct &&
+      !(options_.m2l_cache &&
+        options_.m2l_cache->compatible(p_, root_->box.half_side, height_,
+                                       options_.scaled))) {
+    options_.m2l_cache = std::make_shared<const M2LOperatorCache>(
+        p_, root_->box.half_side, height_, options_.scaled);
+  }
+  if (options_.m2l == M2LMode::Compressed &&
+      options_.schedule == FmmSchedule::Levels &&
+      !(options_.m2l_compressed &&
+        options_.m2l_compressed->compatible(*options_.m2l_cache,
+                                            options_.m2l_tolerance))) {
+    options_.m2l_compressed = std::make_shared<const CompressedM2LOperators>(
+        *options_.m2l_cache, options_.m2l_tolerance);
+  }
+
+  if ((options_.m2l == M2LMode::Batched ||
+       options_.m2l == M2LMode::Compressed) &&
+      options_.schedule == FmmSchedule::Levels) {
+    m2l_batches_.resize(height_ + 1);
+    for (int level = 2; level <= height_; level++) {
+      m2l_batches_[level] = groupInteractions(levels_[level], period());
+    }
+  }
+}
 
-  Box2 root_box = computeBoundingBox(sources);
-  root_ = new Node(p_, root_box, NodeType::Leaf);
-  levels_[0].push_back(root_);
+template <class Kernel>
+NaiveFmmTree<Kernel>::NaiveFmmTree(const std::string &path,
+                                   FmmOptions options)
+    : image_(std::make_unique<FmmTreeImage>(path)), options_(options),
+      pool_(options.num_threads) {
+  if (periodic()) {
+    throw std::invalid_argument("tree images are free-space only");
+  }
+  const FmmTreeImageContents &image = image_->contents();
+  p_ = image.p;
+  height_ = image.height;
+  options_.scaled = image.scaled;
+  if (height_ == 0) {
+    return;
+  }
+  linkGeometry(image);
+  if (image.coefficients.empty() || !Node::double_coefficients ||
+      options_.schedule == FmmSchedule::TaskGraph) {
+    computeExpansions();
+  }
+}
 
+// Creates the nodes in the order buildGeometry does, which is the image's
+// numbering, and links them from the image's index arrays
+template <class Kernel>
+void NaiveFmmTree<Kernel>::linkGeometry(const FmmTreeImageContents &image) {
+  FMM_PROFILE_SCOPE(TreeBuild, -1);
+  levels_.resize(height_ + 1);
+  std::size_t total_nodes = 0;
   for (int level = 0; level <= height_; level++) {
-    for (Node *node : levels_[level]) {
-      buildChildNodes(node, level);
-      computeNodeLists(node);
+    std::size_t level_nodes = std::size_t(1) << (2 * level);
+    node_arenas_.emplace_back(level_nodes);
+    levels_[level].reserve(level_nodes);
+    total_nodes += level_nodes;
+  }
+  if (image.num_nodes() != total_nodes || p_ < 0) {
+    throw std::runtime_error("tree image does not match its height");
+  }
+  // saved expansions are double; other precisions rebuild theirs
+  bool mapped = !image.coefficients.empty() && Node::double_coefficients;
+  if (!mapped) {
+    coefficients_ = AlignedBuffer<std::byte>(Node::coefficientBytes(p_) *
+                                             total_nodes);
+    coefficient_data_ = coefficients_.data();
+  } else {
+    coefficient_data_ =
+        reinterpret_cast<std::byte *>(image_->coefficients().data());
+  }
+
+  std::vector<Node *> nodes;
+  nodes.reserve(total_nodes);
+  for (int level = 0; level <= height_; level++) {
+    for (std::size_t i = 0; i < levels_[level].capacity(); i++) {
+      const double *box = &image.boxes[3 * nodes.size()];
+      // saved coefficients are kept, and their pages stay unwritten
+      nodes.push_back(
+          newNode(level, Box2{Vector2(box[0], box[1]), box[2]}, !mapped));
+    }
+  }
+
+  auto node = [&](uint64_t g) {
+    if (g >= total_nodes) {
+      throw std::runtime_error("tree image node index out of range");
+    }
+    return nodes[g];
+  };
+  std::size_t num_sources = image.xs.size();
+  for (std::size_t g = 0; g < total_nodes; g++) {
+    Node *n = nodes[g];
+    n->parent = image.parents[g] < 0 ? nullptr : node(image.parents[g]);
+    n->type = image.first_children[g] < 0 ? NodeType::Leaf
+                                           : NodeType::Internal;
+    for (int q = 0; q < 4 && !n->is_leaf(); q++) {
+      n->children[q] = node(image.first_children[g] + q);
+    }
+    n->point_begin = image.point_ranges[2 * g];
+    n->point_end = image.point_ranges[2 * g + 1];
+    if (n->point_begin > n->point_end || n->point_end > num_sources) {
+      throw std::runtime_error("tree image point range out of range");
+    }
+    // push_back throws on more entries than the geometry allows
+    for (uint64_t k = image.near_offsets[g]; k < image.near_offsets[g + 1];
+         k++) {
+      n->near_neighbors.push_back(node(image.near_indices[k]));
+    }
+    for (uint64_t k = image.interaction_offsets[g];
+         k < image.interaction_offsets[g + 1]; k++) {
+      n->interaction_list.push_back(node(image.interaction_indices[k]));
+    }
+  }
+  root_ = nodes[0];
+  prepareM2L();
+
+  xs_.assign(image.xs.begin(), image.xs.end());
+  ys_.assign(image.ys.begin(), image.ys.end());
+  strengths_.assign(image.strengths.begin(), image.strengths.end());
+  order_.assign(image.order.begin(), image.order.end());
+  keys_.assign(image.keys.begin(), image.keys.end());
+  if (ys_.size() != num_sources || strengths_.size() != num_sources ||
+      order_.size() != num_sources || keys_.size() != num_sources) {
+    throw std::runtime_error("tree image source arrays differ in length");
+  }
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::save(const std::string &path,
+                                bool expansions) const {
+  if (periodic()) {
+    throw std::invalid_argument("periodic trees cannot be saved");
+  }
+  // node g of level l is level_begin[l] + its index within the level; a
+  // tree of height 0 has no levels
+  int num_levels = levels_.size();
+  std::vector<uint64_t> level_begin(num_levels + 1, 0);
+  for (int level = 0; level < num_levels; level++) {
+    level_begin[level + 1] = level_begin[level] + levels_[level].size();
+  }
+  std::size_t num_nodes = level_begin[num_levels];
+
+  std::vector<double> boxes;
+  std::vector<int32_t> parents, first_children;
+  std::vector<uint64_t> point_ranges;
+  std::vector<uint64_t> near_offsets{0}, interaction_offsets{0};
+  std::vector<uint32_t> near_indices, interaction_indices;
+  boxes.reserve(3 * num_nodes);
+  for (int level = 0; level < num_levels; level++) {
+    for (const Node *node : levels_[level]) {
+      boxes.insert(boxes.end(), {node->box.center.x, node->box.center.y,
+                                 node->box.half_side});
+      parents.push_back(
+          node->parent == nullptr
+              ? -1
+              : static_cast<int32_t>(level_begin[level - 1] +
+                                     node->parent->index));
+      first_children.push_back(
+          node->is_leaf()
+              ? -1
+              : static_cast<int32_t>(level_begin[level + 1] +
+                                     node->children[0]->index));
+      point_ranges.insert(point_ranges.end(),
+                          {node->point_begin, node->point_end});
+      // both lists hold nodes of the same level
+      for (const Node *near_neighbor : node->near_neighbors) {
+        near_indices.push_back(level_begin[level] + near_neighbor->index);
+      }
+      for (const Node *interaction : node->interaction_list) {
+        interaction_indices.push_back(level_begin[level] +
+                                      interaction->index);
+      }
+      near_offsets.push_back(near_indices.size());
+      interaction_offsets.push_back(interaction_indices.size());
     }
   }
+  std::vector<uint64_t> order(order_.begin(), order_.end());
 
-  for (const Point &p : sources) {
-    std::size_t leafIndex = getLeafIndex(p.position);
-    levels_[height_][leafIndex]->points.push_back(p);
+  FmmTreeImageContents image;
+  image.p = p_;
+  image.height = height_;
+  image.scaled = options_.scaled;
+  image.boxes = boxes;
+  image.parents = parents;
+  image.first_children = first_children;
+  image.point_ranges = point_ranges;
+  image.near_offsets = near_offsets;
+  image.near_indices = near_indices;
+  image.interaction_offsets = interaction_offsets;
+  image.interaction_indices = interaction_indices;
+  image.xs = xs_;
+  image.ys = ys_;
+  image.strengths = strengths_;
+  image.order = order;
+  image.keys = keys_;
+  if constexpr (Node::double_coefficients) {
+    if (expansions && num_nodes > 0) {
+      image.coefficients = {reinterpret_cast<const Complex *>(
+                                coefficient_data_),
+                            2 * (p_ + 1) * num_nodes};
+    }
+  }
+  writeFmmTreeImage(path, image);
+}
+
+// numeric phase for the current strengths. Only the multipoles of the dirty
+// leaves (all of them if none are given) and of their ancestors are rebuilt;
+// the local expansions are always recomputed.
+template <class Kernel>
+void NaiveFmmTree<Kernel>::computeExpansions(
+    std::vector<uint8_t> dirty_leaves) {
+  if (options_.schedule == FmmSchedule::TaskGraph) {
+    runTaskGraph();
+    return;
+  }
+
+  std::vector<uint8_t> dirty = std::move(dirty_leaves);
+  if (dirty.empty()) {
+    dirty.assign(num_leaves(), 1);
   }
 
   // step 1: form multipole expansions at each leaf node
-  for (std::size_t i = 0; i < num_leaves(); i++) {
-    Node *leaf = levels_[height_][i];
-    leaf->multipole.buildExpansion(leaf->points);
+  {
+    FMM_PROFILE_SCOPE(P2M, height_);
+    pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+      if (dirty[i]) {
+        buildLeafExpansion(levels_[height_][i]);
+      }
+    });
   }
 
   // step 2: form multipole expansions up the tree by combining child multipole
-  // expansions
-  for (int level = height_ - 1; level >= 2; level--) {
-    for (Node *node : levels_[level]) {
-      Multipole me(p_, node->box.center);
+  // expansions; a periodic tree needs them up to the root
+  for (int level = height_ - 1; level >= (periodic() ? 0 : 2); level--) {
+    std::vector<uint8_t> parents(levels_[level].size(), 0);
+    for (std::size_t i = 0; i < dirty.size(); i++) {
+      parents[i / 4] |= dirty[i];
+    }
+    dirty.swap(parents);
 
-      for (Node *child : node->children) {
-        Vector2 shift = child->box.center - node->box.center;
-        me += child->multipole.M2M(Complex(shift.x, shift.y));
+    FMM_PROFILE_SCOPE(M2M, level);
+    pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+      if (dirty[i]) {
+        translateChildren(levels_[level][i]);
       }
-      node->multipole = me;
-    }
+    });
+    FMM_PROFILE_WORK(M2M, level,
+                     4 * std::count(dirty.begin(), dirty.end(), 1),
+                     4 * std::count(dirty.begin(), dirty.end(), 1) *
+                         m2mFlops(p_),
+                     0);
   }
 
-  // step 3: form local expansions down the tree by combining multipole
-  // expansions from interaction list
-  for (int level = 2; level <= height_; level++) {
-    for (Node *node : levels_[level]) {
-      Vector2 shift = node->parent->box.center - node->box.center;
-      node->local += node->parent->local.L2L(Complex(shift.x, shift.y));
+  // step 3: form local expansions down the tree from the parent's local
+  // expansion and the multipole expansions of the interaction list. A
+  // periodic tree starts at the root, from the far images, and has
+  // interaction lists from level 1 on.
+  if (periodic()) {
+    FMM_PROFILE_SCOPE(M2L, 0);
+    translateLattice();
+  }
+  for (int level = periodic() ? 1 : 2; level <= height_; level++) {
+    // the operators start at level 2
+    bool batched = level >= 2 && (options_.m2l == M2LMode::Batched ||
+                                  options_.m2l == M2LMode::Compressed);
+#ifndef FMM_PROFILE
+    // one pass per node, and one barrier per level, unless the profiler
+    // needs L2L and M2L timed apart
+    if (!batched) {
+      pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+        Node *node = levels_[level][i];
+        node->local.clear();
+        translateParent(node);
+        translateInteractions(node, level);
+      });
+      continue;
+    }
+#endif
+    {
+      FMM_PROFILE_SCOPE(L2L, level);
+      pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+        levels_[level][i]->local.clear();
+        translateParent(levels_[level][i]);
+      });
+      // free-space locals at level 1 are zero, so level 2 has no L2L
+      FMM_PROFILE_WORK(
+          L2L, level,
+          level > 2 || periodic() ? levels_[level].size() : 0,
+          level > 2 || periodic() ? levels_[level].size() * l2lFlops(p_) : 0,
+          0);
+    }
 
-      for (Node *interaction : node->interaction_list) {
-        Local le(p_, node->box.center);
-        le.M2L(interaction->multipole);
-        node->local += le;
+    FMM_PROFILE_SCOPE(M2L, level);
+    if constexpr (Node::double_coefficients) {
+      if (batched && options_.m2l == M2LMode::Batched) {
+        batchedM2L(*options_.m2l_cache, level, m2l_batches_[level], pool_);
+      } else if (batched) {
+        compressedM2L(*options_.m2l_compressed, level, levels_[level],
+                      m2l_batches_[level], pool_);
       }
     }
+    if (!batched) {
+      pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+        translateInteractions(levels_[level][i], level);
+      });
+    }
+    FMM_PROFILE_WORK(M2L, level, numInteractions(level),
+                     numInteractions(level) * m2lFlops(p_), 0);
   }
 }
 
-template <class Kernel> NaiveFmmTree<Kernel>::~NaiveFmmTree() {
+// Bins the sources into leaves with one radix sort on their Morton keys and
+// stores them in that order, so every leaf owns a contiguous range
+template <class Kernel>
+void NaiveFmmTree<Kernel>::sortSources(const std::vector<Point> &sources) {
+  std::vector<uint64_t> keys(sources.size());
+  for (std::size_t i = 0; i < sources.size(); i++) {
+    keys[i] = getLeafIndex(wrap(sources[i].position));
+  }
+  binSources(std::move(keys), [&](std::size_t i) {
+    return Point(wrap(sources[i].position), sources[i].strength);
+  });
+}
+
+// keys[i] is the leaf of source(i), which returns the i-th source as a Point
+template <class Kernel>
+template <class Source>
+void NaiveFmmTree<Kernel>::binSources(std::vector<uint64_t> keys,
+                                      Source source) {
+  std::size_t num_sources = keys.size();
+  order_ = radixSortByKey(keys, 2 * height_);
+  keys_ = std::move(keys);
+
+  xs_.resize(num_sources);
+  ys_.resize(num_sources);
+  strengths_.resize(num_sources);
+  for (std::size_t i = 0; i < num_sources; i++) {
+    Point point = source(order_[i]);
+    xs_[i] = point.position.x;
+    ys_[i] = point.position.y;
+    strengths_[i] = point.strength;
+  }
+
+  std::size_t begin = 0;
+  for (Node *leaf : levels_[height_]) {
+    std::size_t end = begin;
+    while (end < num_sources && keys_[end] == leaf->index) {
+      end++;
+    }
+    leaf->point_begin = begin;
+    leaf->point_end = end;
+    begin = end;
+  }
+}
+
+// Fits the root box to positions and moves every node box and expansion
+// center with it; the uniform tree's nodes and lists do not depend on the box.
+// The box gets some slack so that drifting sources do not refit every step.
+template <class Kernel>
+void NaiveFmmTree<Kernel>::refit(std::span<const Vector2> positions) {
+  constexpr double slack = 0.05;
+  root_->box = computeBoundingBox(positions);
+  root_->box.half_side *= 1.0 + slack;
   for (int level = 0; level <= height_; level++) {
     for (Node *node : levels_[level]) {
-      delete node;
+      Complex center(node->box.center.x, node->box.center.y);
+      node->multipole.center = center;
+      node->local.center = center;
+      if (options_.scaled) {
+        node->multipole.scale = node->box.half_side;
+        node->local.scale = node->box.half_side;
+      }
+      if (node->type == NodeType::Leaf) {
+        continue;
+      }
+      for (int q = 0; q < 4; q++) {
+        node->children[q]->box = getChildBox(node->box, q);
+      }
     }
   }
+
+  if (options_.m2l != M2LMode::Direct &&
+      !options_.m2l_cache->compatible(p_, root_->box.half_side, height_,
+                                      options_.scaled)) {
+    options_.m2l_cache = std::make_shared<const M2LOperatorCache>(
+        p_, root_->box.half_side, height_, options_.scaled);
+  }
+  if (options_.m2l_compressed &&
+      !options_.m2l_compressed->compatible(*options_.m2l_cache,
+                                           options_.m2l_tolerance)) {
+    options_.m2l_compressed = std::make_shared<const CompressedM2LOperators>(
+        *options_.m2l_cache, options_.m2l_tolerance);
+  }
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::update(std::span<const Vector2> positions,
+                                  std::span<const double> strengths) {
+  std::size_t num_sources = this->num_sources();
+  if (positions.size() != num_sources || strengths.size() != num_sources) {
+    throw std::invalid_argument("update needs one position and strength per "
+                                "source");
+  }
+  if (height_ == 0) {
+    return;
+  }
+
+  // a periodic tree keeps its cell and takes the positions inside it
+  std::vector<Vector2> wrapped;
+  if (periodic()) {
+    double total = 0.0;
+    double magnitude = 0.0;
+    for (double strength : strengths) {
+      total += strength;
+      magnitude += std::abs(strength);
+    }
+    checkNeutral(total, magnitude);
+    wrapped.reserve(num_sources);
+    for (Vector2 position : positions) {
+      wrapped.push_back(wrap(position));
+    }
+    positions = wrapped;
+  }
+
+  bool inside = true;
+  for (Vector2 position : positions) {
+    inside = inside && root_->box.contains(Point(position, 0.0));
+  }
+  if (!inside) {
+    refit(positions);
+  }
+
+  std::vector<uint64_t> keys(num_sources);
+  pool_.parallel_for(num_sources, [&](std::size_t i) {
+    keys[i] = getLeafIndex(positions[i]);
+  });
+
+  // a leaf is dirty if any of its sources moved, changed strength, left or
+  // arrived; after a refit every leaf is
+  std::vector<uint8_t> dirty(num_leaves(), inside ? 0 : 1);
+  bool crossed = !inside;
+  for (std::size_t j = 0; j < num_sources && inside; j++) {
+    std::size_t i = order_[j];
+    if (keys[i] != keys_[j]) {
+      crossed = true;
+      dirty[keys_[j]] = 1;
+      dirty[keys[i]] = 1;
+    } else if (positions[i].x != xs_[j] || positions[i].y != ys_[j] ||
+               strengths[i] != strengths_[j]) {
+      dirty[keys_[j]] = 1;
+    }
+  }
+
+  if (crossed) {
+    FMM_PROFILE_SCOPE(Binning, -1);
+    binSources(std::move(keys), [&](std::size_t i) {
+      return Point(positions[i], strengths[i]);
+    });
+    FMM_PROFILE_WORK(Binning, -1, 1, 0.0, num_sources);
+  } else {
+    // same leaf for every source, so the sorted order stands
+    for (std::size_t j = 0; j < num_sources; j++) {
+      xs_[j] = positions[order_[j]].x;
+      ys_[j] = positions[order_[j]].y;
+      strengths_[j] = strengths[order_[j]];
+    }
+  }
+
+  computeExpansions(std::move(dirty));
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::buildLeafExpansion(Node *leaf) {
+  std::size_t begin = leaf->point_begin;
+  leaf->multipole.clear();
+  leaf->multipole.buildExpansion(&xs_[begin], &ys_[begin], &strengths_[begin],
+                                 leaf->point_end - begin);
+  FMM_PROFILE_WORK(P2M, height_, 1, p2mFlops(p_, leaf->point_end - begin), 0);
+}
+
+// direct sum over the sources of the leaf's near neighbors, skipping sources
+// at point itself; strength holds one value per source in sorted order. A
+// neighbor's periodic image is reached by moving point the other way.
+template <class Kernel>
+double NaiveFmmTree<Kernel>::nearField(const Node *leaf, Vector2 point,
+                                       const double *strength) const {
+  double result = 0.0;
+  for (std::size_t k = 0; k < leaf->near_neighbors.size(); k++) {
+    const Node *near_neighbor = leaf->near_neighbors[k];
+    Vector2 target = point - imageShift(leaf->near_images, k, period());
+    if constexpr (HasP2PBatch<Kernel>) {
+      std::size_t begin = near_neighbor->point_begin;
+      Kernel::p2p_batch(&xs_[begin], &ys_[begin], &strength[begin],
+                        near_neighbor->point_end - begin, &target.x, &target.y,
+                        &result, 1);
+      continue;
+    }
+
+    for (std::size_t j = near_neighbor->point_begin;
+         j < near_neighbor->point_end; j++) {
+      if (xs_[j] == target.x && ys_[j] == target.y) {
+        continue;
+      }
+      result += Kernel::potential(Point(Vector2(xs_[j], ys_[j]), strength[j]),
+                                  target);
+    }
+  }
+  return result;
+}
+
+// near field at the leaf's own sources, out[j - point_begin] for each source j
+// of the leaf
+template <class Kernel>
+void NaiveFmmTree<Kernel>::nearFieldSources(const Node *leaf,
+                                            double *out) const {
+  std::size_t begin = leaf->point_begin;
+  nearFieldTargets(leaf, strengths_.data(), &xs_[begin], &ys_[begin], out,
+                   leaf->point_end - begin);
+}
+
+// near field at a block of targets inside the leaf, written to out. With the
+// batch hook the near neighbors' sources are gathered into one block first,
+// so small leaves still fill the vector units.
+template <class Kernel>
+void NaiveFmmTree<Kernel>::nearFieldTargets(const Node *leaf,
+                                            const double *strength,
+                                            const double *tx, const double *ty,
+                                            double *out,
+                                            std::size_t num_targets) const {
+  std::fill(out, out + num_targets, 0.0);
+
+  if constexpr (HasP2PBatch<Kernel>) {
+    thread_local std::vector<double> sx, sy, sq;
+    sx.clear();
+    sy.clear();
+    sq.clear();
+    for (std::size_t k = 0; k < leaf->near_neighbors.size(); k++) {
+      const Node *near_neighbor = leaf->near_neighbors[k];
+      std::size_t begin = near_neighbor->point_begin;
+      std::size_t end = near_neighbor->point_end;
+      sx.insert(sx.end(), &xs_[0] + begin, &xs_[0] + end);
+      sy.insert(sy.end(), &ys_[0] + begin, &ys_[0] + end);
+      sq.insert(sq.end(), strength + begin, strength + end);
+      // the gathered copies of a periodic image are moved into place
+      Vector2 shift = imageShift(leaf->near_images, k, period());
+      if (shift.x != 0.0 || shift.y != 0.0) {
+        for (std::size_t j = sx.size() - (end - begin); j < sx.size(); j++) {
+          sx[j] += shift.x;
+          sy[j] += shift.y;
+        }
+      }
+    }
+    Kernel::p2p_batch(sx.data(), sy.data(), sq.data(), sx.size(), tx, ty, out,
+                      num_targets);
+  } else {
+    for (std::size_t j = 0; j < num_targets; j++) {
+      out[j] = nearField(leaf, Vector2(tx[j], ty[j]), strength);
+    }
+  }
+}
+
+// nearFieldTargets for num_rhs strength vectors of num_sources() each, in
+// sorted order: out holds num_rhs blocks of num_targets. The near neighbors'
+// sources are swept once for all right-hand sides.
+template <class Kernel>
+void NaiveFmmTree<Kernel>::nearFieldTargets(const Node *leaf,
+                                            const double *strengths,
+                                            std::size_t num_rhs,
+                                            const double *tx, const double *ty,
+                                            double *out,
+                                            std::size_t num_targets) const {
+  std::size_t n = num_sources();
+  std::fill(out, out + num_rhs * num_targets, 0.0);
+
+  if constexpr (HasP2PBatch<Kernel>) {
+    thread_local std::vector<double> sx, sy, sq;
+    sx.clear();
+    sy.clear();
+    for (std::size_t k = 0; k < leaf->near_neighbors.size(); k++) {
+      const Node *near_neighbor = leaf->near_neighbors[k];
+      std::size_t begin = near_neighbor->point_begin;
+      std::size_t end = near_neighbor->point_end;
+      sx.insert(sx.end(), &xs_[0] + begin, &xs_[0] + end);
+      sy.insert(sy.end(), &ys_[0] + begin, &ys_[0] + end);
+    }
+    std::size_t ns = sx.size();
+    sq.resize(num_rhs * ns);
+    for (std::size_t r = 0; r < num_rhs; r++) {
+      double *q = &sq[r * ns];
+      for (const Node *near_neighbor : leaf->near_neighbors) {
+        q = std::copy(&strengths[r * n + near_neighbor->point_begin],
+                      &strengths[r * n + near_neighbor->point_end], q);
+      }
+    }
+    if constexpr (HasP2PMultiBatch<Kernel>) {
+      Kernel::p2p_multi_batch(sx.data(), sy.data(), sq.data(), ns, num_rhs,
+                              tx, ty, out, num_targets);
+    } else {
+      for (std::size_t r = 0; r < num_rhs; r++) {
+        Kernel::p2p_batch(sx.data(), sy.data(), &sq[r * ns], ns, tx, ty,
+                          &out[r * num_targets], num_targets);
+      }
+    }
+  } else {
+    // the kernel is linear in the strength, so one unit-strength evaluation
+    // serves every right-hand side
+    for (std::size_t i = 0; i < num_targets; i++) {
+      Vector2 target(tx[i], ty[i]);
+      for (const Node *near_neighbor : leaf->near_neighbors) {
+        for (std::size_t j = near_neighbor->point_begin;
+             j < near_neighbor->point_end; j++) {
+          if (xs_[j] == target.x && ys_[j] == target.y) {
+            continue;
+          }
+          double g =
+              Kernel::potential(Point(Vector2(xs_[j], ys_[j]), 1.0), target);
+          for (std::size_t r = 0; r < num_rhs; r++) {
+            out[r * num_targets + i] += strengths[r * n + j] * g;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <class Kernel>
+PotentialGradient
+NaiveFmmTree<Kernel>::nearFieldWithGradient(const Node *leaf,
+                                            Vector2 point) const {
+  PotentialGradient result;
+  for (std::size_t k = 0; k < leaf->near_neighbors.size(); k++) {
+    const Node *near_neighbor = leaf->near_neighbors[k];
+    Vector2 target = point - imageShift(leaf->near_images, k, period());
+    if constexpr (HasP2PGradientBatch<Kernel>) {
+      std::size_t begin = near_neighbor->point_begin;
+      Kernel::p2p_gradient_batch(
+          &xs_[begin], &ys_[begin], &strengths_[begin],
+          near_neighbor->point_end - begin, &target.x, &target.y,
+          &result.potential, &result.gradient.x, &result.gradient.y, 1);
+      continue;
+    }
+
+    for (std::size_t j = near_neighbor->point_begin;
+         j < near_neighbor->point_end; j++) {
+      if (xs_[j] == target.x && ys_[j] == target.y) {
+        continue;
+      }
+      Point source(Vector2(xs_[j], ys_[j]), strengths_[j]);
+      result.potential += Kernel::potential(source, target);
+      result.gradient += Kernel::gradient(source, target);
+    }
+  }
+  return result;
+}
+
+// gradient counterpart of nearFieldSources
+template <class Kernel>
+void NaiveFmmTree<Kernel>::nearFieldSourcesWithGradient(const Node *leaf,
+                                                        double *potential,
+                                                        double *gx,
+                                                        double *gy) const {
+  std::size_t target_begin = leaf->point_begin;
+  std::size_t num_targets = leaf->point_end - target_begin;
+  std::fill(potential, potential + num_targets, 0.0);
+  std::fill(gx, gx + num_targets, 0.0);
+  std::fill(gy, gy + num_targets, 0.0);
+
+  if constexpr (HasP2PGradientBatch<Kernel>) {
+    for (std::size_t k = 0; k < leaf->near_neighbors.size(); k++) {
+      const Node *near_neighbor = leaf->near_neighbors[k];
+      std::size_t begin = near_neighbor->point_begin;
+      const double *tx = &xs_[target_begin];
+      const double *ty = &ys_[target_begin];
+      // a periodic image is reached by moving the targets the other way
+      Vector2 shift = imageShift(leaf->near_images, k, period());
+      thread_local std::vector<double> moved_x, moved_y;
+      if (shift.x != 0.0 || shift.y != 0.0) {
+        moved_x.resize(num_targets);
+        moved_y.resize(num_targets);
+        for (std::size_t j = 0; j < num_targets; j++) {
+          moved_x[j] = tx[j] - shift.x;
+          moved_y[j] = ty[j] - shift.y;
+        }
+        tx = moved_x.data();
+        ty = moved_y.data();
+      }
+      Kernel::p2p_gradient_batch(&xs_[begin], &ys_[begin], &strengths_[begin],
+                                 near_neighbor->point_end - begin, tx, ty,
+                                 potential, gx, gy, num_targets);
+    }
+  } else {
+    for (std::size_t j = 0; j < num_targets; j++) {
+      Vector2 point(xs_[target_begin + j], ys_[target_begin + j]);
+      PotentialGradient near = nearFieldWithGradient(leaf, point);
+      potential[j] = near.potential;
+      gx[j] = near.gradient.x;
+      gy[j] = near.gradient.y;
+    }
+  }
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::translateChildren(Node *node) {
+  node->multipole.clear();
+
+  for (Node *child : node->children) {
+    Vector2 shift = child->box.center - node->box.center;
+    child->multipole.M2MInto(Complex(shift.x, shift.y),
+                             node->multipole.coeffs, node->multipole.scale);
+  }
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::translateParent(Node *node) {
+  Vector2 shift = node->parent->box.center - node->box.center;
+  node->parent->local.L2LInto(Complex(shift.x, shift.y), node->local.coeffs,
+                              node->local.scale);
+}
+
+template <class Kernel>
+void NaiveFmmTree<Kernel>::translateInteractions(Node *node, int level) {
+  // sources of a periodic tree are taken at their images; the cached
+  // operators start at level 2
+  if constexpr (Node::double_coefficients) {
+    if (options_.m2l != M2LMode::Direct && level >= 2) {
+      double side = 2.0 * node->box.half_side;
+      for (std::size_t i = 0; i < node->interaction_list.size(); i++) {
+        Node *interaction = node->interaction_list[i];
+        Vector2 offset =
+            (interaction->box.center +
+             imageShift(node->interaction_images, i, period()) -
+             node->box.center) /
+            side;
+        options_.m2l_cache->apply(level, std::lround(offset.x),
+                                  std::lround(offset.y),
+                                  interaction->multipole.coeffs.data(),
+                                  node->local.coeffs.data());
+      }
+      return;
+    }
+  }
+
+  for (std::size_t i = 0; i < node->interaction_list.size(); i++) {
+    Node *interaction = node->interaction_list[i];
+    Vector2 shift = interaction->box.center +
+                    imageShift(node->interaction_images, i, period()) -
+                    node->box.center;
+    interaction->multipole.M2LInto(Complex(shift.x, shift.y),
+                                   node->local.coeffs, node->local.scale);
+  }
+}
+
+// root local expansion of a periodic tree from the images beyond the root's
+// 3x3 block, which the interaction lists cover
+template <class Kernel> void NaiveFmmTree<Kernel>::translateLattice() {
+  std::vector<Complex> multipole(root_->multipole.coeffs.begin(),
+                                 root_->multipole.coeffs.end());
+  std::vector<Complex> local(p_ + 1, 0.0);
+  lattice_->apply(multipole.data(), local.data(), root_->multipole.scale);
+  std::copy(local.begin(), local.end(), root_->local.coeffs.begin());
+}
+
+// Same passes as the level-synchronous schedule, but every node update is a
+// task that waits only on the expansions it reads. Near-field P2P tasks have
+// no dependencies and run whenever a worker would otherwise wait on the far
+// field.
+template <class Kernel> void NaiveFmmTree<Kernel>::runTaskGraph() {
+  using TaskId = TaskGraph::TaskId;
+
+  TaskGraph graph;
+  std::vector<double> near(num_sources());
+  std::vector<double> far(num_sources());
+
+  // task after which the node's multipole (upward) or local (downward)
+  // expansion is final
+  std::vector<std::vector<TaskId>> upward(height_ + 1);
+  std::vector<std::vector<TaskId>> downward(height_ + 1);
+
+  for (Node *leaf : levels_[height_]) {
+    upward[height_].push_back(graph.addTask(
+        TaskKind::P2M, height_, [this, leaf] { buildLeafExpansion(leaf); }));
+  }
+
+  for (int level = height_ - 1; level >= (periodic() ? 0 : 2); level--) {
+    for (std::size_t i = 0; i < levels_[level].size(); i++) {
+      Node *node = levels_[level][i];
+      TaskId task = graph.addTask(TaskKind::M2M, level,
+                                  [this, node] { translateChildren(node); });
+      for (std::size_t q = 0; q < 4; q++) {
+        graph.addDependency(upward[level + 1][4 * i + q], task);
+      }
+      upward[level].push_back(task);
+    }
+    FMM_PROFILE_WORK(M2M, level, 4 * levels_[level].size(),
+                     4 * levels_[level].size() * m2mFlops(p_), 0);
+  }
+
+  // a periodic tree's root local comes from the far images, and its lists
+  // start at level 1
+  if (periodic()) {
+    TaskId lattice = graph.addTask(TaskKind::M2L, 0,
+                                   [this] { translateLattice(); });
+    graph.addDependency(upward[0][0], lattice);
+    downward[0].push_back(lattice);
+  }
+
+  for (int level = periodic() ? 1 : 2; level <= height_; level++) {
+    // free-space locals at level 1 are zero, so level 2 starts from M2L alone
+    bool l2l_level = level > 2 || periodic();
+    FMM_PROFILE_WORK(M2L, level, numInteractions(level),
+                     numInteractions(level) * m2lFlops(p_), 0);
+    FMM_PROFILE_WORK(L2L, level, l2l_level ? levels_[level].size() : 0,
+                     l2l_level ? levels_[level].size() * l2lFlops(p_) : 0, 0);
+
+    for (std::size_t i = 0; i < levels_[level].size(); i++) {
+      Node *node = levels_[level][i];
+      TaskId m2l =
+          graph.addTask(TaskKind::M2L, level, [this, node, level] {
+            node->local.clear();
+            translateInteractions(node, level);
+          });
+      for (Node *interaction : node->interaction_list) {
+        graph.addDependency(upward[level][interaction->index], m2l);
+      }
+
+      if (!l2l_level) {
+        downward[level].push_back(m2l);
+        continue;
+      }
+      TaskId l2l = graph.addTask(TaskKind::L2L, level,
+                                 [this, node] { translateParent(node); });
+      graph.addDependency(m2l, l2l);
+      graph.addDependency(downward[level - 1][i / 4], l2l);
+      downward[level].push_back(l2l);
+    }
+  }
+
+  for (std::size_t i = 0; i < num_leaves(); i++) {
+    Node *leaf = levels_[height_][i];
+
+    if (height_ >= 2 || periodic()) {
+      TaskId l2p = graph.addTask(TaskKind::L2P, height_, [this, leaf, &far] {
+        for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+          far[order_[j]] = leaf->local.evaluate(Vector2(xs_[j], ys_[j]));
+        }
+        FMM_PROFILE_WORK(L2P, height_, 1,
+                         l2pFlops(p_, leaf->point_end - leaf->point_begin),
+                         0);
+      });
+      graph.addDependency(downward[height_][i], l2p);
+    }
+
+    graph.addTask(TaskKind::P2P, height_, [this, leaf, &near] {
+      std::vector<double> block(leaf->point_end - leaf->point_begin);
+      nearFieldSources(leaf, block.data());
+      for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+        near[order_[j]] = block[j - leaf->point_begin];
+      }
+      FMM_PROFILE_WORK(P2P, height_, 1, 0.0,
+                       block.size() * numNearSources(leaf));
+    });
+  }
+
+  task_profile_ = graph.run(options_.num_threads);
+  FMM_PROFILE_TASKS(task_profile_);
+
+  source_potentials_.resize(num_sources());
+  for (std::size_t i = 0; i < num_sources(); i++) {
+    source_potentials_[i] = far[i] + near[i];
+  }
+}
+
+template <class Kernel>
+typename NaiveFmmTree<Kernel>::Node *
+NaiveFmmTree<Kernel>::newNode(int level, Box2 box, bool zero) {
+  std::byte *coefficients =
+      coefficient_data_ + Node::coefficientBytes(p_) * num_nodes_;
+  num_nodes_++;
+  Node *node = node_arenas_[level].emplace(p_, box, NodeType::Leaf,
+                                           coefficients, zero);
+  if (options_.scaled) {
+    node->multipole.scale = box.half_side;
+    node->local.scale = box.half_side;
+  }
+  node->index = levels_[level].size();
+  levels_[level].push_back(node);
+  return node;
+}
+
+template <class Kernel>
+FmmMemoryUsage NaiveFmmTree<Kernel>::memory_usage() const {
+  FmmMemoryUsage usage;
+  usage.num_nodes = num_nodes_;
+  for (const Arena<Node> &arena : node_arenas_) {
+    usage.nodes += arena.bytes();
+  }
+  usage.coefficients = coefficients_.bytes();
+  for (const std::vector<Node *> &level : levels_) {
+    usage.levels += level.capacity() * sizeof(Node *);
+  }
+  usage.sources = (xs_.capacity() + ys_.capacity() + strengths_.capacity()) *
+                      sizeof(double) +
+                  order_.capacity() * sizeof(std::size_t) +
+                  keys_.capacity() * sizeof(uint64_t);
+  return usage;
 }
 
 template <class Kernel>
@@ -154,62 +1532,375 @@ void NaiveFmmTree<Kernel>::buildChildNodes(Node *node, int level) {
 
   node->type = NodeType::Internal;
   for (int q = 0; q < 4; q++) {
-    Box2 child_box = getChildBox(node->box, q);
-    Node *child = new Node(p_, child_box, NodeType::Leaf);
+    Node *child = newNode(level + 1, getChildBox(node->box, q));
     child->parent = node;
     node->children[q] = child;
-    levels_[level + 1].push_back(child);
   }
 }
 
 // compute near neighbors and interaction list for node, assuming parent node
-// has already been computed
+// has already been computed. The root of a periodic tree neighbors its own
+// 3x3 block of images, and every entry below takes the image of the parent
+// neighbor it descends from.
 template <class Kernel>
 void NaiveFmmTree<Kernel>::computeNodeLists(Node *node) {
   Node *parent = node->parent;
   if (parent == nullptr) {
-    node->near_neighbors.push_back(node);
+    if (!periodic()) {
+      node->near_neighbors.push_back(node);
+      return;
+    }
+    for (uint8_t image = 0; image < 9; image++) {
+      node->near_neighbors.push_back(node);
+      node->near_images.push_back(image);
+    }
     return;
   }
 
-  for (Node *parent_neighbor : parent->near_neighbors) {
-    for (Node *child : parent_neighbor->children) {
-      if (adjacent(node->box, child->box)) {
+  for (std::size_t i = 0; i < parent->near_neighbors.size(); i++) {
+    Vector2 shift = imageShift(parent->near_images, i, period());
+    for (Node *child : parent->near_neighbors[i]->children) {
+      Box2 box(child->box.center + shift, child->box.half_side);
+      if (adjacent(node->box, box)) {
         node->near_neighbors.push_back(child);
+        if (periodic()) {
+          node->near_images.push_back(parent->near_images[i]);
+        }
       } else {
         node->interaction_list.push_back(child);
+        if (periodic()) {
+          node->interaction_images.push_back(parent->near_images[i]);
+        }
       }
     }
   }
 }
 
+template <class Kernel>
+std::size_t NaiveFmmTree<Kernel>::numInteractions(int level) const {
+  std::size_t count = 0;
+  for (const Node *node : levels_[level]) {
+    count += node->interaction_list.size();
+  }
+  return count;
+}
+
+template <class Kernel>
+std::size_t NaiveFmmTree<Kernel>::numNearSources(const Node *leaf) const {
+  std::size_t count = 0;
+  for (const Node *near_neighbor : leaf->near_neighbors) {
+    count += near_neighbor->point_end - near_neighbor->point_begin;
+  }
+  return count;
+}
+
 template <class Kernel>
 double NaiveFmmTree<Kernel>::evaluate(Vector2 point) const {
+  point = wrap(point);
   std::size_t leaf_index = getLeafIndex(point);
   Node *leaf = levels_[height_][leaf_index];
 
-  double result = leaf->local.evaluate(point);
+  return leaf->local.evaluate(point) +
+         nearField(leaf, point, strengths_.data());
+}
 
-  for (Node *near_neighbor : leaf->near_neighbors) {
-    for (const Point &p : near_neighbor->points) {
-      if (p.position == point) {
-        continue;
-      }
-      result += Kernel::potential(p, point);
-    }
+template <class Kernel>
+std::vector<double>
+NaiveFmmTree<Kernel>::evaluateTargets(std::span<const Vector2> targets) const {
+  std::size_t num_targets = targets.size();
+  std::vector<uint64_t> keys(num_targets);
+  pool_.parallel_for(num_targets, [&](std::size_t i) {
+    keys[i] = getLeafIndex(wrap(targets[i]));
+  });
+  std::vector<std::size_t> order = radixSortByKey(keys, 2 * height_);
+
+  std::vector<double> tx(num_targets);
+  std::vector<double> ty(num_targets);
+  for (std::size_t i = 0; i < num_targets; i++) {
+    Vector2 target = wrap(targets[order[i]]);
+    tx[i] = target.x;
+    ty[i] = target.y;
   }
 
-  return result;
+  // targets of leaf i are [leaf_begin[i], leaf_begin[i + 1]) in sorted order
+  std::vector<std::size_t> leaf_begin(num_leaves() + 1, 0);
+  for (uint64_t key : keys) {
+    leaf_begin[key + 1]++;
+  }
+  for (std::size_t i = 0; i < num_leaves(); i++) {
+    leaf_begin[i + 1] += leaf_begin[i];
+  }
+
+  std::vector<double> potentials(num_targets);
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    std::size_t begin = leaf_begin[i];
+    std::size_t end = leaf_begin[i + 1];
+    if (begin == end) {
+      return;
+    }
+
+    const Node *leaf = levels_[height_][i];
+    thread_local std::vector<double> near;
+    near.resize(end - begin);
+    nearFieldTargets(leaf, strengths_.data(), &tx[begin], &ty[begin],
+                     near.data(), end - begin);
+
+    for (std::size_t j = begin; j < end; j++) {
+      potentials[order[j]] =
+          leaf->local.evaluate(Vector2(tx[j], ty[j])) + near[j - begin];
+    }
+  });
+
+  return potentials;
+}
+
+template <class Kernel>
+PotentialGradient
+NaiveFmmTree<Kernel>::evaluateWithGradient(Vector2 point) const {
+  point = wrap(point);
+  std::size_t leaf_index = getLeafIndex(point);
+  Node *leaf = levels_[height_][leaf_index];
+
+  PotentialGradient far = leaf->local.evaluateWithGradient(point);
+  PotentialGradient near = nearFieldWithGradient(leaf, point);
+  return {far.potential + near.potential, far.gradient + near.gradient};
 }
 
 template <class Kernel>
 std::vector<double> NaiveFmmTree<Kernel>::evaluateSources() const {
-  int num_sources = sources_.size();
-  std::vector<double> potentials(num_sources);
+  if (options_.schedule == FmmSchedule::TaskGraph) {
+    return source_potentials_;
+  }
+
+  std::vector<double> potentials(num_sources());
+
+  // walk the sources leaf by leaf, so each leaf's near field is one block of
+  // targets against one block of sources per near neighbor
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    const Node *leaf = levels_[height_][i];
+    std::size_t num_targets = leaf->point_end - leaf->point_begin;
+    thread_local std::vector<double> near;
+    near.resize(num_targets);
+    {
+      FMM_PROFILE_SCOPE(P2P, height_);
+      nearFieldSources(leaf, near.data());
+      FMM_PROFILE_WORK(P2P, height_, 1, 0.0,
+                       num_targets * numNearSources(leaf));
+    }
 
-  for (int i = 0; i < num_sources; i++) {
-    potentials[i] = evaluate(sources_[i].position);
+    FMM_PROFILE_SCOPE(L2P, height_);
+    for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+      Vector2 point(xs_[j], ys_[j]);
+      potentials[order_[j]] =
+          leaf->local.evaluate(point) + near[j - leaf->point_begin];
+    }
+    FMM_PROFILE_WORK(L2P, height_, 1, l2pFlops(p_, num_targets), 0);
+  });
+
+  return potentials;
+}
+
+// the local expansions are final after construction under either schedule, so
+// this is one leaf-by-leaf L2P and P2P pass like evaluateSources
+template <class Kernel>
+std::vector<PotentialGradient>
+NaiveFmmTree<Kernel>::evaluateSourcesWithGradient() const {
+  std::vector<PotentialGradient> results(num_sources());
+
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    const Node *leaf = levels_[height_][i];
+    std::size_t num_targets = leaf->point_end - leaf->point_begin;
+    thread_local std::vector<double> near;
+    near.resize(3 * num_targets);
+    double *potential = near.data();
+    double *gx = potential + num_targets;
+    double *gy = gx + num_targets;
+    nearFieldSourcesWithGradient(leaf, potential, gx, gy);
+
+    for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+      std::size_t k = j - leaf->point_begin;
+      PotentialGradient far =
+          leaf->local.evaluateWithGradient(Vector2(xs_[j], ys_[j]));
+      results[order_[j]] = {far.potential + potential[k],
+                            far.gradient + Vector2(gx[k], gy[k])};
+    }
+  });
+
+  return results;
+}
+
+// Geometry phase of the multi-RHS evaluation: the M2L, M2M and L2L operators
+// (the tree's own when it has compatible ones) and the per-level batches of
+// the interaction lists. Built by the first call and reused; the operators
+// are rebuilt only when update() re-fits the root box.
+template <class Kernel>
+std::shared_ptr<const M2LOperatorCache>
+NaiveFmmTree<Kernel>::prepareMultiRhs() const {
+  std::lock_guard<std::mutex> lock(multi_rhs_mutex_);
+  auto compatible = [&](const std::shared_ptr<const M2LOperatorCache> &cache) {
+    return cache && cache->compatible(p_, root_->box.half_side, height_,
+                                      options_.scaled);
+  };
+  if (!compatible(multi_rhs_cache_)) {
+    multi_rhs_cache_ = compatible(options_.m2l_cache)
+                           ? options_.m2l_cache
+                           : std::make_shared<const M2LOperatorCache>(
+                                 p_, root_->box.half_side, height_,
+                                 options_.scaled);
   }
+  if (m2l_batches_.empty() && multi_rhs_batches_.empty()) {
+    multi_rhs_batches_.resize(height_ + 1);
+    for (int level = 2; level <= height_; level++) {
+      multi_rhs_batches_[level] = groupInteractions(levels_[level]);
+    }
+  }
+  return multi_rhs_cache_;
+}
+
+template <class Kernel>
+std::vector<std::vector<double>> NaiveFmmTree<Kernel>::evaluateSources(
+    const std::vector<std::vector<double>> &strengths) const {
+  if (periodic()) {
+    throw std::invalid_argument("multi-RHS evaluation is free-space only");
+  }
+  std::size_t num_rhs = strengths.size();
+  std::size_t n = num_sources();
+  for (const std::vector<double> &strength : strengths) {
+    if (strength.size() != n) {
+      throw std::invalid_argument("Strength vector size does not match the "
+                                  "number of sources");
+    }
+  }
+
+  std::vector<std::vector<double>> potentials(num_rhs, std::vector<double>(n));
+  if (num_rhs == 0 || n == 0) {
+    return potentials;
+  }
+
+  // strengths in sorted source order, n per right-hand side
+  std::vector<double> sorted(num_rhs * n);
+  for (std::size_t r = 0; r < num_rhs; r++) {
+    for (std::size_t i = 0; i < n; i++) {
+      sorted[r * n + i] = strengths[r][order_[i]];
+    }
+  }
+
+  int K = num_rhs;
+  int num_coeffs = p_ + 1;
+  std::size_t block = num_coeffs * num_rhs;
+
+  // per level, one row-major (p+1) x K coefficient block per node, in level
+  // order; only levels >= 2 carry expansions
+  std::vector<std::vector<Complex>> multipoles(height_ + 1);
+  std::vector<std::vector<Complex>> locals(height_ + 1);
+
+  if (height_ >= 2) {
+    std::shared_ptr<const M2LOperatorCache> cache = prepareMultiRhs();
+    const std::vector<std::vector<M2LBatch<Node>>> &batches =
+        m2l_batches_.empty() ? multi_rhs_batches_ : m2l_batches_;
+
+    for (int level = 2; level <= height_; level++) {
+      multipoles[level].resize(levels_[level].size() * block);
+      locals[level].resize(levels_[level].size() * block);
+    }
+
+    // P2M: a_0 = sum q, a_k = -sum q z^k / k for each right-hand side, with
+    // z in units of the expansion's scale
+    pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+      const Node *leaf = levels_[height_][i];
+      Complex *M = &multipoles[height_][i * block];
+      for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+        Complex z = Complex(xs_[j] - leaf->box.center.x,
+                            ys_[j] - leaf->box.center.y) /
+                    leaf->multipole.scale;
+        for (int r = 0; r < K; r++) {
+          M[r] += sorted[r * n + j];
+        }
+        Complex power = 1.0;
+        for (int k = 1; k <= p_; k++) {
+          power *= z;
+          Complex c = -power / static_cast<double>(k);
+          for (int r = 0; r < K; r++) {
+            M[k * K + r] += c * sorted[r * n + j];
+          }
+        }
+      }
+    });
+
+    // M2M: children of node i are 4i..4i+3 at the next level, in quadrant
+    // order
+    for (int level = height_ - 1; level >= 2; level--) {
+      pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+          complexGemm(num_coeffs, K, num_coeffs,
+                      cache->m2mMatrix(level + 1, quadrant), num_coeffs,
+                      &multipoles[level + 1][(4 * i + quadrant) * block], K,
+                      &multipoles[level][i * block], K);
+        }
+      });
+    }
+
+    // L2L from the parent, then M2L from the interaction list with the
+    // pairs sharing an operator batched into wide GEMMs
+    for (int level = 2; level <= height_; level++) {
+      if (level >= 3) {
+        pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+          complexGemm(num_coeffs, K, num_coeffs, cache->l2lMatrix(level, i % 4),
+                      num_coeffs, &locals[level - 1][(i / 4) * block], K,
+                      &locals[level][i * block], K);
+        });
+      }
+
+      batchedM2L(
+          *cache, level, batches[level], pool_, K,
+          [&](const Node *node) {
+            return &multipoles[level][node->index * block];
+          },
+          [&](const Node *node) {
+            return &locals[level][node->index * block];
+          });
+    }
+  }
+
+  // L2P and P2P leaf by leaf
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    const Node *leaf = levels_[height_][i];
+    std::size_t begin = leaf->point_begin;
+    std::size_t num_targets = leaf->point_end - begin;
+
+    thread_local std::vector<double> near;
+    near.resize(num_rhs * num_targets);
+    nearFieldTargets(leaf, sorted.data(), num_rhs, &xs_[begin], &ys_[begin],
+                     near.data(), num_targets);
+    for (int r = 0; r < K; r++) {
+      for (std::size_t j = 0; j < num_targets; j++) {
+        potentials[r][order_[begin + j]] = near[r * num_targets + j];
+      }
+    }
+
+    if (height_ < 2) {
+      return;
+    }
+    const Complex *L = &locals[height_][i * block];
+    thread_local std::vector<Complex> powers;
+    powers.resize(num_coeffs);
+    for (std::size_t j = begin; j < leaf->point_end; j++) {
+      Complex z = Complex(xs_[j] - leaf->box.center.x,
+                          ys_[j] - leaf->box.center.y) /
+                  leaf->local.scale;
+      powers[0] = 1.0;
+      for (int l = 1; l <= p_; l++) {
+        powers[l] = powers[l - 1] * z;
+      }
+      for (int r = 0; r < K; r++) {
+        double far = 0.0;
+        for (int l = 0; l <= p_; l++) {
+          far += (L[l * K + r] * powers[l]).real();
+        }
+        potentials[r][order_[j]] += far;
+      }
+    }
+  });
 
   return potentials;
 }
@@ -0,0 +1,397 @@
+#pragma once
+
+#include "arena.h"
+#include "fmmtree.h"
+#include "harmonics.h"
+#include "morton.h"
+#include "point3.h"
+#include "staticvector.h"
+#include "threadpool.h"
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+template <class Kernel> struct FmmNode3 {
+  using Multipole = typename Kernel::Multipole;
+  using Local = typename Kernel::Local;
+
+  // coefficients of a node: numHarmonics(p) multipole, then as many local
+  static std::size_t numCoefficients(int p) { return 2 * numHarmonics(p); }
+
+  FmmNode3(int p, Box3 box, NodeType type, Complex *coefficients)
+      : box(box), type(type), multipole(p, box.center, coefficients),
+        local(p, box.center, coefficients + numHarmonics(p)) {}
+
+  Box3 box;
+  NodeType type;
+  std::size_t index = 0; // position within its level
+
+  // for leaf nodes, range of the tree's Morton-ordered sources
+  std::size_t point_begin = 0;
+  std::size_t point_end = 0;
+
+  FmmNode3 *parent = nullptr;
+  FmmNode3 *children[8] = {};
+
+  Multipole multipole;
+  Local local;
+
+  StaticVector<FmmNode3 *, 27> near_neighbors;
+  StaticVector<FmmNode3 *, 189> interaction_list;
+
+  bool is_leaf() const { return type == NodeType::Leaf; }
+};
+
+// Balanced octree FMM for 3D kernels, with the passes of NaiveFmmTree: P2M at
+// the leaves, M2M up to level 2, then per level L2L from the parent and M2L
+// from the (up to 189) well-separated children of the parent's neighbors,
+// and L2P plus P2P over the 27 near neighbors at the leaves. Kernel provides
+// potential(const Point3 &, Vector3) and the Multipole and Local expansions,
+// MultipoleExpansion3 and LocalExpansion3 for 1 / r. Every translation is
+// rotated onto the z axis; the rotations are built once per direction, as
+// a uniform tree has 8 child directions and 316 interaction offsets, all in
+// the 7 x 7 x 7 grid of box offsets, at every level. Of FmmOptions only
+// num_threads applies; the other options are rejected with
+// std::invalid_argument.
+template <class Kernel> struct FmmTree3 {
+  using Multipole = typename Kernel::Multipole;
+  using Local = typename Kernel::Local;
+
+  using Node = FmmNode3<Kernel>;
+
+  FmmTree3(int p, const std::vector<Point3> &sources, int height,
+           FmmOptions options = {});
+
+  Node *root() const { return root_; }
+  int height() const { return height_; }
+  const std::vector<Node *> &level(int level) const { return levels_[level]; }
+  std::size_t num_leaves() const { return std::size_t(1) << (3 * height_); }
+  std::size_t num_sources() const { return order_.size(); }
+
+  double evaluate(Vector3 point) const;
+  std::vector<double> evaluateSources() const;
+
+protected:
+  int p_;
+  Node *root_ = nullptr;
+  int height_;
+  std::vector<std::vector<Node *>> levels_;
+  std::vector<Arena<Node>> node_arenas_;
+  AlignedBuffer<Complex> coefficients_;
+  std::size_t num_nodes_ = 0;
+  FmmOptions options_;
+  mutable ThreadPool pool_;
+
+  // rotations onto the directions of the child-to-parent (M2M), the
+  // parent-to-child (L2L) and the interaction offsets, the last indexed by
+  // offsetIndex in units of the node side
+  std::vector<HarmonicRotation> m2m_rotations_;
+  std::vector<HarmonicRotation> l2l_rotations_;
+  std::vector<HarmonicRotation> m2l_rotations_;
+
+  // sources in Morton order of their leaves, as structure of arrays
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<double> zs_;
+  std::vector<double> strengths_;
+  std::vector<std::size_t> order_; // sorted position -> source index
+  std::vector<uint64_t> keys_;     // sorted position -> leaf index
+
+private:
+  static int offsetIndex(int dx, int dy, int dz) {
+    return ((dx + 3) * 7 + dy + 3) * 7 + dz + 3;
+  }
+  // direction from the parent's center to child octant's
+  static Vector3 octantDirection(uint32_t octant) {
+    return Vector3((octant & 1) ? 1.0 : -1.0, (octant & 2) ? 1.0 : -1.0,
+                   (octant & 4) ? 1.0 : -1.0);
+  }
+
+  std::size_t getLeafIndex(Vector3 position) const;
+  Node *newNode(int level, Box3 box);
+  void buildChildNodes(Node *node, int level);
+  void computeNodeLists(Node *node);
+  void sortSources(const std::vector<Point3> &sources);
+  void prepareRotations();
+  void computeExpansions();
+
+  void buildLeafExpansion(Node *leaf);
+  double nearField(const Node *leaf, Vector3 point) const;
+  void translateChildren(Node *node);
+  void translateParent(Node *node);
+  void translateInteractions(Node *node);
+};
+
+template <class Kernel>
+std::size_t FmmTree3<Kernel>::getLeafIndex(Vector3 position) const {
+  return mortonKey(root_->box, height_, position);
+}
+
+template <class Kernel>
+FmmTree3<Kernel>::FmmTree3(int p, const std::vector<Point3> &sources,
+                           int height, FmmOptions options)
+    : p_(p), height_(height), options_(options), pool_(options.num_threads) {
+  if (options_.schedule != FmmSchedule::Levels ||
+      options_.m2l != M2LMode::Direct || options_.scaled ||
+      options_.periodic_cell) {
+    throw std::invalid_argument("FmmTree3 supports num_threads only");
+  }
+  if (height_ < 0 || 3 * height_ > 63) {
+    throw std::invalid_argument("FmmTree3 height must be in 0..21");
+  }
+  if (height_ == 0) {
+    return;
+  }
+
+  levels_.resize(height_ + 1);
+  std::size_t total_nodes = 0;
+  for (int level = 0; level <= height_; level++) {
+    std::size_t level_nodes = std::size_t(1) << (3 * level);
+    node_arenas_.emplace_back(level_nodes);
+    levels_[level].reserve(level_nodes);
+    total_nodes += level_nodes;
+  }
+  coefficients_ =
+      AlignedBuffer<Complex>(Node::numCoefficients(p_) * total_nodes);
+
+  root_ = newNode(0, computeBoundingBox3(sources));
+  for (int level = 0; level <= height_; level++) {
+    for (Node *node : levels_[level]) {
+      buildChildNodes(node, level);
+    }
+  }
+  // parents before children, as computeNodeLists expects
+  for (int level = 0; level <= height_; level++) {
+    for (Node *node : levels_[level]) {
+      computeNodeLists(node);
+    }
+  }
+  prepareRotations();
+  sortSources(sources);
+  computeExpansions();
+}
+
+// One M2L rotation for each of the 343 offsets of the 7 x 7 x 7 grid, so
+// that offsetIndex addresses them directly; only the 316 with a coordinate
+// of magnitude 2 or 3 occur in interaction lists. The Wigner matrices are
+// shared between rotations of equal polar angle, of which there are few.
+template <class Kernel> void FmmTree3<Kernel>::prepareRotations() {
+  std::map<double, std::shared_ptr<const WignerMatrices>> matrices;
+  auto rotation = [&](Vector3 direction) {
+    double angle = HarmonicRotation::polarAngle(direction);
+    auto &d = matrices[angle];
+    if (!d) {
+      d = std::make_shared<const WignerMatrices>(p_, angle);
+    }
+    return HarmonicRotation(direction, d);
+  };
+
+  for (uint32_t octant = 0; octant < 8; octant++) {
+    Vector3 direction = octantDirection(octant);
+    m2m_rotations_.push_back(rotation(direction));
+    l2l_rotations_.push_back(rotation(direction * -1.0));
+  }
+  for (int dx = -3; dx <= 3; dx++) {
+    for (int dy = -3; dy <= 3; dy++) {
+      for (int dz = -3; dz <= 3; dz++) {
+        m2l_rotations_.push_back(rotation(Vector3(dx, dy, dz)));
+      }
+    }
+  }
+}
+
+// Bins the sources into leaves with one radix sort on their Morton keys, so
+// every leaf owns a contiguous range
+template <class Kernel>
+void FmmTree3<Kernel>::sortSources(const std::vector<Point3> &sources) {
+  std::size_t num_sources = sources.size();
+  std::vector<uint64_t> keys(num_sources);
+  for (std::size_t i = 0; i < num_sources; i++) {
+    keys[i] = getLeafIndex(sources[i].position);
+  }
+  order_ = radixSortByKey(keys, 3 * height_);
+  keys_ = std::move(keys);
+
+  xs_.resize(num_sources);
+  ys_.resize(num_sources);
+  zs_.resize(num_sources);
+  strengths_.resize(num_sources);
+  for (std::size_t i = 0; i < num_sources; i++) {
+    const Point3 &source = sources[order_[i]];
+    xs_[i] = source.position.x;
+    ys_[i] = source.position.y;
+    zs_[i] = source.position.z;
+    strengths_[i] = source.strength;
+  }
+
+  std::size_t begin = 0;
+  for (Node *leaf : levels_[height_]) {
+    std::size_t end = begin;
+    while (end < num_sources && keys_[end] == leaf->index) {
+      end++;
+    }
+    leaf->point_begin = begin;
+    leaf->point_end = end;
+    begin = end;
+  }
+}
+
+template <class Kernel> void FmmTree3<Kernel>::computeExpansions() {
+  // step 1: form multipole expansions at each leaf node
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    buildLeafExpansion(levels_[height_][i]);
+  });
+
+  // step 2: form multipole expansions up the tree by combining child multipole
+  // expansions
+  for (int level = height_ - 1; level >= 2; level--) {
+    pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+      translateChildren(levels_[level][i]);
+    });
+  }
+
+  // step 3: form local expansions down the tree from the parent's local
+  // expansion and the multipole expansions of the interaction list; locals at
+  // level 1 are zero, so level 2 has no L2L
+  for (int level = 2; level <= height_; level++) {
+    pool_.parallel_for(levels_[level].size(), [&](std::size_t i) {
+      Node *node = levels_[level][i];
+      node->local.clear();
+      if (level > 2) {
+        translateParent(node);
+      }
+      translateInteractions(node);
+    });
+  }
+}
+
+template <class Kernel>
+void FmmTree3<Kernel>::buildLeafExpansion(Node *leaf) {
+  std::size_t begin = leaf->point_begin;
+  leaf->multipole.clear();
+  leaf->multipole.buildExpansion(&xs_[begin], &ys_[begin], &zs_[begin],
+                                 &strengths_[begin], leaf->point_end - begin);
+}
+
+// direct sum over the sources of the leaf's near neighbors, skipping sources
+// at point itself
+template <class Kernel>
+double FmmTree3<Kernel>::nearField(const Node *leaf, Vector3 point) const {
+  double result = 0.0;
+  for (const Node *near_neighbor : leaf->near_neighbors) {
+    for (std::size_t j = near_neighbor->point_begin;
+         j < near_neighbor->point_end; j++) {
+      Vector3 position(xs_[j], ys_[j], zs_[j]);
+      if (position == point) {
+        continue;
+      }
+      result += Kernel::potential(Point3(position, strengths_[j]), point);
+    }
+  }
+  return result;
+}
+
+template <class Kernel>
+void FmmTree3<Kernel>::translateChildren(Node *node) {
+  node->multipole.clear();
+  for (uint32_t octant = 0; octant < 8; octant++) {
+    Node *child = node->children[octant];
+    double distance = std::sqrt(3.0) * child->box.half_side;
+    child->multipole.M2MInto(m2m_rotations_[octant], distance,
+                             node->multipole.coeffs);
+  }
+}
+
+template <class Kernel> void FmmTree3<Kernel>::translateParent(Node *node) {
+  uint32_t octant = getOctant(node->parent->box, node->box.center);
+  double distance = std::sqrt(3.0) * node->box.half_side;
+  node->parent->local.L2LInto(l2l_rotations_[octant], distance,
+                              node->local.coeffs);
+}
+
+template <class Kernel>
+void FmmTree3<Kernel>::translateInteractions(Node *node) {
+  double side = 2.0 * node->box.half_side;
+  for (Node *interaction : node->interaction_list) {
+    Vector3 offset = (interaction->box.center - node->box.center) / side;
+    int dx = std::lround(offset.x);
+    int dy = std::lround(offset.y);
+    int dz = std::lround(offset.z);
+    double distance = side * std::sqrt(dx * dx + dy * dy + dz * dz);
+    interaction->multipole.M2LInto(m2l_rotations_[offsetIndex(dx, dy, dz)],
+                                   distance, node->local.coeffs);
+  }
+}
+
+template <class Kernel>
+typename FmmTree3<Kernel>::Node *FmmTree3<Kernel>::newNode(int level,
+                                                           Box3 box) {
+  Complex *coefficients =
+      coefficients_.data() + Node::numCoefficients(p_) * num_nodes_;
+  num_nodes_++;
+  Node *node =
+      node_arenas_[level].emplace(p_, box, NodeType::Leaf, coefficients);
+  node->index = levels_[level].size();
+  levels_[level].push_back(node);
+  return node;
+}
+
+template <class Kernel>
+void FmmTree3<Kernel>::buildChildNodes(Node *node, int level) {
+  if (level == height_) {
+    node->type = NodeType::Leaf;
+    return;
+  }
+
+  node->type = NodeType::Internal;
+  for (uint32_t octant = 0; octant < 8; octant++) {
+    Node *child = newNode(level + 1, getChildBox(node->box, octant));
+    child->parent = node;
+    node->children[octant] = child;
+  }
+}
+
+// compute near neighbors and interaction list for node, assuming parent node
+// has already been computed
+template <class Kernel> void FmmTree3<Kernel>::computeNodeLists(Node *node) {
+  Node *parent = node->parent;
+  if (parent == nullptr) {
+    node->near_neighbors.push_back(node);
+    return;
+  }
+
+  for (Node *parent_neighbor : parent->near_neighbors) {
+    for (Node *child : parent_neighbor->children) {
+      if (adjacent(node->box, child->box)) {
+        node->near_neighbors.push_back(child);
+      } else {
+        node->interaction_list.push_back(child);
+      }
+    }
+  }
+}
+
+template <class Kernel>
+double FmmTree3<Kernel>::evaluate(Vector3 point) const {
+  Node *leaf = levels_[height_][getLeafIndex(point)];
+  return leaf->local.evaluate(point) + nearField(leaf, point);
+}
+
+template <class Kernel>
+std::vector<double> FmmTree3<Kernel>::evaluateSources() const {
+  std::vector<double> potentials(num_sources());
+  pool_.parallel_for(num_leaves(), [&](std::size_t i) {
+    const Node *leaf = levels_[height_][i];
+    for (std::size_t j = leaf->point_begin; j < leaf->point_end; j++) {
+      Vector3 point(xs_[j], ys_[j], zs_[j]);
+      potentials[order_[j]] =
+          leaf->local.evaluate(point) + nearField(leaf, point);
+    }
+  });
+  return potentials;
+}
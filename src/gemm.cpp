@@ -0,0 +1,56 @@
+#include "gemm.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr int block_n = 128;
+constexpr int block_k = 64;
+
+} // namespace
+
+void complexGemm(int m, int n, int k, const Complex *A, int lda,
+                 const Complex *B, int ldb, Complex *C, int ldc) {
+  alignas(64) double b_re[block_k * block_n];
+  alignas(64) double b_im[block_k * block_n];
+  alignas(64) double c_re[block_n];
+  alignas(64) double c_im[block_n];
+
+  for (int j0 = 0; j0 < n; j0 += block_n) {
+    int nb = std::min(block_n, n - j0);
+
+    for (int k0 = 0; k0 < k; k0 += block_k) {
+      int kb = std::min(block_k, k - k0);
+
+      for (int kk = 0; kk < kb; kk++) {
+        const Complex *b_row = B + (k0 + kk) * ldb + j0;
+        for (int j = 0; j < nb; j++) {
+          b_re[kk * block_n + j] = b_row[j].real();
+          b_im[kk * block_n + j] = b_row[j].imag();
+        }
+      }
+
+      for (int i = 0; i < m; i++) {
+        const Complex *a_row = A + i * lda + k0;
+        std::fill(c_re, c_re + nb, 0.0);
+        std::fill(c_im, c_im + nb, 0.0);
+
+        for (int kk = 0; kk < kb; kk++) {
+          double a_re = a_row[kk].real();
+          double a_im = a_row[kk].imag();
+          const double *br = b_re + kk * block_n;
+          const double *bi = b_im + kk * block_n;
+          for (int j = 0; j < nb; j++) {
+            c_re[j] += a_re * br[j] - a_im * bi[j];
+            c_im[j] += a_re * bi[j] + a_im * br[j];
+          }
+        }
+
+        Complex *c_row = C + i * ldc + j0;
+        for (int j = 0; j < nb; j++) {
+          c_row[j] += Complex(c_re[j], c_im[j]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <complex>
+
+using Complex = std::complex<double>;
+
+// C += A * B for row-major complex matrices: A is m x k, B is k x n and C is
+// m x n, with leading dimensions lda, ldb and ldc. Blocked over n and k; each
+// block of B is packed into separate real and imaginary planes so the inner
+// loop vectorizes.
+void complexGemm(int m, int n, int k, const Complex *A, int lda,
+                 const Complex *B, int ldb, Complex *C, int ldc);
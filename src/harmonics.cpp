@@ -0,0 +1,216 @@
+#include "harmonics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+void regularHarmonics(int p, Vector3 x, Complex *out) {
+  // T_n^m = |x|^n Y_n^m / w^m with w = x + i y, from
+  //   T_m^m = -sqrt((2m - 1) / 2m) T_(m-1)^(m-1),
+  //   T_(m+1)^m = sqrt(2m + 1) z T_m^m,
+  //   sqrt((n - m)(n + m)) T_n^m =
+  //       (2n - 1) z T_(n-1)^m - sqrt((n + m - 1)(n - m - 1)) r^2 T_(n-2)^m,
+  // which need no division by |x| and hold at the origin
+  double r2 = x.norm2();
+  Complex w(x.x, x.y);
+  Complex w_power = 1.0;
+  double diagonal = 1.0;
+  for (int m = 0; m <= p; m++) {
+    if (m > 0) {
+      diagonal *= -std::sqrt((2.0 * m - 1.0) / (2.0 * m));
+      w_power *= w;
+    }
+    out[harmonicIndex(m, m)] = diagonal * w_power;
+    if (m == p) {
+      break;
+    }
+    double previous = diagonal;
+    double current = std::sqrt(2.0 * m + 1.0) * x.z * diagonal;
+    out[harmonicIndex(m + 1, m)] = current * w_power;
+    for (int n = m + 2; n <= p; n++) {
+      double next =
+          ((2.0 * n - 1.0) * x.z * current -
+           std::sqrt((n + m - 1.0) * (n - m - 1.0)) * r2 * previous) /
+          std::sqrt((n - m) * static_cast<double>(n + m));
+      out[harmonicIndex(n, m)] = next * w_power;
+      previous = current;
+      current = next;
+    }
+  }
+}
+
+void irregularHarmonics(int p, Vector3 x, Complex *out) {
+  regularHarmonics(p, x, out);
+  double inverse_r2 = 1.0 / x.norm2();
+  double scale = std::sqrt(inverse_r2);
+  for (int n = 0; n <= p; n++) {
+    for (int m = 0; m <= n; m++) {
+      out[harmonicIndex(n, m)] *= scale;
+    }
+    scale *= inverse_r2;
+  }
+}
+
+HarmonicTables::HarmonicTables(int p)
+    : p_(p), factorials_(2 * p + 1), norms_(numHarmonics(p)) {
+  factorials_[0] = 1.0;
+  for (int n = 1; n <= 2 * p; n++) {
+    factorials_[n] = factorials_[n - 1] * n;
+  }
+  for (int n = 0; n <= p; n++) {
+    for (int m = 0; m <= n; m++) {
+      norms_[harmonicIndex(n, m)] =
+          std::sqrt(factorials_[n - m] * factorials_[n + m]);
+    }
+  }
+}
+
+const HarmonicTables &HarmonicTables::get(int p) {
+  thread_local const HarmonicTables *last = nullptr;
+  if (last != nullptr && last->p() == p) {
+    return *last;
+  }
+
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<const HarmonicTables>> tables;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &entry = tables[p];
+  if (!entry) {
+    entry = std::make_unique<const HarmonicTables>(p);
+  }
+  last = entry.get();
+  return *last;
+}
+
+namespace {
+
+// Jacobi polynomial P_k^(a, b)(x) by its three-term recurrence in k
+double jacobi(int k, int a, int b, double x) {
+  double previous = 1.0;
+  if (k == 0) {
+    return previous;
+  }
+  double current = (a + 1.0) + 0.5 * (a + b + 2.0) * (x - 1.0);
+  for (int n = 2; n <= k; n++) {
+    double s = 2.0 * n + a + b;
+    double next = ((s - 1.0) * (s * (s - 2.0) * x + a * a - b * b) * current -
+                   2.0 * (n + a - 1.0) * (n + b - 1.0) * s * previous) /
+                  (2.0 * n * (n + a + b) * (s - 2.0));
+    previous = current;
+    current = next;
+  }
+  return current;
+}
+
+} // namespace
+
+WignerMatrices::WignerMatrices(int p, double beta)
+    : p_(p), beta_(beta), offsets_(p + 2, 0) {
+  for (int n = 0; n <= p; n++) {
+    offsets_[n + 1] = offsets_[n] + (2 * n + 1) * (2 * n + 1);
+  }
+  data_.resize(offsets_[p + 1]);
+
+  // d^j_(m', m) = (-1)^lambda sqrt(binomial(2j - k, k + a) /
+  //     binomial(k + b, b)) sin(beta/2)^a cos(beta/2)^b P_k^(a, b)(cos beta)
+  // with k = min(j + m, j - m, j + m', j - m'), a = |m - m'|,
+  // b = 2j - 2k - a and lambda = m' - m when k is j + m or j - m', else 0
+  const HarmonicTables &tables = HarmonicTables::get(p);
+  auto binomial = [&](int n, int k) {
+    return tables.factorial(n) /
+           (tables.factorial(k) * tables.factorial(n - k));
+  };
+  double c = std::cos(beta);
+  double half_sin = std::sin(0.5 * beta);
+  double half_cos = std::cos(0.5 * beta);
+  for (int j = 0; j <= p; j++) {
+    double *block = &data_[offsets_[j]];
+    for (int m1 = -j; m1 <= j; m1++) {
+      for (int m2 = -j; m2 <= j; m2++) {
+        int k = std::min({j + m2, j - m2, j + m1, j - m1});
+        int a = std::abs(m2 - m1);
+        int lambda = 0;
+        if (k == j + m2) {
+          lambda = m1 - m2;
+        } else if (k != j - m2 && k != j + m1) {
+          lambda = m1 - m2;
+        }
+        int b = 2 * j - 2 * k - a;
+        double value = std::sqrt(binomial(2 * j - k, k + a) /
+                                 binomial(k + b, b)) *
+                       std::pow(half_sin, a) * std::pow(half_cos, b) *
+                       jacobi(k, a, b, c);
+        block[(m1 + j) * (2 * j + 1) + m2 + j] =
+            (lambda % 2 == 0) ? value : -value;
+      }
+    }
+  }
+}
+
+HarmonicRotation::HarmonicRotation(int p, Vector3 direction)
+    : HarmonicRotation(direction, std::make_shared<const WignerMatrices>(
+                                      p, polarAngle(direction))) {}
+
+HarmonicRotation::HarmonicRotation(Vector3 direction,
+                                   std::shared_ptr<const WignerMatrices> d)
+    : phase_(1.0), d_(std::move(d)) {
+  double rho = std::hypot(direction.x, direction.y);
+  if (rho > 0.0) {
+    phase_ = Complex(direction.x, direction.y) / rho;
+  }
+}
+
+double HarmonicRotation::polarAngle(Vector3 direction) {
+  return std::atan2(std::hypot(direction.x, direction.y), direction.z);
+}
+
+// in frame coordinates x' = R_y(-theta) R_z(-phi) x: the azimuthal step
+// multiplies coefficient m by e^(i m phi) and the polar step mixes the
+// orders of each degree through d^n(theta)^T; coefficients of negative order
+// come from X_n^-m = (-1)^m conj(X_n^m)
+void HarmonicRotation::forward(const Complex *in, Complex *out) const {
+  const WignerMatrices &d = *d_;
+  int p = d.p();
+  thread_local std::vector<Complex> phases, rotated;
+  phases.resize(p + 1);
+  rotated.resize(p + 1);
+  phases[0] = 1.0;
+  for (int m = 1; m <= p; m++) {
+    phases[m] = phases[m - 1] * phase_;
+  }
+
+  for (int n = 0; n <= p; n++) {
+    for (int m = 0; m <= n; m++) {
+      rotated[m] = in[harmonicIndex(n, m)] * phases[m];
+    }
+    for (int m1 = 0; m1 <= n; m1++) {
+      Complex sum = d(n, 0, m1) * rotated[0];
+      for (int m = 1; m <= n; m++) {
+        double sign = (m % 2 == 0) ? 1.0 : -1.0;
+        sum += d(n, m, m1) * rotated[m] +
+               sign * d(n, -m, m1) * std::conj(rotated[m]);
+      }
+      out[harmonicIndex(n, m1)] = sum;
+    }
+  }
+}
+
+void HarmonicRotation::backward(const Complex *in, Complex *out) const {
+  const WignerMatrices &d = *d_;
+  int p = d.p();
+  Complex inverse_phase = std::conj(phase_);
+  for (int n = 0; n <= p; n++) {
+    Complex phase = 1.0;
+    for (int m1 = 0; m1 <= n; m1++) {
+      Complex sum = d(n, m1, 0) * in[harmonicIndex(n, 0)];
+      for (int m = 1; m <= n; m++) {
+        double sign = (m % 2 == 0) ? 1.0 : -1.0;
+        sum += d(n, m1, m) * in[harmonicIndex(n, m)] +
+               sign * d(n, m1, -m) * std::conj(in[harmonicIndex(n, m)]);
+      }
+      out[harmonicIndex(n, m1)] = sum * phase;
+      phase *= inverse_phase;
+    }
+  }
+}
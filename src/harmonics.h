@@ -0,0 +1,108 @@
+#pragma once
+
+#include "vector.h"
+
+#include <complex>
+#include <memory>
+#include <span>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Spherical harmonics for the 3D Laplace kernel,
+//   Y_n^m(theta, phi) = sqrt((n - m)! / (n + m)!) P_n^m(cos theta) e^(i m phi)
+// with the Condon-Shortley phase in P_n^m, so Y_n^-m = (-1)^m conj(Y_n^m) and
+// for |y| < |x| the addition theorem reads
+//   1 / |x - y| = sum_(n, |m| <= n) |y|^n conj(Y_n^m(y)) Y_n^m(x) / |x|^(n+1).
+// Expansions of real potentials have the same symmetry in their
+// coefficients, so they keep m >= 0 only, (n, m) at harmonicIndex(n, m).
+inline int harmonicIndex(int n, int m) { return n * (n + 1) / 2 + m; }
+inline int numHarmonics(int p) { return (p + 1) * (p + 2) / 2; }
+
+// out[harmonicIndex(n, m)] = |x|^n Y_n^m(x), n <= p, m >= 0
+void regularHarmonics(int p, Vector3 x, Complex *out);
+// out[harmonicIndex(n, m)] = Y_n^m(x) / |x|^(n+1), for x != 0
+void irregularHarmonics(int p, Vector3 x, Complex *out);
+
+// Constants of the translations of order p: factorials up to (2p)! and
+// norm(n, m) = sqrt((n - m)! (n + m)!). Immutable and shared through get(),
+// like TranslationTables.
+class HarmonicTables {
+public:
+  explicit HarmonicTables(int p);
+
+  // the tables for order p, built on first use; safe from any thread
+  static const HarmonicTables &get(int p);
+
+  int p() const { return p_; }
+  double factorial(int n) const { return factorials_[n]; }
+  double norm(int n, int m) const { return norms_[harmonicIndex(n, m)]; }
+
+private:
+  int p_;
+  std::vector<double> factorials_;
+  std::vector<double> norms_;
+};
+
+// Wigner small-d matrices d^n_(m', m)(beta) for n <= p, from their Jacobi
+// polynomial form, which is stable at any order. Building them costs O(p^4).
+class WignerMatrices {
+public:
+  WignerMatrices(int p, double beta);
+
+  int p() const { return p_; }
+  double beta() const { return beta_; }
+  // d^n_(m', m), |m'|, |m| <= n
+  double operator()(int n, int m1, int m2) const {
+    return data_[offsets_[n] + (m1 + n) * (2 * n + 1) + m2 + n];
+  }
+
+private:
+  int p_;
+  double beta_;
+  std::vector<std::size_t> offsets_;
+  std::vector<double> data_;
+};
+
+// Rotation of the coordinate frame that takes a direction onto +z, acting on
+// the coefficients of expansions of order p: a rotation about z by the
+// direction's azimuth, then about y by its polar angle. Both steps keep the
+// degree n, so each costs O(p^3) in all, which is what makes translating
+// along the rotated z axis pay off. The Wigner matrices are shared between
+// rotations with the same polar angle.
+class HarmonicRotation {
+public:
+  HarmonicRotation(int p, Vector3 direction);
+  // with d = WignerMatrices(p, polarAngle(direction)), shared
+  HarmonicRotation(Vector3 direction,
+                   std::shared_ptr<const WignerMatrices> d);
+
+  static double polarAngle(Vector3 direction);
+
+  int p() const { return d_->p(); }
+  // coefficients in the rotated frame: out = R in, both numHarmonics(p)
+  void forward(const Complex *in, Complex *out) const;
+  // back to the original frame: out = R^-1 in
+  void backward(const Complex *in, Complex *out) const;
+
+private:
+  Complex phase_; // e^(i phi) of the direction's azimuth phi
+  std::shared_ptr<const WignerMatrices> d_;
+};
+
+// out += R^-1 axial(R in): a translation along the direction of rotation done
+// in its frame, where axial(rotated, translated) reads and writes
+// numHarmonics(p) coefficients
+template <class Axial>
+void rotatedTranslation(const HarmonicRotation &rotation, const Complex *in,
+                        std::span<Complex> out, Axial axial) {
+  thread_local std::vector<Complex> rotated, translated;
+  rotated.resize(out.size());
+  translated.assign(out.size(), 0.0);
+  rotation.forward(in, rotated.data());
+  axial(rotated.data(), translated.data());
+  rotation.backward(translated.data(), rotated.data());
+  for (std::size_t i = 0; i < out.size(); i++) {
+    out[i] += rotated[i];
+  }
+}
@@ -0,0 +1,123 @@
+#include "lattice.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+// Sums F_n of (2 w)^-n over the far images w = m + i n, max(|m|, |n|) >= 2,
+// which are the lattice sums for a cell of half side 1, for n = 0..max_n.
+// Low orders subtract the 3x3 block from the full lattice sums; from
+// direct_from on the far images are summed over a few shells, as the
+// remainder has fallen below rounding while the subtraction would cancel.
+std::vector<double> farSums(int max_n) {
+  constexpr int direct_from = 20;
+  constexpr int shells = 32;
+  std::vector<double> sums(max_n + 1, 0.0);
+
+  for (int n = 4; n <= std::min(max_n, direct_from - 1); n += 4) {
+    double near = 0.0;
+    for (int y = -1; y <= 1; y++) {
+      for (int x = -1; x <= 1; x++) {
+        if (x != 0 || y != 0) {
+          near += std::pow(Complex(x, y), -n).real();
+        }
+      }
+    }
+    sums[n] = std::ldexp(LatticeSumOperator::latticeSum(n) - near, -n);
+  }
+
+  if (max_n >= direct_from) {
+    for (int y = -shells; y <= shells; y++) {
+      for (int x = -shells; x <= shells; x++) {
+        if (std::max(std::abs(x), std::abs(y)) < 2) {
+          continue;
+        }
+        Complex inverse = 1.0 / Complex(2.0 * x, 2.0 * y);
+        Complex power = std::pow(inverse, direct_from);
+        for (int n = direct_from; n <= max_n; n++) {
+          sums[n] += power.real();
+          power *= inverse;
+        }
+      }
+    }
+    for (int n = direct_from; n <= max_n; n++) {
+      if (n % 4 != 0) {
+        sums[n] = 0.0; // zero by symmetry, up to rounding
+      }
+    }
+  }
+  return sums;
+}
+
+} // namespace
+
+double LatticeSumOperator::latticeSum(int n) {
+  if (n < 4 || n % 4 != 0) {
+    return 0.0;
+  }
+
+  // P(z) = z^-2 + sum_k c_k z^(2k - 2) with c_k = (2k - 1) G_2k, c_2 = 3 G_4,
+  // c_3 = 0 for the square lattice and, for k >= 4,
+  //   c_k = 3 / ((2k + 1)(k - 3)) sum_(m=2..k-2) c_m c_(k-m)
+  double g4 = std::pow(std::tgamma(0.25), 8) /
+              (960.0 * std::numbers::pi * std::numbers::pi);
+  int last = n / 2;
+  std::vector<double> c(last + 1, 0.0);
+  c[2] = 3.0 * g4;
+  for (int k = 4; k <= last; k++) {
+    double sum = 0.0;
+    for (int m = 2; m <= k - 2; m++) {
+      sum += c[m] * c[k - m];
+    }
+    c[k] = 3.0 * sum / ((2.0 * k + 1.0) * (k - 3.0));
+  }
+  return c[last] / (2.0 * last - 1.0);
+}
+
+LatticeSumOperator::LatticeSumOperator(int p, double half_side)
+    : p_(p), half_side_(half_side), matrix_((p + 1) * (p + 1), 0.0) {
+  const TranslationTables &tables = TranslationTables::get(p);
+  std::vector<double> far = farSums(2 * p);
+
+  for (int k = 1; k <= p; k++) {
+    matrix_[k] = tables.sign(k) * far[k];
+  }
+  for (int l = 1; l <= p; l++) {
+    for (int k = 1; k <= p; k++) {
+      matrix_[l * (p + 1) + k] =
+          tables.sign(k) * tables.binomial(l + k - 1, k - 1) * far[l + k];
+    }
+  }
+}
+
+void LatticeSumOperator::apply(const Complex *multipole, Complex *local,
+                               double scale) const {
+  // multipole coefficient k is rescaled from scale to half_side by ratio^k,
+  // and local coefficient l back by ratio^l
+  double ratio = scale / half_side_;
+  std::vector<double> powers(p_ + 1);
+  powers[0] = 1.0;
+  for (int k = 1; k <= p_; k++) {
+    powers[k] = powers[k - 1] * ratio;
+  }
+
+  for (int l = 0; l <= p_; l++) {
+    const double *row = &matrix_[l * (p_ + 1)];
+    Complex sum = 0.0;
+    for (int k = 1; k <= p_; k++) {
+      sum += row[k] * powers[k] * multipole[k];
+    }
+    local[l] += sum * powers[l];
+  }
+
+  // b_1 += pi conj(D) / L^2 with D = -a_1, in units of scale
+  if (p_ == 0) {
+    return;
+  }
+  double side = 2.0 * half_side_;
+  local[1] -= std::numbers::pi / (side * side) * scale * scale *
+              std::conj(multipole[1]);
+}
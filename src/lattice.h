@@ -0,0 +1,44 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Far field of the periodic images of a square cell for the 2D log kernel.
+// The images at lattice offsets w = L (m + i n), max(|m|, |n|) >= 2, of a
+// cell of side L are translated onto the cell's local expansion in one step:
+// summing Lemma 2.2.2 over them gives
+//   b_0 = sum_k (-1)^k a_k S_k,
+//   b_l = sum_k (-1)^k a_k binomial(l + k - 1, k - 1) S_(l+k),
+// with the lattice sums S_n = sum_w w^-n. The a_0 log(-w) and a_0 / w^l
+// terms diverge and drop out only for a charge-neutral cell (a_0 = 0). S_1
+// and S_2 converge only conditionally; summing the images in square shells
+// about the cell makes both zero, as are all S_n with n not a multiple of 4
+// for the square lattice. Shells leave the uniform field of the cell's
+// dipole moment D = sum q (z - center) = -a_1 on their surface, which moves
+// the potential by -pi Re(D) / L from one cell to the next; the operator
+// adds pi conj(D) / L^2 to b_1 to cancel it, so the potential is periodic.
+// The images nearer than that are left to the tree's periodic lists.
+class LatticeSumOperator {
+public:
+  LatticeSumOperator(int p, double half_side);
+
+  int p() const { return p_; }
+  double half_side() const { return half_side_; }
+
+  // sum of w^-n over the nonzero points w = m + i n of the unit square
+  // lattice, in square shells: G_4 = Gamma(1/4)^8 / (960 pi^2) and the
+  // higher ones from the Laurent series of the Weierstrass function, zero for
+  // n not a multiple of 4
+  static double latticeSum(int n);
+
+  // local += T multipole, both centered on the cell and scaled by scale (see
+  // MultipoleExpansion::scale; 1 for unscaled expansions)
+  void apply(const Complex *multipole, Complex *local, double scale) const;
+
+private:
+  int p_;
+  double half_side_;
+  std::vector<double> matrix_; // [l][k], for expansions scaled by half_side
+};
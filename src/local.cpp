@@ -1,7 +1,74 @@
 #include "local.h"
+#include "fixedorder.h"
+#include "tables.h"
 
-LocalExpansion &LocalExpansion::operator+=(const LocalExpansion &other) {
-  if (p != other.p || center != other.center) {
+#include <stdexcept>
+
+template <class T>
+BasicLocalExpansion<T>::BasicLocalExpansion(const BasicLocalExpansion &other)
+    : p(other.p), center(other.center), scale(other.scale),
+      storage_(other.coeffs.begin(), other.coeffs.end()) {
+  coeffs = storage_;
+}
+
+template <class T>
+BasicLocalExpansion<T>::BasicLocalExpansion(
+    BasicLocalExpansion &&other) noexcept
+    : p(other.p), center(other.center), scale(other.scale),
+      storage_(std::move(other.storage_)) {
+  coeffs = storage_.empty() ? other.coeffs : std::span<Coefficient>(storage_);
+  if (!storage_.empty()) {
+    other.coeffs = {};
+  }
+}
+
+template <class T>
+BasicLocalExpansion<T> &
+BasicLocalExpansion<T>::operator=(const BasicLocalExpansion &other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (isView()) {
+    // a view stays on its buffer, which belongs to a tree's flat storage
+    if (coeffs.size() != other.coeffs.size()) {
+      throw std::invalid_argument(
+          "Cannot assign an expansion of another order to a view");
+    }
+    std::copy(other.coeffs.begin(), other.coeffs.end(), coeffs.begin());
+  } else {
+    storage_.assign(other.coeffs.begin(), other.coeffs.end());
+    coeffs = storage_;
+  }
+  p = other.p;
+  center = other.center;
+  scale = other.scale;
+  return *this;
+}
+
+template <class T>
+BasicLocalExpansion<T> &
+BasicLocalExpansion<T>::operator=(BasicLocalExpansion &&other) {
+  if (this == &other) {
+    return *this;
+  }
+  // only owned coefficients move; to or from a view the values are copied,
+  // so that assignment never leaves two expansions on one buffer
+  if (isView() || other.isView()) {
+    return *this = static_cast<const BasicLocalExpansion &>(other);
+  }
+  storage_ = std::move(other.storage_);
+  coeffs = storage_;
+  other.coeffs = {};
+  p = other.p;
+  center = other.center;
+  scale = other.scale;
+  return *this;
+}
+
+template <class T>
+BasicLocalExpansion<T> &
+BasicLocalExpansion<T>::operator+=(const BasicLocalExpansion &other) {
+  if (p != other.p || center != other.center || scale != other.scale) {
     throw std::runtime_error("Cannot add incompatible local expansions");
   }
 
@@ -11,49 +78,109 @@ LocalExpansion &LocalExpansion::operator+=(const LocalExpansion &other) {
   return *this;
 }
 
-double LocalExpansion::evaluate(Vector2 point) const {
+template <class T>
+double BasicLocalExpansion<T>::evaluate(Vector2 point) const {
+  double result = 0.0;
+  if (fixed_order::dispatch(p, [&](auto order) {
+        result = fixed_order::l2p<order>(coeffs.data(), center, point, scale);
+      })) {
+    return result;
+  }
+  return evaluateDynamic(point);
+}
+
+template <class T>
+double BasicLocalExpansion<T>::evaluateDynamic(Vector2 point) const {
   Complex z(point.x, point.y);
-  z -= center;
+  z = (z - center) / scale;
 
   Complex result = 0;
   Complex z_power = 1;
 
   for (int l = 0; l <= p; l++) {
-    result += coeffs[l] * z_power;
+    result += Complex(coeffs[l]) * z_power;
     z_power *= z;
   }
 
   return result.real();
 }
 
-void LocalExpansion::M2L(const MultipoleExpansion &multipole) {
+template <class T>
+PotentialGradient
+BasicLocalExpansion<T>::evaluateWithGradient(Vector2 point) const {
+  Complex z(point.x, point.y);
+  z = (z - center) / scale;
+
+  Complex value = coeffs[p];
+  Complex derivative = 0.0;
+  for (int l = p - 1; l >= 0; l--) {
+    derivative = derivative * z + value;
+    value = value * z + Complex(coeffs[l]);
+  }
+  derivative /= scale;
+
+  return {value.real(), Vector2(derivative.real(), -derivative.imag())};
+}
+
+template <class T>
+void BasicLocalExpansion<T>::M2L(
+    const BasicMultipoleExpansion<T> &multipole) {
+  if (scale != 1.0 || multipole.scale != 1.0) {
+    throw std::runtime_error("M2L requires unscaled expansions");
+  }
+
   // Lemma 2.2.2
+  const TranslationTables &tables = TranslationTables::get(p);
   Complex shift = multipole.center - center;
+  std::vector<Complex> inv_powers(p + 1);
+  shiftPowers(1.0 / shift, p, inv_powers.data());
 
-  coeffs[0] = multipole.coeffs[0] * std::log(-shift);
+  Complex a0 = multipole.coeffs[0];
+  Complex sum = a0 * std::log(-shift);
   for (int k = 1; k <= p; k++) {
-    int sign = (k % 2 == 0) ? 1 : -1;
-    coeffs[0] += static_cast<double>(sign) * multipole.coeffs[k] *
-                 inv_exp_table.inv_exp(shift, k);
+    sum += tables.sign(k) * Complex(multipole.coeffs[k]) * inv_powers[k];
   }
+  coeffs[0] = Coefficient(sum);
 
   for (int l = 1; l <= p; l++) {
-    coeffs[l] = -multipole.coeffs[0] / static_cast<double>(l);
+    sum = -a0 * tables.inverse(l);
     for (int k = 1; k <= p; k++) {
-      int sign = (k % 2 == 0) ? 1 : -1;
-      coeffs[l] +=
-          static_cast<double>(sign) * multipole.coeffs[k] *
-          inv_exp_table.inv_exp(shift, k) *
-          static_cast<double>(binomial_table.binomial(l + k - 1, k - 1));
+      sum += tables.sign(k) * Complex(multipole.coeffs[k]) * inv_powers[k] *
+             tables.binomial(l + k - 1, k - 1);
+    }
+    coeffs[l] = Coefficient(sum * inv_powers[l]);
+  }
+}
+
+template <class T>
+void BasicLocalExpansion<T>::P2L(const std::vector<Point> &sources) {
+  // Lemma 2.2.2 with a single source term: log(z - z0) expanded about center,
+  // the powers in z0 / scale
+  for (const Point &source : sources) {
+    Complex z0(source.position.x, source.position.y);
+    z0 -= center;
+    coeffs[0] += Coefficient(source.strength * std::log(-z0));
+
+    Complex w0 = z0 / scale;
+    Complex w0_inv_power = 1.0 / w0;
+    for (int l = 1; l <= p; l++) {
+      coeffs[l] -=
+          Coefficient(source.strength * w0_inv_power / static_cast<double>(l));
+      w0_inv_power /= w0;
     }
-    coeffs[l] *= inv_exp_table.inv_exp(shift, l);
   }
 }
 
-LocalExpansion LocalExpansion::L2L(const Complex &shift) {
+template <class T>
+BasicLocalExpansion<T>
+BasicLocalExpansion<T>::L2L(const Complex &shift) const {
+  if (scale != 1.0) {
+    throw std::runtime_error("L2L requires an unscaled local expansion");
+  }
+
   // Lemma 2.2.3
   Complex new_center = center - shift;
-  std::vector<Complex> new_coeffs(coeffs);
+  std::vector<Complex> new_coeffs(coeffs.begin(), coeffs.end());
 
   for (int j = 0; j < p; j++) {
     for (int k = p - j - 1; k < p; k++) {
@@ -61,6 +188,46 @@ LocalExpansion LocalExpansion::L2L(const Complex &shift) {
     }
   }
 
-  return LocalExpansion(Vector2(new_center.real(), new_center.imag()),
-                        new_coeffs);
+  return BasicLocalExpansion(
+      Vector2(new_center.real(), new_center.imag()),
+      std::vector<Coefficient>(new_coeffs.begin(), new_coeffs.end()));
+}
+
+template <class T>
+void BasicLocalExpansion<T>::L2LInto(const Complex &shift,
+                                     std::span<Coefficient> out,
+                                     double out_scale) const {
+  if (!fixed_order::dispatch(p, [&](auto order) {
+        fixed_order::l2l<order>(coeffs.data(), shift, out.data(), scale,
+                                out_scale);
+      })) {
+    L2LIntoDynamic(shift, out, out_scale);
+  }
 }
+
+template <class T>
+void BasicLocalExpansion<T>::L2LIntoDynamic(const Complex &shift,
+                                            std::span<Coefficient> out,
+                                            double out_scale) const {
+  // Lemma 2.2.3 expanded, with ratio = out_scale / scale:
+  //   out[l] += ratio^l sum_k coeffs[k] binomial(k, l) (-shift / scale)^(k - l)
+  // for k = l..p
+  double ratio = out_scale / scale;
+  Complex step = -shift / scale;
+  double ratio_power = 1.0;
+  for (int l = 0; l <= p; l++) {
+    Complex sum = 0.0;
+    Complex power = 1.0;
+    double binomial = 1.0;
+    for (int k = l; k <= p; k++) {
+      sum += Complex(coeffs[k]) * power * binomial;
+      power *= step;
+      binomial = binomial * (k + 1) / static_cast<double>(k + 1 - l);
+    }
+    out[l] += Coefficient(sum * ratio_power);
+    ratio_power *= ratio;
+  }
+}
+
+template struct BasicLocalExpansion<float>;
+template struct BasicLocalExpansion<double>;
@@ -2,36 +2,91 @@
 
 #include "multipole.h"
 #include "point.h"
-#include "tables.h"
 #include "vector.h"
 
+#include <algorithm>
 #include <complex>
+#include <span>
 #include <vector>
 
 using Complex = std::complex<double>;
 
-struct LocalExpansion {
+// Local expansion with coefficients of real type T, float or double, as for
+// BasicMultipoleExpansion
+template <class T> struct BasicLocalExpansion {
+  using Coefficient = std::complex<T>;
+
   int p;
   Complex center;
-  std::vector<Complex> coeffs;
+  // radius the coefficients are scaled by: coefficient l holds b_l * scale^l
+  double scale = 1.0;
+  // p + 1 coefficients, in owned storage or in a caller-provided buffer
+  std::span<Coefficient> coeffs;
 
-  InverseExponentialTable inv_exp_table;
-  BinomialTable binomial_table;
+  BasicLocalExpansion(int p, Vector2 center)
+      : p(p), center(center.x, center.y), storage_(p + 1) {
+    coeffs = storage_;
+  }
 
-  LocalExpansion(int p, Vector2 center)
-      : p(p), center(center.x, center.y), coeffs(p + 1) {}
+  BasicLocalExpansion(Vector2 center, const std::vector<Coefficient> &coeffs)
+      : p(coeffs.size() - 1), center(center.x, center.y), storage_(coeffs) {
+    this->coeffs = storage_;
+  }
 
-  LocalExpansion(Vector2 center, const std::vector<Complex> &coeffs) {
-    this->coeffs = coeffs;
-    this->p = coeffs.size() - 1;
-    this->center = Complex(center.x, center.y);
+  // view of the p + 1 coefficients at buffer, which is zeroed unless zero is
+  // false (the values are kept, as for a mapped tree) and must outlive the
+  // expansion
+  BasicLocalExpansion(int p, Vector2 center, Coefficient *buffer,
+                      bool zero = true)
+      : p(p), center(center.x, center.y), coeffs(buffer, p + 1) {
+    if (zero) {
+      clear();
+    }
   }
 
-  LocalExpansion &operator+=(const LocalExpansion &other);
-  void clear() { coeffs.assign(p + 1, 0.0); }
+  // copies own their coefficients; assigning to a view writes the values into
+  // its buffer, and throws std::invalid_argument for another order
+  BasicLocalExpansion(const BasicLocalExpansion &other);
+  BasicLocalExpansion(BasicLocalExpansion &&other) noexcept;
+  BasicLocalExpansion &operator=(const BasicLocalExpansion &other);
+  BasicLocalExpansion &operator=(BasicLocalExpansion &&other);
+
+  BasicLocalExpansion &operator+=(const BasicLocalExpansion &other);
+  void clear() { std::fill(coeffs.begin(), coeffs.end(), Coefficient(0)); }
 
   double evaluate(Vector2 point) const;
+  // potential and gradient from f(z) and f'(z) in one Horner pass:
+  // grad Re f = (Re f', -Im f')
+  PotentialGradient evaluateWithGradient(Vector2 point) const;
+
+  // M2L and L2L by value: unscaled expansions only. M2L overwrites this
+  // expansion's coefficients and reads the shared TranslationTables of
+  // order p.
+  void M2L(const BasicMultipoleExpansion<T> &multipole);
+  void P2L(const std::vector<Point> &sources);
+  BasicLocalExpansion L2L(const Complex &shift) const;
 
-  void M2L(const MultipoleExpansion &multipole);
-  LocalExpansion L2L(const Complex &shift);
+  // Allocation-free L2L that accumulates into a caller-provided span of p + 1
+  // coefficients scaled by out_scale; shift is this expansion's center minus
+  // the target center. evaluate and L2LInto run the fixed-order kernels of
+  // fixedorder.h for orders 4..32.
+  void L2LInto(const Complex &shift, std::span<Coefficient> out,
+               double out_scale = 1.0) const;
+
+  // runtime-order versions of evaluate and L2LInto, for any p
+  double evaluateDynamic(Vector2 point) const;
+  void L2LIntoDynamic(const Complex &shift, std::span<Coefficient> out,
+                      double out_scale = 1.0) const;
+
+private:
+  std::vector<Coefficient> storage_; // empty for views
+
+  // views have coefficients but no storage; moved-from expansions have
+  // neither
+  bool isView() const { return storage_.empty() && !coeffs.empty(); }
 };
+
+using LocalExpansion = BasicLocalExpansion<double>;
+
+extern template struct BasicLocalExpansion<float>;
+extern template struct BasicLocalExpansion<double>;
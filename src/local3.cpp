@@ -0,0 +1,75 @@
+#include "local3.h"
+
+#include <cmath>
+
+LocalExpansion3::LocalExpansion3(const LocalExpansion3 &other)
+    : p(other.p), center(other.center),
+      storage_(other.coeffs.begin(), other.coeffs.end()) {
+  coeffs = storage_;
+}
+
+LocalExpansion3 &LocalExpansion3::operator=(const LocalExpansion3 &other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (storage_.empty() && coeffs.size() == other.coeffs.size()) {
+    std::copy(other.coeffs.begin(), other.coeffs.end(), coeffs.begin());
+  } else {
+    storage_.assign(other.coeffs.begin(), other.coeffs.end());
+    coeffs = storage_;
+  }
+  p = other.p;
+  center = other.center;
+  return *this;
+}
+
+// the m = 0 terms plus twice the real part of the m > 0 terms, as for
+// MultipoleExpansion3::evaluate
+double LocalExpansion3::evaluate(Vector3 point) const {
+  thread_local std::vector<Complex> harmonics;
+  harmonics.resize(numHarmonics(p));
+  regularHarmonics(p, point - center, harmonics.data());
+
+  double result = 0.0;
+  for (int n = 0; n <= p; n++) {
+    const Complex *c = &coeffs[harmonicIndex(n, 0)];
+    const Complex *y = &harmonics[harmonicIndex(n, 0)];
+    result += (c[0] * y[0]).real();
+    for (int m = 1; m <= n; m++) {
+      result += 2.0 * (c[m] * y[m]).real();
+    }
+  }
+  return result;
+}
+
+// Along z, with this center at distance d above the target center,
+//   L'_j^m = sum_(n=j..p) (-d)^(n-j) norm(n, m) / ((n - j)! norm(j, m)) L_n^m
+void LocalExpansion3::L2LInto(const HarmonicRotation &rotation,
+                              double distance,
+                              std::span<Coefficient> out) const {
+  const HarmonicTables &tables = HarmonicTables::get(p);
+  rotatedTranslation(
+      rotation, coeffs.data(), out, [&](const Complex *in, Complex *result) {
+        thread_local std::vector<double> powers;
+        powers.resize(p + 1);
+        powers[0] = 1.0;
+        for (int k = 1; k <= p; k++) {
+          powers[k] = -powers[k - 1] * distance / k;
+        }
+        for (int m = 0; m <= p; m++) {
+          for (int j = m; j <= p; j++) {
+            Complex sum = 0.0;
+            for (int n = j; n <= p; n++) {
+              sum += powers[n - j] * tables.norm(n, m) *
+                     in[harmonicIndex(n, m)];
+            }
+            result[harmonicIndex(j, m)] = sum / tables.norm(j, m);
+          }
+        }
+      });
+}
+
+void LocalExpansion3::L2LInto(Vector3 shift,
+                              std::span<Coefficient> out) const {
+  L2LInto(HarmonicRotation(p, shift), shift.norm(), out);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "harmonics.h"
+#include "multipole3.h"
+#include "point3.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <complex>
+#include <span>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Local expansion of the 3D Laplace kernel about center,
+//   phi(x) = sum_(n, |m| <= n) L_n^m |x - center|^n Y_n^m(x - center),
+// stored like MultipoleExpansion3
+struct LocalExpansion3 {
+  using Coefficient = Complex;
+
+  int p;
+  Vector3 center;
+  // numHarmonics(p) coefficients, in owned storage or a caller's buffer
+  std::span<Coefficient> coeffs;
+
+  LocalExpansion3(int p, Vector3 center)
+      : p(p), center(center), storage_(numHarmonics(p)) {
+    coeffs = storage_;
+  }
+
+  // view of the numHarmonics(p) coefficients at buffer, zeroed unless zero is
+  // false; the buffer must outlive the expansion
+  LocalExpansion3(int p, Vector3 center, Coefficient *buffer,
+                  bool zero = true)
+      : p(p), center(center), coeffs(buffer, numHarmonics(p)) {
+    if (zero) {
+      clear();
+    }
+  }
+
+  // copies own their coefficients; assigning to a view writes the values into
+  // its buffer
+  LocalExpansion3(const LocalExpansion3 &other);
+  LocalExpansion3 &operator=(const LocalExpansion3 &other);
+
+  void clear() { std::fill(coeffs.begin(), coeffs.end(), Coefficient(0)); }
+
+  double evaluate(Vector3 point) const;
+
+  // L2L into a caller-provided span of numHarmonics(p) coefficients, as for
+  // MultipoleExpansion3::M2MInto: shift is this expansion's center minus the
+  // target center and rotation takes its direction onto +z
+  void L2LInto(const HarmonicRotation &rotation, double distance,
+               std::span<Coefficient> out) const;
+  void L2LInto(Vector3 shift, std::span<Coefficient> out) const;
+
+private:
+  std::vector<Coefficient> storage_; // empty for views
+};
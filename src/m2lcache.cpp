@@ -0,0 +1,204 @@
+#include "m2lcache.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// slot of each offset of the 7x7 grid, row by row, skipping the 3x3 near
+// field, which maps to -1; built at compile time so that offsetIndex is one
+// lookup
+constexpr std::array<int, 49> offset_slots = [] {
+  std::array<int, 49> slots{};
+  int slot = 0;
+  for (int y = -3; y <= 3; y++) {
+    for (int x = -3; x <= 3; x++) {
+      bool near = x >= -1 && x <= 1 && y >= -1 && y <= 1;
+      slots[(y + 3) * 7 + x + 3] = near ? -1 : slot++;
+    }
+  }
+  return slots;
+}();
+static_assert(offset_slots[48] == M2LOperatorCache::num_offsets - 1);
+
+} // namespace
+
+M2LOperatorCache::M2LOperatorCache(int p, double root_half_side, int height,
+                                   bool scaled)
+    : p_(p), root_half_side_(root_half_side), height_(height),
+      scaled_(scaled) {
+  int num_levels = std::max(0, height - 1);
+  std::size_t matrix_size = (p + 1) * (p + 1);
+  matrices_.resize(num_levels * num_offsets * matrix_size);
+
+  for (int level = 2; level <= height; level++) {
+    double side = 2.0 * root_half_side / std::pow(2.0, level);
+    double scale = scaled ? side / 2.0 : 1.0;
+    for (int dy = -3; dy <= 3; dy++) {
+      for (int dx = -3; dx <= 3; dx++) {
+        int slot = offsetIndex(dx, dy);
+        if (slot < 0) {
+          continue;
+        }
+        Complex shift(dx * side, dy * side);
+        buildMatrix(shift, scale,
+                    &matrices_[((level - 2) * num_offsets + slot) *
+                               matrix_size]);
+      }
+    }
+  }
+
+  int num_child_levels = std::max(0, height - 2);
+  m2m_matrices_.resize(num_child_levels * 4 * matrix_size);
+  l2l_matrices_.resize(num_child_levels * 4 * matrix_size);
+  for (int level = 3; level <= height; level++) {
+    double half_side = root_half_side / std::pow(2.0, level);
+    double child_scale = scaled ? half_side : 1.0;
+    double parent_scale = scaled ? 2.0 * half_side : 1.0;
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+      // child center minus parent center
+      Complex shift((quadrant & 1) ? half_side : -half_side,
+                    (quadrant & 2) ? half_side : -half_side);
+      std::size_t offset = ((level - 3) * 4 + quadrant) * matrix_size;
+      buildM2MMatrix(shift, child_scale, parent_scale, &m2m_matrices_[offset]);
+      buildL2LMatrix(-shift, parent_scale, child_scale,
+                     &l2l_matrices_[offset]);
+    }
+  }
+}
+
+int M2LOperatorCache::offsetIndex(int dx, int dy) {
+  if (dx < -3 || dx > 3 || dy < -3 || dy > 3) {
+    return -1;
+  }
+  return offset_slots[(dy + 3) * 7 + dx + 3];
+}
+
+const Complex *M2LOperatorCache::matrix(int level, int offset_index) const {
+  if (level < 2 || level > height_ || offset_index < 0 ||
+      offset_index >= num_offsets) {
+    throw std::out_of_range("No cached M2L operator for this level/offset");
+  }
+  std::size_t matrix_size = (p_ + 1) * (p_ + 1);
+  return &matrices_[((level - 2) * num_offsets + offset_index) * matrix_size];
+}
+
+const Complex *M2LOperatorCache::m2mMatrix(int level, int quadrant) const {
+  if (level < 3 || level > height_ || quadrant < 0 || quadrant > 3) {
+    throw std::out_of_range("No cached M2M operator for this level/quadrant");
+  }
+  std::size_t matrix_size = (p_ + 1) * (p_ + 1);
+  return &m2m_matrices_[((level - 3) * 4 + quadrant) * matrix_size];
+}
+
+const Complex *M2LOperatorCache::l2lMatrix(int level, int quadrant) const {
+  if (level < 3 || level > height_ || quadrant < 0 || quadrant > 3) {
+    throw std::out_of_range("No cached L2L operator for this level/quadrant");
+  }
+  std::size_t matrix_size = (p_ + 1) * (p_ + 1);
+  return &l2l_matrices_[((level - 3) * 4 + quadrant) * matrix_size];
+}
+
+void M2LOperatorCache::apply(int level, int dx, int dy,
+                             const Complex *multipole, Complex *local) const {
+  const Complex *T = matrix(level, offsetIndex(dx, dy));
+  for (int l = 0; l <= p_; l++) {
+    Complex sum = 0.0;
+    for (int k = 0; k <= p_; k++) {
+      sum += T[l * (p_ + 1) + k] * multipole[k];
+    }
+    local[l] += sum;
+  }
+}
+
+void M2LOperatorCache::buildMatrix(Complex shift, double scale,
+                                   Complex *matrix) const {
+  // Lemma 2.2.2, one column per multipole coefficient, with s = shift / scale
+  // for source and target expansions of the same scale:
+  //   T(0, 0) = log(-shift)
+  //   T(0, k) = (-1)^k s^-k
+  //   T(l, 0) = -s^-l / l
+  //   T(l, k) = (-1)^k binom(l + k - 1, k - 1) s^-(l + k)
+  // Binomials come from the shared tables, in floating point so that large p
+  // does not overflow.
+  int n = p_ + 1;
+  Complex unit_shift = shift / scale;
+  std::vector<Complex> inv_powers(2 * p_ + 1);
+  inv_powers[0] = 1.0;
+  for (int i = 1; i <= 2 * p_; i++) {
+    inv_powers[i] = inv_powers[i - 1] / unit_shift;
+  }
+
+  const TranslationTables &tables = TranslationTables::get(p_);
+
+  matrix[0] = std::log(-shift);
+  for (int k = 1; k <= p_; k++) {
+    matrix[k] = tables.sign(k) * inv_powers[k];
+  }
+  for (int l = 1; l <= p_; l++) {
+    matrix[l * n] = -inv_powers[l] * tables.inverse(l);
+    for (int k = 1; k <= p_; k++) {
+      matrix[l * n + k] = tables.sign(k) * tables.binomial(l + k - 1, k - 1) *
+                          inv_powers[l + k];
+    }
+  }
+}
+
+void M2LOperatorCache::buildM2MMatrix(Complex shift, double in_scale,
+                                      double out_scale,
+                                      Complex *matrix) const {
+  // Lemma 2.2.1, lower triangular, with s = shift / out_scale and
+  // r = in_scale / out_scale:
+  //   T(0, 0) = 1
+  //   T(l, 0) = -s^l / l
+  //   T(l, k) = binom(l - 1, k - 1) s^(l - k) r^k, 1 <= k <= l
+  int n = p_ + 1;
+  std::vector<Complex> powers(n);
+  std::vector<double> ratio_powers(n);
+  powers[0] = 1.0;
+  ratio_powers[0] = 1.0;
+  for (int i = 1; i <= p_; i++) {
+    powers[i] = powers[i - 1] * (shift / out_scale);
+    ratio_powers[i] = ratio_powers[i - 1] * (in_scale / out_scale);
+  }
+  const TranslationTables &tables = TranslationTables::get(p_);
+
+  std::fill(matrix, matrix + n * n, Complex(0.0));
+  matrix[0] = 1.0;
+  for (int l = 1; l <= p_; l++) {
+    matrix[l * n] = -powers[l] / static_cast<double>(l);
+    for (int k = 1; k <= l; k++) {
+      matrix[l * n + k] =
+          tables.binomial(l - 1, k - 1) * ratio_powers[k] * powers[l - k];
+    }
+  }
+}
+
+void M2LOperatorCache::buildL2LMatrix(Complex shift, double in_scale,
+                                      double out_scale,
+                                      Complex *matrix) const {
+  // Lemma 2.2.3 expanded, upper triangular, with s = shift / out_scale and
+  // r = out_scale / in_scale:
+  //   T(l, k) = binom(k, l) (-s)^(k - l) r^k, k >= l
+  int n = p_ + 1;
+  std::vector<Complex> powers(n);
+  std::vector<double> ratio_powers(n);
+  powers[0] = 1.0;
+  ratio_powers[0] = 1.0;
+  for (int i = 1; i <= p_; i++) {
+    powers[i] = -powers[i - 1] * (shift / out_scale);
+    ratio_powers[i] = ratio_powers[i - 1] * (out_scale / in_scale);
+  }
+  const TranslationTables &tables = TranslationTables::get(p_);
+
+  std::fill(matrix, matrix + n * n, Complex(0.0));
+  for (int l = 0; l <= p_; l++) {
+    for (int k = l; k <= p_; k++) {
+      matrix[l * n + k] =
+          tables.binomial(k, l) * ratio_powers[k] * powers[k - l];
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Dense M2L translation matrices for a uniform tree. M2L depends only on the
+// offset between the source and target box centers, which at a given level is
+// one of 40 integer multiples (dx, dy) of the box side, |dx|, |dy| <= 3 and
+// max(|dx|, |dy|) >= 2. Each translation is stored once per (level, offset) as
+// a row-major (p+1)x(p+1) matrix, so M2L becomes a matrix-vector product.
+// The cache also holds the M2M and L2L matrices, which depend only on the
+// child's level and quadrant, for translating blocks of expansions as GEMMs.
+// A scaled cache translates expansions scaled by their box's half side (see
+// MultipoleExpansion::scale).
+class M2LOperatorCache {
+public:
+  static constexpr int num_offsets = 40;
+
+  M2LOperatorCache(int p, double root_half_side, int height,
+                   bool scaled = false);
+
+  int p() const { return p_; }
+  double root_half_side() const { return root_half_side_; }
+  int height() const { return height_; }
+  bool scaled() const { return scaled_; }
+
+  // whether the cache can serve a tree with the given order and geometry
+  bool compatible(int p, double root_half_side, int height,
+                  bool scaled = false) const {
+    return p == p_ && root_half_side == root_half_side_ &&
+           height <= height_ && scaled == scaled_;
+  }
+
+  // slot of offset (dx, dy) among the num_offsets interaction list offsets,
+  // -1 for near neighbors and offsets outside the interaction list
+  static int offsetIndex(int dx, int dy);
+
+  const Complex *matrix(int level, int offset_index) const;
+
+  // parent multipole += M2M * child multipole, and child local += L2L *
+  // parent local, for a child at level >= 3 in quadrant (see getQuadrant) of
+  // its parent
+  const Complex *m2mMatrix(int level, int quadrant) const;
+  const Complex *l2lMatrix(int level, int quadrant) const;
+
+  // local += T * multipole, where the multipole is centered at offset (dx, dy)
+  // box sides from the local expansion
+  void apply(int level, int dx, int dy, const Complex *multipole,
+             Complex *local) const;
+
+private:
+  int p_;
+  double root_half_side_;
+  int height_;
+  bool scaled_;
+  std::vector<Complex> matrices_;     // [level - 2][offset][l][k]
+  std::vector<Complex> m2m_matrices_; // [level - 3][quadrant][l][k]
+  std::vector<Complex> l2l_matrices_; // [level - 3][quadrant][l][k]
+
+  // the operators between expansions scaled by in_scale and out_scale, 1 for
+  // an unscaled cache
+  void buildMatrix(Complex shift, double scale, Complex *matrix) const;
+  void buildM2MMatrix(Complex shift, double in_scale, double out_scale,
+                      Complex *matrix) const;
+  void buildL2LMatrix(Complex shift, double in_scale, double out_scale,
+                      Complex *matrix) const;
+};
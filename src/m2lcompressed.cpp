@@ -0,0 +1,133 @@
+#include "m2lcompressed.h"
+#include "eigen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+CompressedM2LOperators::CompressedM2LOperators(const M2LOperatorCache &cache,
+                                               double tolerance)
+    : p_(cache.p()), root_half_side_(cache.root_half_side()),
+      height_(cache.height()), scaled_(cache.scaled()),
+      tolerance_(tolerance) {
+  constexpr int num_offsets = M2LOperatorCache::num_offsets;
+  int n = p_ + 1;
+
+  for (int level = 2; level <= height_; level++) {
+    // T'(l, k) = s^l T(l, k) s^k is the operator between expansions scaled
+    // by s, the half side; a scaled cache stores it already
+    double s = scaled_ ? 1.0 : root_half_side_ / std::pow(2.0, level);
+    std::vector<double> powers(n, 1.0);
+    for (int k = 1; k < n; k++) {
+      powers[k] = powers[k - 1] * s;
+    }
+    std::vector<Complex> operators(num_offsets * n * n);
+    for (int i = 0; i < num_offsets; i++) {
+      const Complex *T = cache.matrix(level, i);
+      for (int l = 0; l < n; l++) {
+        for (int k = 0; k < n; k++) {
+          operators[(i * n + l) * n + k] =
+              powers[l] * T[l * n + k] * powers[k];
+        }
+      }
+    }
+
+    // right singular vectors of the operators stacked, and of their
+    // adjoints stacked, which are the left singular vectors of the operators
+    // side by side
+    std::vector<Complex> stacked(operators), adjoints(num_offsets * n * n);
+    for (int i = 0; i < num_offsets; i++) {
+      for (int l = 0; l < n; l++) {
+        for (int k = 0; k < n; k++) {
+          adjoints[(i * n + k) * n + l] =
+              std::conj(operators[(i * n + l) * n + k]);
+        }
+      }
+    }
+    std::vector<double> left_values(n), right_values(n);
+    std::vector<Complex> U(n * n), V(n * n);
+    singularValueDecomposition(num_offsets * n, n, adjoints.data(),
+                               left_values.data(), U.data());
+    singularValueDecomposition(num_offsets * n, n, stacked.data(),
+                               right_values.data(), V.data());
+
+    auto keep = [&](const std::vector<double> &values) {
+      if (tolerance <= 0.0) {
+        return n;
+      }
+      double cutoff = tolerance * values[0];
+      return static_cast<int>(std::count_if(
+          values.begin(), values.end(), [&](double v) { return v > cutoff; }));
+    };
+    int r = std::max({1, keep(left_values), keep(right_values)});
+    ranks_.push_back(r);
+
+    std::vector<Complex> compress(n * r), expand(r * n);
+    for (int k = 0; k < n; k++) {
+      for (int a = 0; a < r; a++) {
+        compress[k * r + a] = std::conj(V[k * n + a]) / powers[k];
+        expand[a * n + k] = U[k * n + a] / powers[k];
+      }
+    }
+
+    // C_i = U^H T'_i V
+    std::vector<Complex> cores(num_offsets * r * r);
+    std::vector<Complex> TV(n * r);
+    for (int i = 0; i < num_offsets; i++) {
+      const Complex *T = &operators[i * n * n];
+      for (int l = 0; l < n; l++) {
+        for (int b = 0; b < r; b++) {
+          Complex sum = 0.0;
+          for (int k = 0; k < n; k++) {
+            sum += T[l * n + k] * V[k * n + b];
+          }
+          TV[l * r + b] = sum;
+        }
+      }
+      for (int a = 0; a < r; a++) {
+        for (int b = 0; b < r; b++) {
+          Complex sum = 0.0;
+          for (int l = 0; l < n; l++) {
+            sum += std::conj(U[l * n + a]) * TV[l * r + b];
+          }
+          cores[(i * r + a) * r + b] = sum;
+        }
+      }
+    }
+
+    compress_.push_back(std::move(compress));
+    expand_.push_back(std::move(expand));
+    cores_.push_back(std::move(cores));
+  }
+}
+
+void CompressedM2LOperators::checkLevel(int level) const {
+  if (level < 2 || level > height_) {
+    throw std::out_of_range("No compressed M2L operators for this level");
+  }
+}
+
+int CompressedM2LOperators::rank(int level) const {
+  checkLevel(level);
+  return ranks_[level - 2];
+}
+
+const Complex *CompressedM2LOperators::compressMatrix(int level) const {
+  checkLevel(level);
+  return compress_[level - 2].data();
+}
+
+const Complex *CompressedM2LOperators::expandMatrix(int level) const {
+  checkLevel(level);
+  return expand_[level - 2].data();
+}
+
+const Complex *CompressedM2LOperators::core(int level,
+                                            int offset_index) const {
+  checkLevel(level);
+  if (offset_index < 0 || offset_index >= M2LOperatorCache::num_offsets) {
+    throw std::out_of_range("No compressed M2L operator for this offset");
+  }
+  int r = ranks_[level - 2];
+  return &cores_[level - 2][offset_index * r * r];
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "m2lcache.h"
+
+#include <complex>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Low-rank M2L operators for a uniform tree (M2LMode::Compressed). At each
+// level the 40 operators T_i of an M2LOperatorCache share a left basis U and
+// a right basis V: the leading left and right singular vectors of the
+// operators side by side and stacked. They come from one-sided Jacobi SVDs,
+// accurate down to rounding in the operators, where the eigenvalues of
+// sum_i T_i T_i^H would be lost below about 1e-8 of the largest singular
+// value. Singular values below tolerance times the largest are dropped, and
+// each operator is kept as its rank x rank core
+// C_i = U^H T_i V. A translation is then local += U C_i V^H multipole, where
+// the V^H and U products are done once per node and each interaction-list
+// pair costs rank^2 instead of (p+1)^2.
+//
+// The bases are computed from the operators between scaled expansions (see
+// MultipoleExpansion::scale), so that truncation weighs every coefficient
+// alike; for an unscaled cache the scaling is folded into the projections.
+class CompressedM2LOperators {
+public:
+  CompressedM2LOperators(const M2LOperatorCache &cache, double tolerance);
+
+  int p() const { return p_; }
+  int height() const { return height_; }
+  double tolerance() const { return tolerance_; }
+
+  // whether the operators were compressed from a cache like this one
+  bool compatible(const M2LOperatorCache &cache, double tolerance) const {
+    return cache.p() == p_ && cache.root_half_side() == root_half_side_ &&
+           cache.height() <= height_ && cache.scaled() == scaled_ &&
+           tolerance == tolerance_;
+  }
+
+  int rank(int level) const;
+
+  // transposed projections, so that rows of coefficients multiply from the
+  // left: compressed row += multipole row * compressMatrix, (p+1) x rank, and
+  // local row += compressed row * expandMatrix, rank x (p+1)
+  const Complex *compressMatrix(int level) const;
+  const Complex *expandMatrix(int level) const;
+  // row-major rank x rank core of the operator for offset_index (see
+  // M2LOperatorCache::offsetIndex)
+  const Complex *core(int level, int offset_index) const;
+
+private:
+  int p_;
+  double root_half_side_;
+  int height_;
+  bool scaled_;
+  double tolerance_;
+  std::vector<int> ranks_;                     // [level - 2]
+  std::vector<std::vector<Complex>> compress_; // [level - 2][k][a]
+  std::vector<std::vector<Complex>> expand_;   // [level - 2][a][l]
+  std::vector<std::vector<Complex>> cores_;    // [level - 2][i][a][b]
+
+  void checkLevel(int level) const;
+};
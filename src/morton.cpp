@@ -0,0 +1,34 @@
+#include "morton.h"
+
+#include <array>
+#include <numeric>
+
+std::vector<std::size_t> radixSortByKey(std::vector<uint64_t> &keys,
+                                        int key_bits) {
+  std::size_t n = keys.size();
+  std::vector<std::size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+
+  std::vector<uint64_t> keys_tmp(n);
+  std::vector<std::size_t> order_tmp(n);
+
+  for (int shift = 0; shift < key_bits; shift += 8) {
+    std::array<std::size_t, 257> offsets{};
+    for (uint64_t key : keys) {
+      offsets[((key >> shift) & 0xFF) + 1]++;
+    }
+    for (int digit = 0; digit < 256; digit++) {
+      offsets[digit + 1] += offsets[digit];
+    }
+
+    for (std::size_t i = 0; i < n; i++) {
+      std::size_t dest = offsets[(keys[i] >> shift) & 0xFF]++;
+      keys_tmp[dest] = keys[i];
+      order_tmp[dest] = order[i];
+    }
+    keys.swap(keys_tmp);
+    order.swap(order_tmp);
+  }
+
+  return order;
+}
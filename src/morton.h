@@ -0,0 +1,81 @@
+#pragma once
+
+#include "point.h"
+#include "point3.h"
+#include "vector.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Spreads the low 32 bits of v to the even bit positions of the result
+inline uint64_t spreadBits(uint32_t v) {
+  uint64_t x = v;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+  x = (x | (x << 2)) & 0x3333333333333333ull;
+  x = (x | (x << 1)) & 0x5555555555555555ull;
+  return x;
+}
+
+// Morton (Z-order) key of the cell containing position among the 4^level
+// cells of box. Bit 2i holds bit i of the x cell index and bit 2i+1 bit i of
+// the y cell index, so the key is the quadrant path given by getQuadrant and
+// equals the leaf's position in a uniform tree level. Positions outside the
+// box are clamped to the nearest cell.
+inline uint64_t mortonKey(const Box2 &box, int level, Vector2 position) {
+  uint32_t cells = 1u << level;
+  double scale = cells / (2.0 * box.half_side);
+
+  auto cell = [&](double coord, double low) -> uint32_t {
+    double c = std::floor((coord - low) * scale);
+    if (!(c >= 0.0)) {
+      return 0;
+    }
+    return c >= cells ? cells - 1 : static_cast<uint32_t>(c);
+  };
+
+  uint32_t ix = cell(position.x, box.center.x - box.half_side);
+  uint32_t iy = cell(position.y, box.center.y - box.half_side);
+  return spreadBits(ix) | (spreadBits(iy) << 1);
+}
+
+// Spreads the low 21 bits of v to every third bit position of the result
+inline uint64_t spreadBits3(uint32_t v) {
+  uint64_t x = v & 0x1FFFFF;
+  x = (x | (x << 32)) & 0x1F00000000FFFFull;
+  x = (x | (x << 16)) & 0x1F0000FF0000FFull;
+  x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+  x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+  x = (x | (x << 2)) & 0x1249249249249249ull;
+  return x;
+}
+
+// Morton key of the cell containing position among the 8^level cells of box,
+// with the x, y and z cell index bits interleaved in that order, so the key
+// is the octant path given by getOctant. level is at most 21.
+inline uint64_t mortonKey(const Box3 &box, int level, Vector3 position) {
+  uint32_t cells = 1u << level;
+  double scale = cells / (2.0 * box.half_side);
+
+  auto cell = [&](double coord, double low) -> uint32_t {
+    double c = std::floor((coord - low) * scale);
+    if (!(c >= 0.0)) {
+      return 0;
+    }
+    return c >= cells ? cells - 1 : static_cast<uint32_t>(c);
+  };
+
+  uint32_t ix = cell(position.x, box.center.x - box.half_side);
+  uint32_t iy = cell(position.y, box.center.y - box.half_side);
+  uint32_t iz = cell(position.z, box.center.z - box.half_side);
+  return spreadBits3(ix) | (spreadBits3(iy) << 1) | (spreadBits3(iz) << 2);
+}
+
+// Stable LSD radix sort of keys on their low key_bits bits, 8 bits per pass.
+// Sorts keys in place and returns the permutation from sorted position to
+// original index.
+std::vector<std::size_t> radixSortByKey(std::vector<uint64_t> &keys,
+                                        int key_bits);
@@ -1,8 +1,75 @@
 #include "multipole.h"
+#include "fixedorder.h"
+#include "tables.h"
 
-MultipoleExpansion &
-MultipoleExpansion::operator+=(const MultipoleExpansion &other) {
-  if (p != other.p || center != other.center) {
+#include <stdexcept>
+
+template <class T>
+BasicMultipoleExpansion<T>::BasicMultipoleExpansion(
+    const BasicMultipoleExpansion &other)
+    : p(other.p), center(other.center), scale(other.scale),
+      storage_(other.coeffs.begin(), other.coeffs.end()) {
+  coeffs = storage_;
+}
+
+template <class T>
+BasicMultipoleExpansion<T>::BasicMultipoleExpansion(
+    BasicMultipoleExpansion &&other) noexcept
+    : p(other.p), center(other.center), scale(other.scale),
+      storage_(std::move(other.storage_)) {
+  coeffs = storage_.empty() ? other.coeffs : std::span<Coefficient>(storage_);
+  if (!storage_.empty()) {
+    other.coeffs = {};
+  }
+}
+
+template <class T>
+BasicMultipoleExpansion<T> &
+BasicMultipoleExpansion<T>::operator=(const BasicMultipoleExpansion &other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (isView()) {
+    // a view stays on its buffer, which belongs to a tree's flat storage
+    if (coeffs.size() != other.coeffs.size()) {
+      throw std::invalid_argument(
+          "Cannot assign an expansion of another order to a view");
+    }
+    std::copy(other.coeffs.begin(), other.coeffs.end(), coeffs.begin());
+  } else {
+    storage_.assign(other.coeffs.begin(), other.coeffs.end());
+    coeffs = storage_;
+  }
+  p = other.p;
+  center = other.center;
+  scale = other.scale;
+  return *this;
+}
+
+template <class T>
+BasicMultipoleExpansion<T> &BasicMultipoleExpansion<T>::operator=(
+    BasicMultipoleExpansion &&other) {
+  if (this == &other) {
+    return *this;
+  }
+  // only owned coefficients move; to or from a view the values are copied,
+  // so that assignment never leaves two expansions on one buffer
+  if (isView() || other.isView()) {
+    return *this = static_cast<const BasicMultipoleExpansion &>(other);
+  }
+  storage_ = std::move(other.storage_);
+  coeffs = storage_;
+  other.coeffs = {};
+  p = other.p;
+  center = other.center;
+  scale = other.scale;
+  return *this;
+}
+
+template <class T>
+BasicMultipoleExpansion<T> &
+BasicMultipoleExpansion<T>::operator+=(const BasicMultipoleExpansion &other) {
+  if (p != other.p || center != other.center || scale != other.scale) {
     throw std::runtime_error("Cannot add incompatible multipole expansions");
   }
 
@@ -12,52 +79,270 @@ MultipoleExpansion::operator+=(const MultipoleExpansion &other) {
   return *this;
 }
 
-double MultipoleExpansion::evaluate(Vector2 point) const {
+template <class T>
+double BasicMultipoleExpansion<T>::evaluate(Vector2 point) const {
   Complex z(point.x, point.y);
   z -= center;
 
-  Complex result = coeffs[0].real() * std::log(z);
+  Complex result = double(coeffs[0].real()) * std::log(z);
 
-  Complex z_inv_power = 1.0 / z;
+  // the series in w = z / scale
+  Complex w = z / scale;
+  Complex w_inv_power = 1.0 / w;
   for (int k = 1; k <= p; k++) {
-    result += coeffs[k] * z_inv_power;
-    z_inv_power /= z;
+    result += Complex(coeffs[k]) * w_inv_power;
+    w_inv_power /= w;
   }
 
   return result.real();
 }
 
-void MultipoleExpansion::buildExpansion(const std::vector<Point> &sources) {
-  // Theorem 2.1.1
+template <class T>
+PotentialGradient
+BasicMultipoleExpansion<T>::evaluateWithGradient(Vector2 point) const {
+  Complex z(point.x, point.y);
+  z -= center;
+
+  // the series in w = z / scale, differentiated in w
+  Complex w_inv = scale / z;
+  double a0 = coeffs[0].real();
+  Complex value = a0 * std::log(z);
+  Complex series_derivative = 0.0;
+
+  Complex w_inv_power = w_inv;
+  for (int k = 1; k <= p; k++) {
+    Complex a = coeffs[k];
+    value += a * w_inv_power;
+    w_inv_power *= w_inv;
+    series_derivative -= static_cast<double>(k) * a * w_inv_power;
+  }
+  Complex derivative = a0 / z + series_derivative / scale;
+
+  return {value.real(), Vector2(derivative.real(), -derivative.imag())};
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::buildExpansion(
+    const std::vector<Point> &sources) {
+  if (fixed_order::dispatch(p, [&](auto order) {
+        fixed_order::p2m<order>(
+            center, sources.size(),
+            [&](std::size_t i) -> const Point & { return sources[i]; },
+            coeffs.data(), scale);
+      })) {
+    return;
+  }
+
+  // Theorem 2.1.1, in z / scale
+  std::vector<Complex> sums(p + 1, 0.0);
   for (const Point &source : sources) {
     Complex z(source.position.x, source.position.y);
-    z -= center;
-    coeffs[0] += source.strength;
+    z = (z - center) / scale;
+    sums[0] += source.strength;
+
+    Complex z_power = z;
+    for (int k = 1; k <= p; k++) {
+      sums[k] -= source.strength * z_power / static_cast<double>(k);
+      z_power *= z;
+    }
+  }
+  for (int k = 0; k <= p; k++) {
+    coeffs[k] += Coefficient(sums[k]);
+  }
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::buildExpansion(const double *x,
+                                                const double *y,
+                                                const double *strength,
+                                                std::size_t n) {
+  if (fixed_order::dispatch(p, [&](auto order) {
+        fixed_order::p2m<order>(
+            center, n,
+            [&](std::size_t i) {
+              return Point(Vector2(x[i], y[i]), strength[i]);
+            },
+            coeffs.data(), scale);
+      })) {
+    return;
+  }
+  buildExpansionDynamic(x, y, strength, n);
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::buildExpansionDynamic(const double *x,
+                                                       const double *y,
+                                                       const double *strength,
+                                                       std::size_t n) {
+  // Theorem 2.1.1, in z / scale, over structure-of-arrays sources
+  std::vector<Complex> sums(p + 1, 0.0);
+  for (std::size_t i = 0; i < n; i++) {
+    Complex z(x[i], y[i]);
+    z = (z - center) / scale;
+    sums[0] += strength[i];
 
     Complex z_power = z;
     for (int k = 1; k <= p; k++) {
-      coeffs[k] -= source.strength * z_power / static_cast<double>(k);
+      sums[k] -= strength[i] * z_power / static_cast<double>(k);
       z_power *= z;
     }
   }
+  for (int k = 0; k <= p; k++) {
+    coeffs[k] += Coefficient(sums[k]);
+  }
 }
 
-MultipoleExpansion MultipoleExpansion::M2M(const Complex &shift) {
+template <class T>
+BasicMultipoleExpansion<T>
+BasicMultipoleExpansion<T>::M2M(const Complex &shift) const {
+  if (scale != 1.0) {
+    throw std::runtime_error("M2M requires an unscaled multipole expansion");
+  }
+
   // Lemma 2.2.1
+  const TranslationTables &tables = TranslationTables::get(p);
   Complex new_center = center - shift;
-  std::vector<Complex> new_coeffs(p + 1);
+  std::vector<Coefficient> new_coeffs(p + 1);
+  std::vector<Complex> shift_powers(p + 1);
+  shiftPowers(shift, p, shift_powers.data());
 
-  new_coeffs[0] = coeffs[0].real();
+  double a0 = coeffs[0].real();
+  new_coeffs[0] = a0;
   for (int l = 1; l <= p; l++) {
-    new_coeffs[l] =
-        -coeffs[0].real() * exp_table.exp(shift, l) / static_cast<double>(l);
+    Complex sum = -a0 * shift_powers[l] * tables.inverse(l);
     for (int k = 1; k <= l; k++) {
-      new_coeffs[l] +=
-          coeffs[k] * exp_table.exp(shift, l - k) *
-          static_cast<double>(binomial_table.binomial(l - 1, k - 1));
+      sum += Complex(coeffs[k]) * shift_powers[l - k] *
+             tables.binomial(l - 1, k - 1);
+    }
+    new_coeffs[l] = Coefficient(sum);
+  }
+
+  return BasicMultipoleExpansion(Vector2(new_center.real(), new_center.imag()),
+                                 new_coeffs);
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::M2MInto(const Complex &shift,
+                                         std::span<Coefficient> out,
+                                         double out_scale) const {
+  if (!fixed_order::dispatch(p, [&](auto order) {
+        fixed_order::m2m<order>(coeffs.data(), shift, out.data(), scale,
+                                out_scale);
+      })) {
+    M2MIntoDynamic(shift, out, out_scale);
+  }
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::M2MIntoDynamic(const Complex &shift,
+                                                std::span<Coefficient> out,
+                                                double out_scale) const {
+  // Lemma 2.2.1 in units of out_scale, where the shift is shift / out_scale
+  // and coefficient k is coeffs[k] * ratio^k; shift powers and binomials are
+  // built by recurrence
+  Complex unit_shift = shift / out_scale;
+  double ratio = scale / out_scale;
+  Complex step = unit_shift / ratio;
+  double a0 = coeffs[0].real();
+  out[0] += Coefficient(a0);
+
+  Complex shift_power = 1.0;
+  double ratio_power = 1.0;
+  for (int l = 1; l <= p; l++) {
+    shift_power *= unit_shift;
+    ratio_power *= ratio;
+
+    // ratio^l sum_k coeffs[k] (shift / ratio)^(l - k) binomial(l - 1, k - 1),
+    // k = l..1
+    Complex sum = 0.0;
+    Complex power = 1.0;
+    double binomial = 1.0;
+    for (int k = l; k >= 1; k--) {
+      sum += Complex(coeffs[k]) * power * binomial;
+      power *= step;
+      binomial = binomial * (k - 1) / static_cast<double>(l - k + 1);
     }
+    out[l] += Coefficient(sum * ratio_power -
+                          a0 * shift_power / static_cast<double>(l));
   }
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::M2LInto(const Complex &shift,
+                                         std::span<std::complex<float>> out,
+                                         double out_scale) const {
+  m2lInto(shift, out, out_scale);
+}
 
-  return MultipoleExpansion(Vector2(new_center.real(), new_center.imag()),
-                            new_coeffs);
+template <class T>
+void BasicMultipoleExpansion<T>::M2LInto(const Complex &shift,
+                                         std::span<std::complex<double>> out,
+                                         double out_scale) const {
+  m2lInto(shift, out, out_scale);
 }
+
+template <class T>
+void BasicMultipoleExpansion<T>::M2LIntoDynamic(
+    const Complex &shift, std::span<std::complex<float>> out,
+    double out_scale) const {
+  m2lIntoDynamic(shift, out, out_scale);
+}
+
+template <class T>
+void BasicMultipoleExpansion<T>::M2LIntoDynamic(
+    const Complex &shift, std::span<std::complex<double>> out,
+    double out_scale) const {
+  m2lIntoDynamic(shift, out, out_scale);
+}
+
+template <class T>
+template <class U>
+void BasicMultipoleExpansion<T>::m2lInto(const Complex &shift,
+                                         std::span<std::complex<U>> out,
+                                         double out_scale) const {
+  if (!fixed_order::dispatch(p, [&](auto order) {
+        fixed_order::m2l<order>(coeffs.data(), shift, out.data(), scale,
+                                out_scale);
+      })) {
+    m2lIntoDynamic(shift, out, out_scale);
+  }
+}
+
+template <class T>
+template <class U>
+void BasicMultipoleExpansion<T>::m2lIntoDynamic(
+    const Complex &shift, std::span<std::complex<U>> out,
+    double out_scale) const {
+  // Lemma 2.2.2 in units of out_scale, as for M2MIntoDynamic, with inverse
+  // shift powers and binomials built by recurrence
+  Complex inv_shift = out_scale / shift;
+  Complex step = -(scale / out_scale) * inv_shift;
+  Complex a0 = coeffs[0];
+
+  Complex sum = a0 * std::log(-shift);
+  Complex power = 1.0; // (-ratio/shift)^k
+  for (int k = 1; k <= p; k++) {
+    power *= step;
+    sum += Complex(coeffs[k]) * power;
+  }
+  out[0] += std::complex<U>(sum);
+
+  Complex inv_shift_power = 1.0;
+  for (int l = 1; l <= p; l++) {
+    inv_shift_power *= inv_shift;
+    sum = -a0 / static_cast<double>(l);
+
+    // sum_k (-1)^k coeffs[k] shift^-k binomial(l + k - 1, k - 1), k = 1..p
+    power = 1.0;
+    double binomial = 1.0;
+    for (int k = 1; k <= p; k++) {
+      power *= step;
+      sum += Complex(coeffs[k]) * power * binomial;
+      binomial = binomial * (l + k) / static_cast<double>(k);
+    }
+    out[l] += std::complex<U>(sum * inv_shift_power);
+  }
+}
+
+template struct BasicMultipoleExpansion<float>;
+template struct BasicMultipoleExpansion<double>;
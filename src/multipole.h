@@ -1,36 +1,113 @@
 #pragma once
 
 #include "point.h"
-#include "tables.h"
 #include "vector.h"
 
+#include <algorithm>
 #include <complex>
+#include <span>
 #include <vector>
 
 using Complex = std::complex<double>;
 
-struct MultipoleExpansion {
+// Multipole expansion with coefficients of real type T, float or double.
+// Centers, radii and the potentials returned stay in double; the fixed-order
+// kernels compute in T, the runtime-order loops in double.
+template <class T> struct BasicMultipoleExpansion {
+  using Coefficient = std::complex<T>;
+
   int p;
   Complex center;
-  std::vector<Complex> coeffs;
+  // radius the coefficients are scaled by: coefficient k holds a_k / scale^k,
+  // which stays O(1) for sources within scale of the center at any order
+  double scale = 1.0;
+  // p + 1 coefficients, in owned storage or in a caller-provided buffer
+  std::span<Coefficient> coeffs;
 
-  BinomialTable binomial_table;
-  ExponentialTable exp_table;
+  BasicMultipoleExpansion(int p, Vector2 center)
+      : p(p), center(center.x, center.y), storage_(p + 1) {
+    coeffs = storage_;
+  }
 
-  MultipoleExpansion(int p, Vector2 center)
-      : p(p), center(center.x, center.y), coeffs(p + 1) {}
+  BasicMultipoleExpansion(Vector2 center,
+                          const std::vector<Coefficient> &coeffs)
+      : p(coeffs.size() - 1), center(center.x, center.y), storage_(coeffs) {
+    this->coeffs = storage_;
+  }
 
-  MultipoleExpansion(Vector2 center, const std::vector<Complex> &coeffs) {
-    this->coeffs = coeffs;
-    this->p = coeffs.size() - 1;
-    this->center = Complex(center.x, center.y);
+  // view of the p + 1 coefficients at buffer, which is zeroed unless zero is
+  // false (the values are kept, as for a mapped tree) and must outlive the
+  // expansion
+  BasicMultipoleExpansion(int p, Vector2 center, Coefficient *buffer,
+                          bool zero = true)
+      : p(p), center(center.x, center.y), coeffs(buffer, p + 1) {
+    if (zero) {
+      clear();
+    }
   }
 
-  MultipoleExpansion &operator+=(const MultipoleExpansion &other);
-  void clear() { coeffs.assign(p + 1, 0.0); }
+  // copies own their coefficients; assigning to a view writes the values into
+  // its buffer, and throws std::invalid_argument for another order
+  BasicMultipoleExpansion(const BasicMultipoleExpansion &other);
+  BasicMultipoleExpansion(BasicMultipoleExpansion &&other) noexcept;
+  BasicMultipoleExpansion &operator=(const BasicMultipoleExpansion &other);
+  BasicMultipoleExpansion &operator=(BasicMultipoleExpansion &&other);
+
+  BasicMultipoleExpansion &operator+=(const BasicMultipoleExpansion &other);
+  void clear() { std::fill(coeffs.begin(), coeffs.end(), Coefficient(0)); }
 
   double evaluate(Vector2 point) const;
+  // potential and gradient (Re f', -Im f') of the expansion f at point
+  PotentialGradient evaluateWithGradient(Vector2 point) const;
 
   void buildExpansion(const std::vector<Point> &sources);
-  MultipoleExpansion M2M(const Complex &shift);
+  void buildExpansion(const double *x, const double *y, const double *strength,
+                      std::size_t n);
+  // unscaled expansions only; reads the shared TranslationTables of order p
+  BasicMultipoleExpansion M2M(const Complex &shift) const;
+
+  // Allocation-free translations that accumulate into a caller-provided span
+  // of p + 1 coefficients, scaled by out_scale. shift is this expansion's
+  // center minus the target center, as for M2M. Orders 4..32 run the
+  // fixed-order kernels of fixedorder.h, other orders the runtime-order loops
+  // below. M2L accepts local coefficients of either precision.
+  void M2MInto(const Complex &shift, std::span<Coefficient> out,
+               double out_scale = 1.0) const;
+  void M2LInto(const Complex &shift, std::span<std::complex<float>> out,
+               double out_scale = 1.0) const;
+  void M2LInto(const Complex &shift, std::span<std::complex<double>> out,
+               double out_scale = 1.0) const;
+
+  // runtime-order versions of buildExpansion and the translations, for any p
+  void buildExpansionDynamic(const double *x, const double *y,
+                             const double *strength, std::size_t n);
+  void M2MIntoDynamic(const Complex &shift, std::span<Coefficient> out,
+                      double out_scale = 1.0) const;
+  void M2LIntoDynamic(const Complex &shift,
+                      std::span<std::complex<float>> out,
+                      double out_scale = 1.0) const;
+  void M2LIntoDynamic(const Complex &shift,
+                      std::span<std::complex<double>> out,
+                      double out_scale = 1.0) const;
+
+private:
+  std::vector<Coefficient> storage_; // empty for views
+
+  // views have coefficients but no storage; moved-from expansions have
+  // neither
+  bool isView() const { return storage_.empty() && !coeffs.empty(); }
+
+  template <class U>
+  void m2lInto(const Complex &shift, std::span<std::complex<U>> out,
+               double out_scale) const;
+  template <class U>
+  void m2lIntoDynamic(const Complex &shift, std::span<std::complex<U>> out,
+                      double out_scale) const;
 };
+
+// double-precision expansions, used throughout unless a Kernel picks another
+// precision
+using MultipoleExpansion = BasicMultipoleExpansion<double>;
+
+extern template struct BasicMultipoleExpansion<float>;
+extern template struct BasicMultipoleExpansion<double>;
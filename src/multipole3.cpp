@@ -0,0 +1,132 @@
+#include "multipole3.h"
+
+#include <cmath>
+
+MultipoleExpansion3::MultipoleExpansion3(const MultipoleExpansion3 &other)
+    : p(other.p), center(other.center),
+      storage_(other.coeffs.begin(), other.coeffs.end()) {
+  coeffs = storage_;
+}
+
+MultipoleExpansion3 &
+MultipoleExpansion3::operator=(const MultipoleExpansion3 &other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (storage_.empty() && coeffs.size() == other.coeffs.size()) {
+    std::copy(other.coeffs.begin(), other.coeffs.end(), coeffs.begin());
+  } else {
+    storage_.assign(other.coeffs.begin(), other.coeffs.end());
+    coeffs = storage_;
+  }
+  p = other.p;
+  center = other.center;
+  return *this;
+}
+
+// the terms of m and -m are conjugates, so the sum is the m = 0 terms plus
+// twice the real part of the m > 0 terms
+double MultipoleExpansion3::evaluate(Vector3 point) const {
+  thread_local std::vector<Complex> harmonics;
+  harmonics.resize(numHarmonics(p));
+  irregularHarmonics(p, point - center, harmonics.data());
+
+  double result = 0.0;
+  for (int n = 0; n <= p; n++) {
+    const Complex *c = &coeffs[harmonicIndex(n, 0)];
+    const Complex *y = &harmonics[harmonicIndex(n, 0)];
+    result += (c[0] * y[0]).real();
+    for (int m = 1; m <= n; m++) {
+      result += 2.0 * (c[m] * y[m]).real();
+    }
+  }
+  return result;
+}
+
+void MultipoleExpansion3::buildExpansion(const std::vector<Point3> &sources) {
+  for (const Point3 &source : sources) {
+    buildExpansion(&source.position.x, &source.position.y,
+                   &source.position.z, &source.strength, 1);
+  }
+}
+
+void MultipoleExpansion3::buildExpansion(const double *x, const double *y,
+                                         const double *z,
+                                         const double *strength,
+                                         std::size_t n) {
+  thread_local std::vector<Complex> harmonics;
+  harmonics.resize(numHarmonics(p));
+  for (std::size_t i = 0; i < n; i++) {
+    regularHarmonics(p, Vector3(x[i], y[i], z[i]) - center, harmonics.data());
+    for (std::size_t k = 0; k < harmonics.size(); k++) {
+      coeffs[k] += strength[i] * std::conj(harmonics[k]);
+    }
+  }
+}
+
+// Along z, with the child at distance d above the parent,
+//   M'_n^m = sum_(k=0..n-m) d^k norm(n, m) / (k! norm(n - k, m)) M_(n-k)^m
+void MultipoleExpansion3::M2MInto(const HarmonicRotation &rotation,
+                                  double distance,
+                                  std::span<Coefficient> out) const {
+  const HarmonicTables &tables = HarmonicTables::get(p);
+  rotatedTranslation(
+      rotation, coeffs.data(), out, [&](const Complex *in, Complex *result) {
+        thread_local std::vector<double> powers;
+        powers.resize(p + 1);
+        powers[0] = 1.0;
+        for (int k = 1; k <= p; k++) {
+          powers[k] = powers[k - 1] * distance / k;
+        }
+        for (int n = 0; n <= p; n++) {
+          for (int m = 0; m <= n; m++) {
+            Complex sum = 0.0;
+            for (int k = 0; k <= n - m; k++) {
+              sum += powers[k] / tables.norm(n - k, m) *
+                     in[harmonicIndex(n - k, m)];
+            }
+            result[harmonicIndex(n, m)] = sum * tables.norm(n, m);
+          }
+        }
+      });
+}
+
+// Along z, with the multipole at distance d above the local center,
+//   L_k^m = sum_(n=m..p) (-1)^(n+m) (n + k)! /
+//           (norm(k, m) norm(n, m) d^(n+k+1)) M_n^m
+void MultipoleExpansion3::M2LInto(const HarmonicRotation &rotation,
+                                  double distance,
+                                  std::span<Coefficient> out) const {
+  const HarmonicTables &tables = HarmonicTables::get(p);
+  rotatedTranslation(
+      rotation, coeffs.data(), out, [&](const Complex *in, Complex *result) {
+        thread_local std::vector<double> inverse_powers;
+        inverse_powers.resize(2 * p + 2);
+        inverse_powers[0] = 1.0;
+        for (int k = 1; k <= 2 * p + 1; k++) {
+          inverse_powers[k] = inverse_powers[k - 1] / distance;
+        }
+        for (int m = 0; m <= p; m++) {
+          for (int k = m; k <= p; k++) {
+            Complex sum = 0.0;
+            for (int n = m; n <= p; n++) {
+              double sign = ((n + m) % 2 == 0) ? 1.0 : -1.0;
+              sum += sign * tables.factorial(n + k) *
+                     inverse_powers[n + k + 1] / tables.norm(n, m) *
+                     in[harmonicIndex(n, m)];
+            }
+            result[harmonicIndex(k, m)] = sum / tables.norm(k, m);
+          }
+        }
+      });
+}
+
+void MultipoleExpansion3::M2MInto(Vector3 shift,
+                                  std::span<Coefficient> out) const {
+  M2MInto(HarmonicRotation(p, shift), shift.norm(), out);
+}
+
+void MultipoleExpansion3::M2LInto(Vector3 shift,
+                                  std::span<Coefficient> out) const {
+  M2LInto(HarmonicRotation(p, shift), shift.norm(), out);
+}
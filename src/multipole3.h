@@ -0,0 +1,68 @@
+#pragma once
+
+#include "harmonics.h"
+#include "point3.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <complex>
+#include <span>
+#include <vector>
+
+using Complex = std::complex<double>;
+
+// Multipole expansion of the 3D Laplace kernel 1 / r about center,
+//   phi(x) = sum_(n, |m| <= n) M_n^m Y_n^m(x - center) / |x - center|^(n+1),
+// M_n^m = sum q |y|^n conj(Y_n^m(y)) over the sources at center + y, in the
+// conventions of harmonics.h: numHarmonics(p) coefficients with m >= 0.
+struct MultipoleExpansion3 {
+  using Coefficient = Complex;
+
+  int p;
+  Vector3 center;
+  // numHarmonics(p) coefficients, in owned storage or a caller's buffer
+  std::span<Coefficient> coeffs;
+
+  MultipoleExpansion3(int p, Vector3 center)
+      : p(p), center(center), storage_(numHarmonics(p)) {
+    coeffs = storage_;
+  }
+
+  // view of the numHarmonics(p) coefficients at buffer, zeroed unless zero is
+  // false; the buffer must outlive the expansion
+  MultipoleExpansion3(int p, Vector3 center, Coefficient *buffer,
+                      bool zero = true)
+      : p(p), center(center), coeffs(buffer, numHarmonics(p)) {
+    if (zero) {
+      clear();
+    }
+  }
+
+  // copies own their coefficients; assigning to a view writes the values into
+  // its buffer
+  MultipoleExpansion3(const MultipoleExpansion3 &other);
+  MultipoleExpansion3 &operator=(const MultipoleExpansion3 &other);
+
+  void clear() { std::fill(coeffs.begin(), coeffs.end(), Coefficient(0)); }
+
+  double evaluate(Vector3 point) const;
+
+  void buildExpansion(const std::vector<Point3> &sources);
+  void buildExpansion(const double *x, const double *y, const double *z,
+                      const double *strength, std::size_t n);
+
+  // Translations that accumulate into a caller-provided span of
+  // numHarmonics(p) coefficients. shift is this expansion's center minus the
+  // target center and rotation takes its direction onto +z; along z both
+  // translations keep the order m, so with the two rotations each costs
+  // O(p^3). The overloads without a rotation build one, in O(p^4).
+  void M2MInto(const HarmonicRotation &rotation, double distance,
+               std::span<Coefficient> out) const;
+  void M2LInto(const HarmonicRotation &rotation, double distance,
+               std::span<Coefficient> out) const;
+  void M2MInto(Vector3 shift, std::span<Coefficient> out) const;
+  void M2LInto(Vector3 shift, std::span<Coefficient> out) const;
+
+private:
+  std::vector<Coefficient> storage_; // empty for views
+};
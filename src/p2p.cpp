@@ -0,0 +1,207 @@
+#include "p2p.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vector width chosen at compile time from the target instruction set
+#if defined(__AVX512F__)
+#define FMM_P2P_WIDTH 8
+#elif defined(__AVX__)
+#define FMM_P2P_WIDTH 4
+#else
+#define FMM_P2P_WIDTH 2
+#endif
+
+namespace {
+
+constexpr int width = FMM_P2P_WIDTH;
+
+typedef double vdouble __attribute__((vector_size(FMM_P2P_WIDTH * 8)));
+typedef int64_t vint __attribute__((vector_size(FMM_P2P_WIDTH * 8)));
+
+inline vdouble load(const double *p) {
+  vdouble v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline vdouble broadcast(double x) {
+  vdouble v;
+  for (int i = 0; i < width; i++) {
+    v[i] = x;
+  }
+  return v;
+}
+
+inline double horizontalSum(vdouble v) {
+  double sum = 0.0;
+  for (int i = 0; i < width; i++) {
+    sum += v[i];
+  }
+  return sum;
+}
+
+// Natural log of positive, normal x (fdlibm's __ieee754_log without the
+// special cases): x = 2^k (1 + f) with sqrt(2)/2 <= 1 + f < sqrt(2) and
+// log(1 + f) = 2 atanh(s), s = f / (2 + f), from a degree-14 polynomial
+// in s. Error below 1 ulp.
+inline vdouble log(vdouble x) {
+  constexpr double ln2_hi = 6.93147180369123816490e-01;
+  constexpr double ln2_lo = 1.90821492927058770002e-10;
+  constexpr double Lg1 = 6.666666666666735130e-01;
+  constexpr double Lg2 = 3.999999999940941908e-01;
+  constexpr double Lg3 = 2.857142874366239149e-01;
+  constexpr double Lg4 = 2.222219843214978396e-01;
+  constexpr double Lg5 = 1.818357216161805012e-01;
+  constexpr double Lg6 = 1.531383769920937332e-01;
+  constexpr double Lg7 = 1.479819860511658591e-01;
+
+  vint bits = std::bit_cast<vint>(x);
+  vint k = (bits >> 52) - 1023;
+  vint mantissa = (bits & 0x000FFFFFFFFFFFFFll) | 0x3FF0000000000000ll;
+  vdouble m = std::bit_cast<vdouble>(mantissa);
+
+  vint big = m > 1.4142135623730951;
+  m = big ? m * 0.5 : m;
+  k -= big; // big is -1 where set
+
+  vdouble f = m - 1.0;
+  vdouble dk = __builtin_convertvector(k, vdouble);
+  vdouble s = f / (2.0 + f);
+  vdouble z = s * s;
+  vdouble w = z * z;
+  vdouble t1 = w * (Lg2 + w * (Lg4 + w * Lg6));
+  vdouble t2 = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)));
+  vdouble R = t2 + t1;
+  vdouble hfsq = 0.5 * f * f;
+  return dk * ln2_hi - ((hfsq - (s * (hfsq + R) + dk * ln2_lo)) - f);
+}
+
+} // namespace
+
+int logP2PWidth() { return width; }
+
+void logP2P(const double *sx, const double *sy, const double *strength,
+            std::size_t ns, const double *tx, const double *ty, double *out,
+            std::size_t nt) {
+  std::size_t vector_end = ns - ns % width;
+
+  for (std::size_t i = 0; i < nt; i++) {
+    vdouble x = broadcast(tx[i]);
+    vdouble y = broadcast(ty[i]);
+    vdouble sum = broadcast(0.0);
+
+    for (std::size_t j = 0; j < vector_end; j += width) {
+      vdouble dx = load(sx + j) - x;
+      vdouble dy = load(sy + j) - y;
+      vdouble r2 = dx * dx + dy * dy;
+      vint coincident = r2 == 0.0;
+      r2 = coincident ? 1.0 : r2;
+      vdouble q = load(strength + j);
+      q = coincident ? 0.0 : q;
+      sum += q * log(r2);
+    }
+
+    // log|d| = log(|d|^2) / 2
+    double result = 0.5 * horizontalSum(sum);
+    for (std::size_t j = vector_end; j < ns; j++) {
+      double dx = sx[j] - tx[i];
+      double dy = sy[j] - ty[i];
+      double r2 = dx * dx + dy * dy;
+      if (r2 != 0.0) {
+        result += 0.5 * strength[j] * std::log(r2);
+      }
+    }
+    out[i] += result;
+  }
+}
+
+void logP2PMulti(const double *sx, const double *sy, const double *strength,
+                 std::size_t ns, std::size_t num_rhs, const double *tx,
+                 const double *ty, double *out, std::size_t nt) {
+  std::size_t vector_end = ns - ns % width;
+  thread_local std::vector<vdouble> sums;
+  sums.resize(num_rhs);
+
+  for (std::size_t i = 0; i < nt; i++) {
+    vdouble x = broadcast(tx[i]);
+    vdouble y = broadcast(ty[i]);
+    std::fill(sums.begin(), sums.end(), broadcast(0.0));
+
+    for (std::size_t j = 0; j < vector_end; j += width) {
+      vdouble dx = load(sx + j) - x;
+      vdouble dy = load(sy + j) - y;
+      vdouble r2 = dx * dx + dy * dy;
+      vint coincident = r2 == 0.0;
+      r2 = coincident ? 1.0 : r2;
+      vdouble l = log(r2);
+      l = coincident ? 0.0 : l;
+      for (std::size_t r = 0; r < num_rhs; r++) {
+        sums[r] += load(strength + r * ns + j) * l;
+      }
+    }
+
+    for (std::size_t r = 0; r < num_rhs; r++) {
+      double result = 0.5 * horizontalSum(sums[r]);
+      for (std::size_t j = vector_end; j < ns; j++) {
+        double dx = sx[j] - tx[i];
+        double dy = sy[j] - ty[i];
+        double r2 = dx * dx + dy * dy;
+        if (r2 != 0.0) {
+          result += 0.5 * strength[r * ns + j] * std::log(r2);
+        }
+      }
+      out[r * nt + i] += result;
+    }
+  }
+}
+
+void logP2PGradient(const double *sx, const double *sy, const double *strength,
+                    std::size_t ns, const double *tx, const double *ty,
+                    double *potential, double *gx, double *gy,
+                    std::size_t nt) {
+  std::size_t vector_end = ns - ns % width;
+
+  for (std::size_t i = 0; i < nt; i++) {
+    vdouble x = broadcast(tx[i]);
+    vdouble y = broadcast(ty[i]);
+    vdouble sum = broadcast(0.0);
+    vdouble sum_x = broadcast(0.0);
+    vdouble sum_y = broadcast(0.0);
+
+    for (std::size_t j = 0; j < vector_end; j += width) {
+      vdouble dx = load(sx + j) - x;
+      vdouble dy = load(sy + j) - y;
+      vdouble r2 = dx * dx + dy * dy;
+      vint coincident = r2 == 0.0;
+      r2 = coincident ? 1.0 : r2;
+      vdouble q = load(strength + j);
+      q = coincident ? 0.0 : q;
+      sum += q * log(r2);
+      vdouble scale = q / r2;
+      sum_x -= scale * dx;
+      sum_y -= scale * dy;
+    }
+
+    double result = 0.5 * horizontalSum(sum);
+    double result_x = horizontalSum(sum_x);
+    double result_y = horizontalSum(sum_y);
+    for (std::size_t j = vector_end; j < ns; j++) {
+      double dx = sx[j] - tx[i];
+      double dy = sy[j] - ty[i];
+      double r2 = dx * dx + dy * dy;
+      if (r2 != 0.0) {
+        result += 0.5 * strength[j] * std::log(r2);
+        result_x -= strength[j] * dx / r2;
+        result_y -= strength[j] * dy / r2;
+      }
+    }
+    potential[i] += result;
+    gx[i] += result_x;
+    gy[i] += result_y;
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+
+// Near-field block for the 2D log kernel:
+//   out[i] += sum_j strength[j] * log|target_i - source_j|
+// over nt targets and ns sources, skipping coincident pairs. Vectorized over
+// the sources with the widest vector unit the compiler targets (AVX-512,
+// AVX2, otherwise 128-bit), with a branch-free log accurate to 1 ulp.
+// Tolerance against the scalar Kernel::potential loop, summation order
+// included: |logP2P - scalar| <= 1e-14 * sum_j |strength_j log r_ij| per
+// target (about 1.5e-15 observed, checked by test/p2p).
+void logP2P(const double *sx, const double *sy, const double *strength,
+            std::size_t ns, const double *tx, const double *ty, double *out,
+            std::size_t nt);
+
+// logP2P together with the gradient with respect to the target:
+//   gx[i], gy[i] += sum_j strength[j] * (target_i - source_j) / r_ij^2
+// with the same coincident-pair rule and potential tolerance as logP2P.
+void logP2PGradient(const double *sx, const double *sy, const double *strength,
+                    std::size_t ns, const double *tx, const double *ty,
+                    double *potential, double *gx, double *gy, std::size_t nt);
+
+// logP2P for num_rhs strength vectors over the same sources and targets:
+//   out[r * nt + i] += sum_j strength[r * ns + j] * log|target_i - source_j|
+// Each log is computed once and shared by the right-hand sides, with the
+// same coincident-pair rule and tolerance as logP2P.
+void logP2PMulti(const double *sx, const double *sy, const double *strength,
+                 std::size_t ns, std::size_t num_rhs, const double *tx,
+                 const double *ty, double *out, std::size_t nt);
+
+// Number of doubles per vector used by logP2P
+int logP2PWidth();
+
+// Optional kernel hook for the near field over blocks of structure-of-arrays
+// sources and targets: out[i] += sum_j potential(source j, target i), with
+// coincident pairs contributing zero. Kernels without it use the scalar
+// Kernel::potential loop.
+template <class Kernel>
+concept HasP2PBatch = requires(const double *in, double *out, std::size_t n) {
+  Kernel::p2p_batch(in, in, in, n, in, in, out, n);
+};
+
+// Optional multi-RHS counterpart of p2p_batch: num_rhs strength blocks of ns
+// and output blocks of nt, each pair's kernel evaluated once for all of them.
+// Kernels without it call p2p_batch once per right-hand side.
+template <class Kernel>
+concept HasP2PMultiBatch =
+    requires(const double *in, double *out, std::size_t n) {
+      Kernel::p2p_multi_batch(in, in, in, n, n, in, in, out, n);
+    };
+
+// Optional gradient counterpart of p2p_batch: also gx[i], gy[i] += the
+// gradient of the potential with respect to target i. Kernels without it use
+// the scalar Kernel::potential and Kernel::gradient loop.
+template <class Kernel>
+concept HasP2PGradientBatch =
+    requires(const double *in, double *out, std::size_t n) {
+      Kernel::p2p_gradient_batch(in, in, in, n, in, in, out, out, out, n);
+    };
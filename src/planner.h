@@ -0,0 +1,351 @@
+#pragma once
+
+#include "fmmtree.h"
+#include "m2lcache.h"
+#include "m2lcompressed.h"
+#include "p2p.h"
+#include "point.h"
+#include "threadpool.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <random>
+#include <tuple>
+#include <vector>
+
+// Host costs behind a plan, in seconds
+struct FmmCostModel {
+  double p2p = 0.0; // one source-target interaction
+  double m2l = 0.0; // one translation at the plan's order
+};
+
+// Chooses p from a calibrated error model and the tree depth from a cost
+// model timed on the host. The interaction-list boxes of a uniform quadtree
+// are at least one box side apart, so a far-field term converges at worst
+// like (sqrt(2) / (4 - sqrt(2)))^p, about 0.55^p, but only the nearest
+// corners of the nearest boxes come close to that. Measured on uniform and
+// clustered sources up to p = 24, the error relative to the largest
+// potential stays below 0.1 * 0.45^p, hence
+//   p = ceil(log(tolerance / 0.1) / log(0.45)).
+// The height then minimizes
+//   cost(h) = p2p * (pairs in the near field at height h)
+//           + m2l * (translations at height h),
+// with the near-field pairs counted on the actual sources.
+template <class Kernel> class FmmPlanner {
+public:
+  static int orderFor(double tolerance) {
+    double p = std::log(tolerance / error_scale) / std::log(error_ratio);
+    return std::max(1, static_cast<int>(std::ceil(p)));
+  }
+
+  // micro-kernel timings for order p, with M2L done the way a NaiveFmmTree
+  // with these options does it; measured once per process, kernel and M2L
+  // configuration
+  static FmmCostModel measure(int p, const FmmOptions &options = {});
+
+  // plan with this host's measured costs, for trees built with options
+  static FmmPlan plan(const std::vector<Point> &sources, double tolerance,
+                      const FmmOptions &options = {}) {
+    return plan(sources, tolerance, measure(orderFor(tolerance), options));
+  }
+
+  // plan with given costs, deterministic for the same sources
+  static FmmPlan plan(const std::vector<Point> &sources, double tolerance,
+                      const FmmCostModel &costs);
+
+  // near-field pairs of a uniform tree of this height over sources, each
+  // leaf's sources against its 3x3 neighborhood
+  static double nearPairs(const std::vector<Point> &sources, int height) {
+    return nearPairs(leafCounts(sources, height), 1 << height);
+  }
+
+private:
+  static constexpr int max_height = 10;
+  // M2L, M2M and L2L translations per box of an interior level
+  static constexpr double translations_per_box = 27.0 + 2.0;
+  // fitted error model, error < error_scale * error_ratio^p
+  static constexpr double error_scale = 0.1;
+  static constexpr double error_ratio = 0.45;
+
+  static double measureM2L(int p, const FmmOptions &options);
+  // source counts of the n x n boxes at height over the bounding box
+  static std::vector<double> leafCounts(const std::vector<Point> &sources,
+                                        int height);
+  static double nearPairs(const std::vector<double> &counts, int n);
+};
+
+template <class Kernel>
+FmmCostModel FmmPlanner<Kernel>::measure(int p, const FmmOptions &options) {
+  static std::mutex mutex;
+  static std::map<std::tuple<int, M2LMode, double, bool>, FmmCostModel>
+      measured;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto key = std::make_tuple(p, options.m2l, options.m2l_tolerance,
+                             options.scaled);
+  auto it = measured.find(key);
+  if (it != measured.end()) {
+    return it->second;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  constexpr double min_seconds = 0.02;
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  // P2P: one block of targets against one block of sources
+  constexpr int block = 256;
+  std::vector<double> xs(block), ys(block), strengths(block), out(block);
+  std::vector<Point> sources;
+  for (int j = 0; j < block; j++) {
+    xs[j] = dist(gen);
+    ys[j] = dist(gen);
+    strengths[j] = dist(gen);
+    sources.push_back(Point(Vector2(xs[j], ys[j]), strengths[j]));
+  }
+
+  FmmCostModel costs;
+  long interactions = 0;
+  auto start = Clock::now();
+  double elapsed = 0.0;
+  while (elapsed < min_seconds) {
+    if constexpr (HasP2PBatch<Kernel>) {
+      Kernel::p2p_batch(xs.data(), ys.data(), strengths.data(), block,
+                        xs.data(), ys.data(), out.data(), block);
+    } else {
+      for (int i = 0; i < block; i++) {
+        for (const Point &source : sources) {
+          out[i] += Kernel::potential(source, Vector2(xs[i], ys[i]));
+        }
+      }
+    }
+    interactions += block * block;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  costs.p2p = elapsed / interactions;
+
+  costs.m2l = measureM2L(p, options);
+
+  measured[key] = costs;
+  return costs;
+}
+
+// M2L over one level of 16 x 16 boxes, with the operators, batches and
+// compressed bases set up beforehand as a tree's construction does
+template <class Kernel>
+double FmmPlanner<Kernel>::measureM2L(int p, const FmmOptions &options) {
+  using Node = FmmNode2<Kernel>;
+  using Clock = std::chrono::steady_clock;
+  constexpr double min_seconds = 0.02;
+  constexpr int level = 4;
+  constexpr int side = 1 << level;
+  constexpr double half_side = 1.0 / side;
+
+  std::vector<Node> storage;
+  storage.reserve(side * side);
+  std::vector<Node *> nodes;
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  for (int iy = 0; iy < side; iy++) {
+    for (int ix = 0; ix < side; ix++) {
+      Vector2 center((2 * ix + 1 - side) * half_side,
+                     (2 * iy + 1 - side) * half_side);
+      Node &node =
+          storage.emplace_back(p, Box2(center, half_side), NodeType::Leaf);
+      node.index = nodes.size();
+      if (options.scaled) {
+        node.multipole.scale = half_side;
+        node.local.scale = half_side;
+      }
+      for (auto &c : node.multipole.coeffs) {
+        c = typename Node::MultipoleCoefficient(dist(gen), dist(gen));
+      }
+      nodes.push_back(&node);
+    }
+  }
+  // children of the parent's neighbors that are not adjacent
+  long translations = 0;
+  for (Node *node : nodes) {
+    int ix = node->index % side;
+    int iy = node->index / side;
+    for (Node *other : nodes) {
+      int jx = other->index % side;
+      int jy = other->index / side;
+      if (std::abs(jx / 2 - ix / 2) <= 1 && std::abs(jy / 2 - iy / 2) <= 1 &&
+          std::max(std::abs(jx - ix), std::abs(jy - iy)) >= 2) {
+        node->interaction_list.push_back(other);
+        translations++;
+      }
+    }
+  }
+
+  M2LMode mode = Node::double_coefficients ? options.m2l : M2LMode::Direct;
+  std::shared_ptr<const M2LOperatorCache> cache;
+  std::shared_ptr<const CompressedM2LOperators> compressed;
+  std::vector<M2LBatch<Node>> batches;
+  if (mode != M2LMode::Direct) {
+    cache = std::make_shared<const M2LOperatorCache>(p, 1.0, level,
+                                                     options.scaled);
+    batches = groupInteractions(nodes);
+  }
+  if (mode == M2LMode::Compressed) {
+    compressed = std::make_shared<const CompressedM2LOperators>(
+        *cache, options.m2l_tolerance);
+  }
+  ThreadPool pool(1);
+
+  auto pass = [&] {
+    if constexpr (Node::double_coefficients) {
+      if (mode == M2LMode::Cached) {
+        for (Node *node : nodes) {
+          for (Node *other : node->interaction_list) {
+            Vector2 offset =
+                (other->box.center - node->box.center) / (2.0 * half_side);
+            cache->apply(level, std::lround(offset.x), std::lround(offset.y),
+                         other->multipole.coeffs.data(),
+                         node->local.coeffs.data());
+          }
+        }
+        return;
+      }
+      if (mode == M2LMode::Batched) {
+        batchedM2L(*cache, level, batches, pool);
+        return;
+      }
+      if (mode == M2LMode::Compressed) {
+        compressedM2L(*compressed, level, nodes, batches, pool);
+        return;
+      }
+    }
+    for (Node *node : nodes) {
+      for (Node *other : node->interaction_list) {
+        Vector2 shift = other->box.center - node->box.center;
+        other->multipole.M2LInto(Complex(shift.x, shift.y), node->local.coeffs,
+                                 node->local.scale);
+      }
+    }
+  };
+
+  long done = 0;
+  auto start = Clock::now();
+  double elapsed = 0.0;
+  while (elapsed < min_seconds) {
+    pass();
+    done += translations;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return elapsed / done;
+}
+
+template <class Kernel>
+FmmPlan FmmPlanner<Kernel>::plan(const std::vector<Point> &sources,
+                                 double tolerance,
+                                 const FmmCostModel &costs) {
+  FmmPlan plan;
+  plan.tolerance = tolerance;
+  plan.p = orderFor(tolerance);
+
+  // adaptive leaves: balance 9 s^2 near-field pairs per leaf against the
+  // translations of about 4/3 boxes per leaf; leaves hold between a quarter
+  // and all of their capacity, about half on average
+  double leaf_size = std::sqrt(translations_per_box * 4.0 / 3.0 * costs.m2l /
+                               (9.0 * costs.p2p));
+  plan.leaf_capacity = std::max<std::size_t>(1, std::lround(2.0 * leaf_size));
+
+  std::size_t num_sources = sources.size();
+  if (num_sources == 0) {
+    return plan;
+  }
+
+  // candidates from height 1 (NaiveFmmTree needs a root with children) to
+  // about one source per leaf
+  int deepest = 1;
+  while (deepest < max_height &&
+         std::pow(4.0, deepest + 1) <= 4.0 * num_sources) {
+    deepest++;
+  }
+
+  // source counts per box at the deepest height, coarsened level by level
+  std::vector<double> counts = leafCounts(sources, deepest);
+
+  double best_cost = 0.0;
+  for (int height = deepest; height >= 1; height--) {
+    int n = 1 << height;
+    double pairs = nearPairs(counts, n);
+
+    double translations = 0.0;
+    for (int level = 2; level <= height; level++) {
+      translations += translations_per_box * std::pow(4.0, level);
+    }
+
+    double cost = costs.p2p * pairs + costs.m2l * translations;
+    if (height == deepest || cost < best_cost) {
+      best_cost = cost;
+      plan.height = height;
+    }
+
+    // coarsen to height - 1
+    if (height > 1) {
+      int m = n / 2;
+      std::vector<double> coarse(m * m, 0.0);
+      for (int iy = 0; iy < n; iy++) {
+        for (int ix = 0; ix < n; ix++) {
+          coarse[(iy / 2) * m + ix / 2] += counts[iy * n + ix];
+        }
+      }
+      counts.swap(coarse);
+    }
+  }
+
+  return plan;
+}
+
+template <class Kernel>
+std::vector<double>
+FmmPlanner<Kernel>::leafCounts(const std::vector<Point> &sources, int height) {
+  int side = 1 << height;
+  std::vector<double> counts(std::size_t(side) * side, 0.0);
+  if (sources.empty()) {
+    return counts;
+  }
+  Box2 box = computeBoundingBox(sources);
+  double scale = side / (2.0 * box.half_side);
+  auto cell = [&](double coord, double low) {
+    int c = static_cast<int>(std::floor((coord - low) * scale));
+    return std::clamp(c, 0, side - 1);
+  };
+  for (const Point &source : sources) {
+    int ix = cell(source.position.x, box.center.x - box.half_side);
+    int iy = cell(source.position.y, box.center.y - box.half_side);
+    counts[std::size_t(iy) * side + ix] += 1.0;
+  }
+  return counts;
+}
+
+template <class Kernel>
+double FmmPlanner<Kernel>::nearPairs(const std::vector<double> &counts,
+                                     int n) {
+  double pairs = 0.0;
+  for (int iy = 0; iy < n; iy++) {
+    for (int ix = 0; ix < n; ix++) {
+      double count = counts[std::size_t(iy) * n + ix];
+      if (count == 0.0) {
+        continue;
+      }
+      double near = 0.0;
+      int x_end = std::min(n - 1, ix + 1);
+      int y_end = std::min(n - 1, iy + 1);
+      for (int jy = std::max(0, iy - 1); jy <= y_end; jy++) {
+        for (int jx = std::max(0, ix - 1); jx <= x_end; jx++) {
+          near += counts[std::size_t(jy) * n + jx];
+        }
+      }
+      pairs += count * near;
+    }
+  }
+  return pairs;
+}
@@ -3,7 +3,10 @@
 #include "vector.h"
 
 #include <cmath>
+#include <cstdint>
+#include <iterator>
 #include <limits>
+#include <stdexcept>
 #include <vector>
 
 struct Point {
@@ -14,6 +17,12 @@ struct Point {
       : position(position), strength(strength) {}
 };
 
+// Potential at a target together with its gradient (the negative field)
+struct PotentialGradient {
+  double potential = 0.0;
+  Vector2 gradient = Vector2::zeros();
+};
+
 struct Box2 {
   Vector2 center;
   double half_side;
@@ -27,8 +36,12 @@ struct Box2 {
   }
 };
 
-inline Box2 computeBoundingBox(const std::vector<Point> &points) {
-  if (points.empty()) {
+inline Vector2 positionOf(const Point &point) { return point.position; }
+inline Vector2 positionOf(Vector2 position) { return position; }
+
+// Padded bounding square of a range of points or positions
+template <class Range> Box2 computeBoundingBox(const Range &points) {
+  if (std::empty(points)) {
     return Box2{Vector2{0.0, 0.0}, 0.0};
   }
 
@@ -37,11 +50,12 @@ inline Box2 computeBoundingBox(const std::vector<Point> &points) {
   double min_y = std::numeric_limits<double>::max();
   double max_y = std::numeric_limits<double>::lowest();
 
-  for (const Point &p : points) {
-    min_x = std::min(min_x, p.position.x);
-    max_x = std::max(max_x, p.position.x);
-    min_y = std::min(min_y, p.position.y);
-    max_y = std::max(max_y, p.position.y);
+  for (const auto &p : points) {
+    Vector2 position = positionOf(p);
+    min_x = std::min(min_x, position.x);
+    max_x = std::max(max_x, position.x);
+    min_y = std::min(min_y, position.y);
+    max_y = std::max(max_y, position.y);
   }
 
   double center_x = 0.5 * (min_x + max_x);
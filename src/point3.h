@@ -0,0 +1,104 @@
+#pragma once
+
+#include "vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// 3D counterparts of point.h, for FmmTree3
+
+struct Point3 {
+  Vector3 position;
+  double strength;
+
+  Point3(Vector3 position, double strength)
+      : position(position), strength(strength) {}
+};
+
+struct Box3 {
+  Vector3 center;
+  double half_side;
+
+  Box3(Vector3 center, double half_side)
+      : center(center), half_side(half_side) {}
+
+  bool contains(const Point3 &p) const {
+    return std::abs(p.position.x - center.x) <= half_side &&
+           std::abs(p.position.y - center.y) <= half_side &&
+           std::abs(p.position.z - center.z) <= half_side;
+  }
+};
+
+inline Vector3 positionOf(const Point3 &point) { return point.position; }
+inline Vector3 positionOf(Vector3 position) { return position; }
+
+// Padded bounding cube of a range of points or positions
+template <class Range> Box3 computeBoundingBox3(const Range &points) {
+  if (std::empty(points)) {
+    return Box3{Vector3{0.0, 0.0, 0.0}, 0.0};
+  }
+
+  Vector3 low(std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::max());
+  Vector3 high(std::numeric_limits<double>::lowest(),
+               std::numeric_limits<double>::lowest(),
+               std::numeric_limits<double>::lowest());
+
+  for (const auto &p : points) {
+    Vector3 position = positionOf(p);
+    low = Vector3(std::min(low.x, position.x), std::min(low.y, position.y),
+                  std::min(low.z, position.z));
+    high = Vector3(std::max(high.x, position.x), std::max(high.y, position.y),
+                   std::max(high.z, position.z));
+  }
+
+  Vector3 extent = high - low;
+  double half_side = 0.5 * std::max({extent.x, extent.y, extent.z});
+
+  constexpr double padding = 1e-5;
+  half_side *= (1.0 + padding);
+
+  return Box3{(low + high) * 0.5, half_side};
+}
+
+inline bool adjacent(const Box3 &box1, const Box3 &box2) {
+  Vector3 delta = box1.center - box2.center;
+  double side_sum = box1.half_side + box2.half_side;
+
+  const double tolerance = std::min(box1.half_side, box2.half_side) * 1e-5;
+  return std::abs(delta.x) <= side_sum + tolerance &&
+         std::abs(delta.y) <= side_sum + tolerance &&
+         std::abs(delta.z) <= side_sum + tolerance;
+}
+
+// Octant of position within box: bit 0 set for x at or above the center,
+// bit 1 for y and bit 2 for z, as getQuadrant for the first two
+inline uint32_t getOctant(const Box3 &box, Vector3 position) {
+  uint32_t octant = 0;
+  if (position.x >= box.center.x) {
+    octant |= 1;
+  }
+  if (position.y >= box.center.y) {
+    octant |= 2;
+  }
+  if (position.z >= box.center.z) {
+    octant |= 4;
+  }
+  return octant;
+}
+
+inline Box3 getChildBox(const Box3 &parent, uint32_t octant) {
+  if (octant > 7) {
+    throw std::runtime_error("Invalid octant");
+  }
+  double h = 0.5 * parent.half_side;
+  Vector3 offset((octant & 1) ? h : -h, (octant & 2) ? h : -h,
+                 (octant & 4) ? h : -h);
+  return Box3{parent.center + offset, h};
+}
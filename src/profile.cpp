@@ -0,0 +1,193 @@
+#include "profile.h"
+
+#include <chrono>
+#include <iomanip>
+
+const char *profilePhaseName(ProfilePhase phase) {
+  switch (phase) {
+  case ProfilePhase::TreeBuild:
+    return "TreeBuild";
+  case ProfilePhase::Lists:
+    return "Lists";
+  case ProfilePhase::Binning:
+    return "Binning";
+  case ProfilePhase::P2M:
+    return "P2M";
+  case ProfilePhase::M2M:
+    return "M2M";
+  case ProfilePhase::M2L:
+    return "M2L";
+  case ProfilePhase::L2L:
+    return "L2L";
+  case ProfilePhase::L2P:
+    return "L2P";
+  case ProfilePhase::P2P:
+    return "P2P";
+  }
+  return "?";
+}
+
+// Recording locks only the thread's own mutex, which is contended only while
+// totals() or events() reads the buffer
+struct Profiler::ThreadBuffer {
+  int thread;
+  std::mutex mutex;
+  std::map<std::pair<ProfilePhase, int>, ProfileCounters> totals;
+  std::vector<ProfileEvent> events;
+};
+
+namespace {
+
+double steadySeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+Profiler::Profiler() : epoch_(steadySeconds()) {}
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+double Profiler::now() const { return steadySeconds() - epoch_; }
+
+Profiler::ThreadBuffer &Profiler::buffer() {
+  // the registry keeps the buffer alive after its thread exits
+  thread_local std::shared_ptr<ThreadBuffer> local;
+  if (!local) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    local = std::make_shared<ThreadBuffer>();
+    local->thread = buffers_.size();
+    buffers_.push_back(local);
+  }
+  return *local;
+}
+
+void Profiler::addTime(ProfilePhase phase, int level, double start,
+                       double end, int thread) {
+  ThreadBuffer &local = buffer();
+  std::lock_guard<std::mutex> lock(local.mutex);
+  local.totals[{phase, level}].seconds += end - start;
+  local.events.push_back(
+      {phase, level, thread < 0 ? local.thread : thread, start, end});
+}
+
+void Profiler::addWork(ProfilePhase phase, int level, std::uint64_t calls,
+                       double flops, std::uint64_t interactions) {
+  ThreadBuffer &local = buffer();
+  std::lock_guard<std::mutex> lock(local.mutex);
+  ProfileCounters &counters = local.totals[{phase, level}];
+  counters.calls += calls;
+  counters.flops += flops;
+  counters.interactions += interactions;
+}
+
+void Profiler::addTaskProfile(const TaskGraphProfile &profile) {
+  // the run's clock started wall_time before it returned
+  double start = now() - profile.wall_time;
+  for (const TaskRecord &record : profile.records) {
+    ProfilePhase phase = ProfilePhase::P2P;
+    switch (record.kind) {
+    case TaskKind::P2M:
+      phase = ProfilePhase::P2M;
+      break;
+    case TaskKind::M2M:
+      phase = ProfilePhase::M2M;
+      break;
+    case TaskKind::M2L:
+      phase = ProfilePhase::M2L;
+      break;
+    case TaskKind::L2L:
+      phase = ProfilePhase::L2L;
+      break;
+    case TaskKind::L2P:
+      phase = ProfilePhase::L2P;
+      break;
+    case TaskKind::P2P:
+      phase = ProfilePhase::P2P;
+      break;
+    }
+    addTime(phase, record.level, start + record.start, start + record.end,
+            record.worker);
+  }
+}
+
+void Profiler::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::shared_ptr<ThreadBuffer> &local : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(local->mutex);
+    local->totals.clear();
+    local->events.clear();
+  }
+  epoch_ = steadySeconds();
+}
+
+std::map<std::pair<ProfilePhase, int>, ProfileCounters>
+Profiler::totals() const {
+  std::map<std::pair<ProfilePhase, int>, ProfileCounters> merged;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::shared_ptr<ThreadBuffer> &local : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(local->mutex);
+    for (const auto &[key, counters] : local->totals) {
+      ProfileCounters &total = merged[key];
+      total.seconds += counters.seconds;
+      total.calls += counters.calls;
+      total.flops += counters.flops;
+      total.interactions += counters.interactions;
+    }
+  }
+  return merged;
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+  std::vector<ProfileEvent> merged;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::shared_ptr<ThreadBuffer> &local : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(local->mutex);
+    merged.insert(merged.end(), local->events.begin(), local->events.end());
+  }
+  return merged;
+}
+
+void Profiler::writeJson(std::ostream &out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::setprecision(9) << "{\"phases\": [";
+  bool first = true;
+  for (const auto &[key, counters] : totals()) {
+    out << (first ? "\n" : ",\n") << "  {\"phase\": \""
+        << profilePhaseName(key.first) << "\", \"level\": " << key.second
+        << ", \"seconds\": " << counters.seconds
+        << ", \"calls\": " << counters.calls
+        << ", \"flops\": " << counters.flops
+        << ", \"interactions\": " << counters.interactions << "}";
+    first = false;
+  }
+  out << "\n]}\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void Profiler::writeChromeTrace(std::ostream &out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  // timestamps and durations in microseconds
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+  bool first = true;
+  for (const ProfileEvent &event : events()) {
+    out << (first ? "\n" : ",\n") << "  {\"name\": \""
+        << profilePhaseName(event.phase)
+        << "\", \"cat\": \"fmm\", \"ph\": \"X\", \"pid\": 0, \"tid\": "
+        << event.thread << ", \"ts\": " << event.start * 1e6
+        << ", \"dur\": " << (event.end - event.start) * 1e6
+        << ", \"args\": {\"level\": " << event.level << "}}";
+    first = false;
+  }
+  out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "taskgraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Phase-level instrumentation of the FMM passes. NaiveFmmTree records its
+// construction, update and evaluateSources through the FMM_PROFILE_* macros
+// below, which compile to nothing unless FMM_PROFILE is defined (make
+// PROFILE=1), so an uninstrumented build pays nothing.
+//
+// Each phase is recorded per tree level (-1 for phases without one): the
+// summed duration of its timed scopes, the number of operations (nodes for
+// P2M, L2P and P2P, translations for M2M, M2L and L2L) and an estimate of
+// their floating-point work, or source-target interactions for P2P. Scopes
+// that run concurrently on several threads add up, so a parallel phase can
+// report more seconds than wall time. Every scope is also kept as a trace
+// event for a Chrome trace (chrome://tracing, Perfetto).
+enum class ProfilePhase : uint8_t {
+  TreeBuild,
+  Lists,
+  Binning,
+  P2M,
+  M2M,
+  M2L,
+  L2L,
+  L2P,
+  P2P
+};
+constexpr int num_profile_phases = 9;
+
+const char *profilePhaseName(ProfilePhase phase);
+
+struct ProfileCounters {
+  double seconds = 0.0;
+  std::uint64_t calls = 0;
+  double flops = 0.0;
+  std::uint64_t interactions = 0;
+};
+
+// One timed scope, in seconds since the profiler's epoch
+struct ProfileEvent {
+  ProfilePhase phase;
+  int level;
+  int thread;
+  double start;
+  double end;
+};
+
+// Process-wide collector. Each thread records into its own buffer, so
+// recording does not contend; totals() and the writers merge the buffers.
+class Profiler {
+public:
+  static Profiler &instance();
+
+  // seconds since the epoch (construction or the last reset)
+  double now() const;
+
+  // a timed scope; thread -1 is the calling thread's index
+  void addTime(ProfilePhase phase, int level, double start, double end,
+               int thread = -1);
+  void addWork(ProfilePhase phase, int level, std::uint64_t calls,
+               double flops, std::uint64_t interactions = 0);
+  // the tasks of a task graph run that has just returned, one event per task
+  // on its worker
+  void addTaskProfile(const TaskGraphProfile &profile);
+
+  // drops everything recorded so far and restarts the epoch; not to be called
+  // while other threads record
+  void reset();
+
+  std::map<std::pair<ProfilePhase, int>, ProfileCounters> totals() const;
+  std::vector<ProfileEvent> events() const;
+
+  // {"phases": [{"phase", "level", "seconds", "calls", "flops",
+  // "interactions"}, ...]}
+  void writeJson(std::ostream &out) const;
+  // Trace Event Format with one complete ("X") event per timed scope
+  void writeChromeTrace(std::ostream &out) const;
+
+private:
+  struct ThreadBuffer;
+
+  Profiler();
+  ThreadBuffer &buffer();
+
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  double epoch_ = 0.0;
+};
+
+// Times the enclosing scope as one event of phase at level
+class ProfileScope {
+public:
+  ProfileScope(ProfilePhase phase, int level)
+      : phase_(phase), level_(level), start_(Profiler::instance().now()) {}
+  ~ProfileScope() {
+    Profiler &profiler = Profiler::instance();
+    profiler.addTime(phase_, level_, start_, profiler.now());
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  ProfilePhase phase_;
+  int level_;
+  double start_;
+};
+
+// Work estimates, counting a complex multiply-add as 8 flops
+inline double p2mFlops(int p, std::size_t num_sources) {
+  return 8.0 * p * num_sources;
+}
+inline double m2mFlops(int p) { return 4.0 * (p + 1) * (p + 2); }
+inline double m2lFlops(int p) { return 8.0 * (p + 1) * (p + 1); }
+inline double l2lFlops(int p) { return 4.0 * (p + 1) * (p + 2); }
+inline double l2pFlops(int p, std::size_t num_targets) {
+  return 8.0 * (p + 1) * num_targets;
+}
+
+#ifdef FMM_PROFILE
+#define FMM_PROFILE_CONCAT_(a, b) a##b
+#define FMM_PROFILE_CONCAT(a, b) FMM_PROFILE_CONCAT_(a, b)
+// times the rest of the enclosing block
+#define FMM_PROFILE_SCOPE(phase, level)                                        \
+  ProfileScope FMM_PROFILE_CONCAT(fmm_profile_scope_, __LINE__)(               \
+      ProfilePhase::phase, level)
+// adds calls, flops and interactions; the arguments are not evaluated when
+// profiling is off
+#define FMM_PROFILE_WORK(phase, level, calls, flops, interactions)            \
+  Profiler::instance().addWork(ProfilePhase::phase, level, calls, flops,       \
+                               interactions)
+#define FMM_PROFILE_TASKS(profile) Profiler::instance().addTaskProfile(profile)
+#else
+#define FMM_PROFILE_SCOPE(phase, level)                                        \
+  do {                                                                         \
+  } while (0)
+#define FMM_PROFILE_WORK(phase, level, calls, flops, interactions)            \
+  do {                                                                         \
+  } while (0)
+#define FMM_PROFILE_TASKS(profile)                                             \
+  do {                                                                         \
+  } while (0)
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+// Vector with inline, fixed-capacity storage, for lists whose size is bounded
+// by the geometry (e.g. at most 9 near neighbors and 27 interaction list
+// entries per node of a uniform quadtree)
+template <class T, std::size_t N> class StaticVector {
+public:
+  void push_back(const T &value) {
+    if (size_ == N) {
+      throw std::length_error("StaticVector capacity exceeded");
+    }
+    data_[size_++] = value;
+  }
+
+  void clear() { size_ = 0; }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  static constexpr std::size_t capacity() { return N; }
+
+  T &operator[](std::size_t i) { return data_[i]; }
+  const T &operator[](std::size_t i) const { return data_[i]; }
+  T *begin() { return data_.data(); }
+  T *end() { return data_.data() + size_; }
+  const T *begin() const { return data_.data(); }
+  const T *end() const { return data_.data() + size_; }
+
+private:
+  std::array<T, N> data_{};
+  std::size_t size_ = 0;
+};
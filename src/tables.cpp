@@ -0,0 +1,41 @@
+#include "tables.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+TranslationTables::TranslationTables(int p)
+    : p_(p), signs_(2 * p + 1), inverses_(2 * p + 1) {
+  int rows = 2 * p + 1;
+  binomials_.resize(rows * (rows + 1) / 2);
+  for (int n = 0; n < rows; n++) {
+    double *row = &binomials_[n * (n + 1) / 2];
+    const double *previous = row - n;
+    row[0] = row[n] = 1.0;
+    for (int k = 1; k < n; k++) {
+      row[k] = previous[k - 1] + previous[k];
+    }
+  }
+  for (int k = 0; k < rows; k++) {
+    signs_[k] = (k % 2 == 0) ? 1.0 : -1.0;
+    inverses_[k] = k > 0 ? 1.0 / k : 0.0;
+  }
+}
+
+const TranslationTables &TranslationTables::get(int p) {
+  // the last tables used by this thread skip the lock, as trees use one p
+  thread_local const TranslationTables *last = nullptr;
+  if (last != nullptr && last->p() == p) {
+    return *last;
+  }
+
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<const TranslationTables>> tables;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &entry = tables[p];
+  if (!entry) {
+    entry = std::make_unique<const TranslationTables>(p);
+  }
+  last = entry.get();
+  return *last;
+}
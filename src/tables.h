@@ -5,93 +5,41 @@
 
 using Complex = std::complex<double>;
 
-class ExponentialTable {
+// Translation constants for expansions of order p: binomial(n, k) for
+// n <= 2p, in floating point so that large p does not overflow, the signs
+// (-1)^k and the factors 1/k for k <= 2p. Immutable once built and shared by
+// every expansion of order p through get(), so any number of threads can read
+// them while translating.
+class TranslationTables {
 public:
-  ExponentialTable() {}
+  explicit TranslationTables(int p);
 
-  Complex exp(Complex z, int n) {
-    if (z != base) {
-      buildTable(z, 0, n);
-      base = z;
-    } else if (n >= table.size()) {
-      buildTable(z, table.size(), n);
-    }
-    return table[n];
-  }
-
-private:
-  Complex base = 0.0;
-  std::vector<Complex> table;
-
-  void buildTable(Complex base, int start, int end) {
-    if (start == 0) {
-      table.assign(1, 1.0);
-      start = 1;
-    }
-    table.resize(end + 1);
-    for (int i = start; i <= end; ++i) {
-      table[i] = table[i - 1] * base;
-    }
-  }
-};
+  // the tables for order p, built on first use and kept for the lifetime of
+  // the program; safe to call from any thread
+  static const TranslationTables &get(int p);
 
-class InverseExponentialTable {
-public:
-  InverseExponentialTable() {}
+  int p() const { return p_; }
 
-  Complex inv_exp(Complex z, int n) {
-    if (z != base) {
-      buildTable(z, 0, n);
-      base = z;
-    } else if (n >= table.size()) {
-      buildTable(z, table.size(), n);
-    }
-    return table[n];
-  }
-
-private:
-  Complex base = 0.0;
-  std::vector<Complex> table;
-
-  void buildTable(Complex base, int start, int end) {
-    if (start == 0) {
-      table.assign(1, 1.0);
-      start = 1;
-    }
-    table.resize(end + 1);
-    for (int i = start; i <= end; ++i) {
-      table[i] = table[i - 1] / base;
-    }
-  }
-};
-
-class BinomialTable {
-public:
-  BinomialTable() {}
-
-  long long binomial(int n, int k) {
+  double binomial(int n, int k) const {
     if (k < 0 || k > n) {
-      return 0;
-    }
-    if (n != this->n) {
-      buildTable(n);
+      return 0.0;
     }
-
-    return table[k];
+    return binomials_[n * (n + 1) / 2 + k];
   }
+  double sign(int k) const { return signs_[k]; }
+  double inverse(int k) const { return inverses_[k]; } // k >= 1
 
 private:
-  int n = 0;
-  std::vector<long long> table = {1};
+  int p_;
+  std::vector<double> binomials_; // row n of Pascal's triangle at n(n+1)/2
+  std::vector<double> signs_;
+  std::vector<double> inverses_; // inverses_[0] is unused
+};
 
-  void buildTable(int n) {
-    table.assign(n + 1, 0);
-    table[0] = 1;
-    for (int i = 1; i <= n; i++) {
-      for (int j = i; j >= 1; j--) {
-        table[j] += table[j - 1];
-      }
-    }
-    this->n = n;
+// powers[i] = z^i for i = 0..n
+inline void shiftPowers(Complex z, int n, Complex *powers) {
+  powers[0] = 1.0;
+  for (int i = 1; i <= n; i++) {
+    powers[i] = powers[i - 1] * z;
   }
-};
+}
@@ -0,0 +1,178 @@
+#include "taskgraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+const char *taskKindName(TaskKind kind) {
+  switch (kind) {
+  case TaskKind::P2M:
+    return "P2M";
+  case TaskKind::M2M:
+    return "M2M";
+  case TaskKind::M2L:
+    return "M2L";
+  case TaskKind::L2L:
+    return "L2L";
+  case TaskKind::L2P:
+    return "L2P";
+  case TaskKind::P2P:
+    return "P2P";
+  }
+  return "?";
+}
+
+double TaskGraphProfile::busyTime() const {
+  double busy = 0.0;
+  for (const TaskRecord &record : records) {
+    busy += record.end - record.start;
+  }
+  return busy;
+}
+
+double TaskGraphProfile::busyTime(TaskKind kind) const {
+  double busy = 0.0;
+  for (const TaskRecord &record : records) {
+    if (record.kind == kind) {
+      busy += record.end - record.start;
+    }
+  }
+  return busy;
+}
+
+TaskGraph::TaskId TaskGraph::addTask(TaskKind kind, int level,
+                                     std::function<void()> fn) {
+  tasks_.push_back(Task{kind, level, std::move(fn), {}, 0});
+  return tasks_.size() - 1;
+}
+
+void TaskGraph::addDependency(TaskId before, TaskId after) {
+  tasks_[before].successors.push_back(after);
+  tasks_[after].num_dependencies++;
+}
+
+namespace {
+
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<TaskGraph::TaskId> tasks;
+
+  void push(TaskGraph::TaskId id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(id);
+  }
+
+  bool pop(TaskGraph::TaskId &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) {
+      return false;
+    }
+    id = tasks.back();
+    tasks.pop_back();
+    return true;
+  }
+
+  bool steal(TaskGraph::TaskId &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()) {
+      return false;
+    }
+    id = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+};
+
+} // namespace
+
+TaskGraphProfile TaskGraph::run(int num_threads) {
+  using Clock = std::chrono::steady_clock;
+
+  int num_workers = std::max(1, num_threads);
+  std::size_t num_tasks = tasks_.size();
+
+  TaskGraphProfile profile;
+  profile.num_workers = num_workers;
+  profile.records.resize(num_tasks);
+
+  std::unique_ptr<std::atomic<int>[]> remaining(
+      new std::atomic<int>[num_tasks]);
+  std::vector<WorkQueue> queues(num_workers);
+  std::size_t next_queue = 0;
+  for (TaskId id = 0; id < num_tasks; id++) {
+    remaining[id].store(tasks_[id].num_dependencies,
+                        std::memory_order_relaxed);
+    if (tasks_[id].num_dependencies == 0) {
+      queues[next_queue].tasks.push_back(id);
+      next_queue = (next_queue + 1) % num_workers;
+    }
+  }
+
+  std::atomic<std::size_t> completed{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  Clock::time_point start = Clock::now();
+  auto seconds = [&](Clock::time_point t) {
+    return std::chrono::duration<double>(t - start).count();
+  };
+
+  auto worker = [&](int w) {
+    while (completed.load(std::memory_order_acquire) < num_tasks &&
+           !failed.load(std::memory_order_relaxed)) {
+      TaskId id;
+      bool found = queues[w].pop(id);
+      for (int i = 1; !found && i < num_workers; i++) {
+        found = queues[(w + i) % num_workers].steal(id);
+      }
+      if (!found) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      Task &task = tasks_[id];
+      Clock::time_point task_start = Clock::now();
+      try {
+        task.fn();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed.store(true, std::memory_order_relaxed);
+      }
+      Clock::time_point task_end = Clock::now();
+      profile.records[id] = TaskRecord{task.kind, task.level, w,
+                                       seconds(task_start), seconds(task_end)};
+
+      for (TaskId successor : task.successors) {
+        if (remaining[successor].fetch_sub(1, std::memory_order_acq_rel) ==
+            1) {
+          queues[w].push(successor);
+        }
+      }
+      completed.fetch_add(1, std::memory_order_release);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int w = 1; w < num_workers; w++) {
+    threads.emplace_back(worker, w);
+  }
+  worker(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  profile.wall_time = seconds(Clock::now());
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return profile;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+enum class TaskKind : uint8_t { P2M, M2M, M2L, L2L, L2P, P2P };
+constexpr int num_task_kinds = 6;
+
+const char *taskKindName(TaskKind kind);
+
+// Timing of one executed task, in seconds since the start of the run
+struct TaskRecord {
+  TaskKind kind;
+  int level;
+  int worker;
+  double start;
+  double end;
+};
+
+struct TaskGraphProfile {
+  int num_workers = 0;
+  double wall_time = 0.0;
+  std::vector<TaskRecord> records;
+
+  double busyTime() const;
+  double busyTime(TaskKind kind) const;
+  // worker time not spent inside a task: scheduling overhead plus waiting on
+  // dependencies
+  double idleTime() const { return num_workers * wall_time - busyTime(); }
+};
+
+// Dependency-driven scheduler: a task becomes ready once all of its
+// predecessors have finished. Each worker pushes the tasks it unblocks onto
+// its own deque and runs them LIFO; idle workers steal the oldest task from
+// another worker's deque.
+class TaskGraph {
+public:
+  using TaskId = std::size_t;
+
+  TaskId addTask(TaskKind kind, int level, std::function<void()> fn);
+  // before must finish before after starts
+  void addDependency(TaskId before, TaskId after);
+
+  std::size_t size() const { return tasks_.size(); }
+
+  // Runs every task once on num_threads workers (the calling thread is one of
+  // them). The first exception thrown by a task is rethrown after all workers
+  // have stopped.
+  TaskGraphProfile run(int num_threads);
+
+private:
+  struct Task {
+    TaskKind kind;
+    int level;
+    std::function<void()> fn;
+    std::vector<TaskId> successors;
+    int num_dependencies = 0;
+  };
+
+  std::vector<Task> tasks_;
+};
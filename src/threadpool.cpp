@@ -0,0 +1,88 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int num_threads) {
+  for (int i = 1; i < num_threads; i++) {
+    workers_.emplace_back([this] { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(std::size_t n,
+                     const std::function<void(std::size_t)> &job) {
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &job;
+    job_size_ = n;
+    grain_ = std::max<std::size_t>(1, n / (8 * size()));
+    next_.store(0, std::memory_order_relaxed);
+    error_ = nullptr;
+    pending_ = workers_.size();
+    generation_++;
+  }
+  start_cv_.notify_all();
+
+  work();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+  job_ = nullptr;
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+void ThreadPool::workerLoop() {
+  std::size_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [&] {
+        return stop_ || generation_ != seen_generation;
+      });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+
+    work();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+    if (begin >= job_size_) {
+      return;
+    }
+    std::size_t end = std::min(begin + grain_, job_size_);
+    try {
+      for (std::size_t i = begin; i < end; i++) {
+        (*job_)(i);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for data-parallel loops. The calling
+// thread takes part in every loop, so a pool of size 1 runs inline and
+// spawns no threads.
+class ThreadPool {
+public:
+  explicit ThreadPool(int num_threads = 1);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Calls f(i) for every i in [0, n) and returns once all calls are done. The
+  // first exception thrown by f is rethrown on the calling thread. Loops
+  // started from different threads are serialized; f must not start a nested
+  // loop on the same pool.
+  template <class F> void parallel_for(std::size_t n, F &&f) {
+    if (workers_.empty() || n <= 1) {
+      for (std::size_t i = 0; i < n; i++) {
+        f(i);
+      }
+      return;
+    }
+    run(n, std::function<void(std::size_t)>(std::forward<F>(f)));
+  }
+
+private:
+  std::vector<std::thread> workers_;
+
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;
+  std::size_t generation_ = 0;
+  std::size_t pending_ = 0;
+
+  const std::function<void(std::size_t)> *job_ = nullptr;
+  std::size_t job_size_ = 0;
+  std::size_t grain_ = 1;
+  std::atomic<std::size_t> next_{0};
+  std::exception_ptr error_;
+
+  void run(std::size_t n, const std::function<void(std::size_t)> &job);
+  void workerLoop();
+  void work();
+};
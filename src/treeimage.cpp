@@ -0,0 +1,222 @@
+#include "treeimage.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char image_magic[8] = "FMMTREE";
+constexpr uint32_t byte_order_mark = 0x01020304;
+constexpr uint32_t scaled_flag = 1;
+constexpr uint32_t expansions_flag = 2;
+constexpr std::size_t section_alignment = 64;
+
+std::size_t alignUp(std::size_t offset) {
+  return (offset + section_alignment - 1) / section_alignment *
+         section_alignment;
+}
+
+template <class T> std::span<const std::byte> bytesOf(std::span<const T> s) {
+  return std::as_bytes(s);
+}
+
+// the sections of contents, in FmmTreeImageSection order
+std::array<std::span<const std::byte>, num_image_sections>
+sectionsOf(const FmmTreeImageContents &contents) {
+  return {bytesOf(contents.boxes),
+          bytesOf(contents.parents),
+          bytesOf(contents.first_children),
+          bytesOf(contents.point_ranges),
+          bytesOf(contents.near_offsets),
+          bytesOf(contents.near_indices),
+          bytesOf(contents.interaction_offsets),
+          bytesOf(contents.interaction_indices),
+          bytesOf(contents.xs),
+          bytesOf(contents.ys),
+          bytesOf(contents.strengths),
+          bytesOf(contents.order),
+          bytesOf(contents.keys),
+          bytesOf(contents.coefficients)};
+}
+
+template <class T>
+std::span<const T> sectionAt(const std::byte *base,
+                             const FmmTreeImageHeader &header,
+                             FmmTreeImageSection section) {
+  auto s = static_cast<std::size_t>(section);
+  return {reinterpret_cast<const T *>(base + header.offsets[s]),
+          header.sizes[s] / sizeof(T)};
+}
+
+// CSR offsets start at 0, never decrease and end at the list's length
+bool validOffsets(std::span<const uint64_t> offsets, std::size_t entries) {
+  if (offsets.empty() || offsets.front() != 0 || offsets.back() != entries) {
+    return false;
+  }
+  for (std::size_t g = 1; g < offsets.size(); g++) {
+    if (offsets[g] < offsets[g - 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+void writeFmmTreeImage(const std::string &path,
+                       const FmmTreeImageContents &contents) {
+  FmmTreeImageHeader header{};
+  std::memcpy(header.magic, image_magic, sizeof(header.magic));
+  header.version = fmm_tree_image_version;
+  header.byte_order = byte_order_mark;
+  header.p = contents.p;
+  header.height = contents.height;
+  header.flags = (contents.scaled ? scaled_flag : 0) |
+                 (contents.coefficients.empty() ? 0 : expansions_flag);
+  header.num_nodes = contents.num_nodes();
+  header.num_sources = contents.xs.size();
+
+  auto sections = sectionsOf(contents);
+  std::size_t offset = alignUp(sizeof(header));
+  for (std::size_t s = 0; s < num_image_sections; s++) {
+    header.offsets[s] = offset;
+    header.sizes[s] = sections[s].size();
+    offset = alignUp(offset + sections[s].size());
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("cannot open " + path + " for writing");
+  }
+  const char padding[section_alignment] = {};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  std::size_t position = sizeof(header);
+  for (std::size_t s = 0; s < num_image_sections; s++) {
+    out.write(padding, header.offsets[s] - position);
+    out.write(reinterpret_cast<const char *>(sections[s].data()),
+              sections[s].size());
+    position = header.offsets[s] + sections[s].size();
+  }
+  out.write(padding, offset - position);
+  if (!out) {
+    throw std::runtime_error("cannot write " + path);
+  }
+}
+
+FmmTreeImage::FmmTreeImage(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open " + path);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      static_cast<std::size_t>(status.st_size) < sizeof(FmmTreeImageHeader)) {
+    ::close(fd);
+    throw std::runtime_error(path + " is not an FMM tree image");
+  }
+  size_ = status.st_size;
+  data_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::runtime_error("cannot map " + path);
+  }
+
+  const auto *base = static_cast<const std::byte *>(data_);
+  const auto &header = *reinterpret_cast<const FmmTreeImageHeader *>(base);
+  auto fail = [&](const std::string &reason) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+    throw std::runtime_error(path + ": " + reason);
+  };
+  if (std::memcmp(header.magic, image_magic, sizeof(header.magic)) != 0) {
+    fail("not an FMM tree image");
+  }
+  if (header.version != fmm_tree_image_version) {
+    fail("unsupported image version " + std::to_string(header.version));
+  }
+  if (header.byte_order != byte_order_mark) {
+    fail("image written with another byte order");
+  }
+
+  // expected element counts, from the header's node and source counts
+  using S = FmmTreeImageSection;
+  std::size_t nodes = header.num_nodes;
+  std::size_t sources = header.num_sources;
+  std::size_t coefficients = (header.flags & expansions_flag)
+                                 ? 2 * (std::size_t(header.p) + 1) * nodes
+                                 : 0;
+  std::array<std::size_t, num_image_sections> expected = {
+      3 * nodes * sizeof(double),
+      nodes * sizeof(int32_t),
+      nodes * sizeof(int32_t),
+      2 * nodes * sizeof(uint64_t),
+      (nodes + 1) * sizeof(uint64_t),
+      0, // list lengths are checked against the offsets below
+      (nodes + 1) * sizeof(uint64_t),
+      0,
+      sources * sizeof(double),
+      sources * sizeof(double),
+      sources * sizeof(double),
+      sources * sizeof(uint64_t),
+      sources * sizeof(uint64_t),
+      coefficients * sizeof(std::complex<double>)};
+  for (std::size_t s = 0; s < num_image_sections; s++) {
+    bool list = s == static_cast<std::size_t>(S::NearIndices) ||
+                s == static_cast<std::size_t>(S::InteractionIndices);
+    if ((!list && header.sizes[s] != expected[s]) ||
+        (list && header.sizes[s] % sizeof(uint32_t) != 0) ||
+        header.offsets[s] % section_alignment != 0 ||
+        header.offsets[s] > size_ ||
+        header.sizes[s] > size_ - header.offsets[s]) {
+      fail("section " + std::to_string(s) + " does not match the header");
+    }
+  }
+
+  contents_.p = header.p;
+  contents_.height = header.height;
+  contents_.scaled = header.flags & scaled_flag;
+  contents_.boxes = sectionAt<double>(base, header, S::Boxes);
+  contents_.parents = sectionAt<int32_t>(base, header, S::Parents);
+  contents_.first_children =
+      sectionAt<int32_t>(base, header, S::FirstChildren);
+  contents_.point_ranges = sectionAt<uint64_t>(base, header, S::PointRanges);
+  contents_.near_offsets = sectionAt<uint64_t>(base, header, S::NearOffsets);
+  contents_.near_indices = sectionAt<uint32_t>(base, header, S::NearIndices);
+  contents_.interaction_offsets =
+      sectionAt<uint64_t>(base, header, S::InteractionOffsets);
+  contents_.interaction_indices =
+      sectionAt<uint32_t>(base, header, S::InteractionIndices);
+  contents_.xs = sectionAt<double>(base, header, S::Xs);
+  contents_.ys = sectionAt<double>(base, header, S::Ys);
+  contents_.strengths = sectionAt<double>(base, header, S::Strengths);
+  contents_.order = sectionAt<uint64_t>(base, header, S::Order);
+  contents_.keys = sectionAt<uint64_t>(base, header, S::Keys);
+  contents_.coefficients =
+      sectionAt<std::complex<double>>(base, header, S::Coefficients);
+
+  if (!validOffsets(contents_.near_offsets, contents_.near_indices.size()) ||
+      !validOffsets(contents_.interaction_offsets,
+                    contents_.interaction_indices.size())) {
+    fail("list offsets do not match the list sections");
+  }
+}
+
+FmmTreeImage::~FmmTreeImage() {
+  if (data_ != nullptr) {
+    ::munmap(data_, size_);
+  }
+}
+
+std::span<std::complex<double>> FmmTreeImage::coefficients() const {
+  // the mapping is private and writable, so the const view may be dropped
+  return {const_cast<std::complex<double> *>(contents_.coefficients.data()),
+          contents_.coefficients.size()};
+}
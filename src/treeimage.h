@@ -0,0 +1,106 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Pointer-free image of a uniform FMM tree, written by NaiveFmmTree::save and
+// mapped back by the loading constructor. Nodes are numbered in creation
+// order: level by level from the root, each level in Morton order, so node g
+// of level l is (4^l - 1) / 3 + its index within the level.
+//
+// File layout, version 1, in host byte order (the header records it):
+//   FmmTreeImageHeader
+//   one section per FmmTreeImageSection, each at a 64-byte aligned offset
+//   given by the header, with no data in between but padding
+struct FmmTreeImageContents {
+  int p = 0;
+  int height = 0;
+  bool scaled = false; // expansions scaled by their box's half side
+
+  std::span<const double> boxes;           // center x, center y, half side
+  std::span<const int32_t> parents;        // -1 at the root
+  std::span<const int32_t> first_children; // 4 consecutive; -1 at leaves
+  std::span<const uint64_t> point_ranges;  // sorted source begin, end
+  // near-neighbor and interaction lists in CSR form: node g's entries are
+  // indices[offsets[g] .. offsets[g + 1])
+  std::span<const uint64_t> near_offsets;
+  std::span<const uint32_t> near_indices;
+  std::span<const uint64_t> interaction_offsets;
+  std::span<const uint32_t> interaction_indices;
+  // sources in Morton order, the permutation to input order and leaf keys
+  std::span<const double> xs;
+  std::span<const double> ys;
+  std::span<const double> strengths;
+  std::span<const uint64_t> order;
+  std::span<const uint64_t> keys;
+  // 2 * (p + 1) per node, multipole then local; empty when not saved
+  std::span<const std::complex<double>> coefficients;
+
+  std::size_t num_nodes() const { return parents.size(); }
+};
+
+enum class FmmTreeImageSection : uint32_t {
+  Boxes,
+  Parents,
+  FirstChildren,
+  PointRanges,
+  NearOffsets,
+  NearIndices,
+  InteractionOffsets,
+  InteractionIndices,
+  Xs,
+  Ys,
+  Strengths,
+  Order,
+  Keys,
+  Coefficients
+};
+constexpr std::size_t num_image_sections = 14;
+
+struct FmmTreeImageHeader {
+  char magic[8]; // "FMMTREE", NUL-padded
+  uint32_t version;
+  uint32_t byte_order; // 0x01020304 as stored by the writer
+  int32_t p;
+  int32_t height;
+  uint32_t flags; // bit 0: scaled, bit 1: expansions saved
+  uint32_t reserved;
+  uint64_t num_nodes;
+  uint64_t num_sources;
+  uint64_t offsets[num_image_sections]; // bytes from the file start
+  uint64_t sizes[num_image_sections];   // bytes
+};
+
+constexpr uint32_t fmm_tree_image_version = 1;
+
+// Writes contents to path; throws std::runtime_error on I/O errors
+void writeFmmTreeImage(const std::string &path,
+                       const FmmTreeImageContents &contents);
+
+// Read-only view of an image file, mapped privately: the sections are used in
+// place, and the coefficients can be written (copy-on-write, never written
+// back to the file). Throws std::runtime_error if the file cannot be mapped,
+// has another version or byte order, its sections do not match the header
+// counts, or the list offsets are not a non-decreasing run from 0 to the
+// length of their list. Node indices are not checked here; the loader checks
+// them as it links the nodes.
+class FmmTreeImage {
+public:
+  explicit FmmTreeImage(const std::string &path);
+  ~FmmTreeImage();
+
+  FmmTreeImage(const FmmTreeImage &) = delete;
+  FmmTreeImage &operator=(const FmmTreeImage &) = delete;
+
+  const FmmTreeImageContents &contents() const { return contents_; }
+  std::span<std::complex<double>> coefficients() const;
+  std::size_t bytes() const { return size_; }
+
+private:
+  void *data_ = nullptr;
+  std::size_t size_ = 0;
+  FmmTreeImageContents contents_;
+};
@@ -59,3 +59,52 @@ struct Vector2 {
   static Vector2 zeros() { return Vector2(0.0, 0.0); }
   static Vector2 ones() { return Vector2(1.0, 1.0); }
 };
+
+struct Vector3 {
+  double x, y, z;
+
+  Vector3(double x, double y, double z) : x(x), y(y), z(z) {}
+
+  Vector3 operator+(const Vector3 &other) const {
+    return Vector3(x + other.x, y + other.y, z + other.z);
+  }
+
+  Vector3 operator-(const Vector3 &other) const {
+    return Vector3(x - other.x, y - other.y, z - other.z);
+  }
+
+  Vector3 operator*(const double &scalar) const {
+    return Vector3(x * scalar, y * scalar, z * scalar);
+  }
+
+  Vector3 operator/(const double &scalar) const {
+    return Vector3(x / scalar, y / scalar, z / scalar);
+  }
+
+  Vector3 &operator+=(const Vector3 &other) {
+    x += other.x;
+    y += other.y;
+    z += other.z;
+    return *this;
+  }
+
+  Vector3 &operator-=(const Vector3 &other) {
+    x -= other.x;
+    y -= other.y;
+    z -= other.z;
+    return *this;
+  }
+
+  bool operator==(const Vector3 &other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+  bool operator!=(const Vector3 &other) const { return !(*this == other); }
+
+  double dot(const Vector3 &other) const {
+    return x * other.x + y * other.y + z * other.z;
+  }
+  double norm2() const { return x * x + y * y + z * z; }
+  double norm() const { return std::sqrt(norm2()); }
+
+  static Vector3 zeros() { return Vector3(0.0, 0.0, 0.0); }
+};
@@ -0,0 +1,59 @@
+#include "../src/adaptivetree.h"
+#include "../src/directsum.h"
+#include "../src/planner.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main() {
+  int num_sources = 10000;
+  int num_clusters = 8;
+  std::vector<Point> sources;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  // strongly clustered sources: most of the bounding box is empty
+  std::vector<Vector2> centers;
+  for (int c = 0; c < num_clusters; c++) {
+    centers.push_back(Vector2(dist(gen), dist(gen)));
+  }
+  std::normal_distribution<double> spread(0.0, 0.01);
+  for (int i = 0; i < num_sources; i++) {
+    Vector2 center = centers[i % num_clusters];
+    Vector2 position(center.x + spread(gen), center.y + spread(gen));
+    sources.push_back(Point(position, dist(gen)));
+  }
+
+  double tolerance = 1e-5;
+  FmmPlan plan = FmmPlanner<GravityKernel>::plan(sources, tolerance);
+  AdaptiveFmmTree<GravityKernel> fmm_tree(plan, sources);
+
+  std::vector<double> fmm_potentials = fmm_tree.evaluateSources();
+  std::vector<double> reference_potentials =
+      DirectSum<GravityKernel>(sources).evaluateSources();
+
+  double max_error = 0.0;
+  double sum_error = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    double error = std::abs(fmm_potentials[i] - reference_potentials[i]) /
+                   std::abs(reference_potentials[i]);
+    max_error = std::max(max_error, error);
+    sum_error += error;
+  }
+
+  std::cout << "Tolerance: " << tolerance << ", p = " << plan.p
+            << ", leaf capacity = " << plan.leaf_capacity << std::endl;
+  std::cout << "Tree depth: " << fmm_tree.depth()
+            << ", leaves: " << fmm_tree.num_leaves() << std::endl;
+  std::cout << "Max relative error: " << max_error << std::endl;
+  std::cout << "Average relative error: " << sum_error / num_sources
+            << std::endl;
+
+  return 0;
+}
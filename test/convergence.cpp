@@ -0,0 +1,103 @@
+#include "../src/directsum.h"
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Error against a direct sum as p grows, for unscaled and scaled expansions
+// on sources in a box of side 1e-6. Unscaled coefficients go as the box
+// radius to the power k and M2L as its inverse powers, so they underflow to
+// denormals and zero, then overflow to inf/NaN as p grows; scaled expansions
+// should converge to machine precision at full speed. Compressed M2L should
+// follow them down to about its tolerance, mixed-precision expansions to
+// about the float rounding of the multipoles and float ones to that of the
+// locals.
+struct RunResult {
+  double error = 0.0; // max error relative to the largest potential
+  double seconds = 0.0;
+};
+
+template <class Kernel = GravityKernel>
+RunResult run(int p, const std::vector<Point> &sources, int height,
+              FmmOptions options, const std::vector<double> &expected) {
+  auto start = std::chrono::steady_clock::now();
+  NaiveFmmTree<Kernel> fmm_tree(p, sources, height, options);
+  std::vector<double> potentials = fmm_tree.evaluateSources();
+  RunResult result;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  double max_potential = 0.0;
+  for (std::size_t i = 0; i < sources.size(); i++) {
+    max_potential = std::max(max_potential, std::abs(expected[i]));
+    double error = std::abs(potentials[i] - expected[i]);
+    // NaN compares false, so record non-finite results explicitly
+    result.error = std::isfinite(potentials[i])
+                       ? std::max(result.error, error)
+                       : INFINITY;
+  }
+  result.error /= max_potential;
+  return result;
+}
+
+int main() {
+  int num_sources = 2000;
+  int height = 4;
+  double side = 1e-6;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(
+        Point(Vector2(side * dist(gen), side * dist(gen)), dist(gen)));
+  }
+  std::vector<double> expected =
+      DirectSum<GravityKernel>(sources).evaluateSources();
+
+  FmmOptions unscaled;
+  FmmOptions scaled;
+  scaled.scaled = true;
+  FmmOptions scaled_batched = scaled;
+  scaled_batched.m2l = M2LMode::Batched;
+  FmmOptions scaled_compressed = scaled;
+  scaled_compressed.m2l = M2LMode::Compressed;
+  scaled_compressed.m2l_tolerance = 1e-12;
+
+  std::cout << "N = " << num_sources << ", height = " << height
+            << ", box side = " << side << std::endl;
+  std::cout << std::setw(4) << "p" << std::setw(24) << "unscaled error [s]"
+            << std::setw(24) << "scaled error [s]" << std::setw(16)
+            << "scaled batched" << std::setw(20) << "compressed (1e-12)"
+            << std::setw(14) << "mixed" << std::setw(14) << "float"
+            << std::endl;
+  for (int p = 4; p <= 64; p += 6) {
+    RunResult plain = run(p, sources, height, unscaled, expected);
+    RunResult result = run(p, sources, height, scaled, expected);
+    RunResult batched = run(p, sources, height, scaled_batched, expected);
+    RunResult compressed =
+        run(p, sources, height, scaled_compressed, expected);
+    RunResult mixed =
+        run<MixedGravityKernel>(p, sources, height, scaled, expected);
+    RunResult single =
+        run<FloatGravityKernel>(p, sources, height, scaled, expected);
+    std::cout << std::setw(4) << p << std::setprecision(3) << std::setw(14)
+              << plain.error << " [" << std::setw(6) << plain.seconds << "]"
+              << std::setw(14) << result.error << " [" << std::setw(6)
+              << result.seconds << "]" << std::setw(16) << batched.error
+              << std::setw(20) << compressed.error << std::setw(14)
+              << mixed.error << std::setw(14) << single.error << std::endl;
+  }
+
+  return 0;
+}
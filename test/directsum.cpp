@@ -0,0 +1,103 @@
+#include "../src/directsum.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// DirectSum against a serial pair loop accumulated in long double, with odd
+// block and tile sizes and several threads, for the source potentials,
+// arbitrary targets, a sampled subset and the gradients
+long double pairLoop(const std::vector<Point> &sources, Vector2 point) {
+  long double result = 0.0;
+  for (const Point &source : sources) {
+    result += GravityKernel::potential(source, point);
+  }
+  return result;
+}
+
+int main() {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  int num_sources = 3000;
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen) - 0.5));
+  }
+  std::vector<Vector2> targets;
+  for (int i = 0; i < 500; i++) {
+    targets.push_back(Vector2(2.0 * dist(gen), 2.0 * dist(gen)));
+  }
+
+  DirectSumOptions options;
+  options.num_threads = 3;
+  options.target_block = 37;
+  options.source_tile = 101;
+  DirectSum<GravityKernel> direct(sources, options);
+
+  // relative to the largest potential, as mixed-sign strengths give
+  // potentials near zero
+  std::vector<double> potentials = direct.evaluateSources();
+  double max_potential = 0.0, max_error = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    long double expected = pairLoop(sources, sources[i].position);
+    max_potential = std::max(max_potential, std::abs(double(expected)));
+    max_error =
+        std::max(max_error, std::abs(double(potentials[i] - expected)));
+  }
+  double source_error = max_error / max_potential;
+
+  std::vector<double> at_targets = direct.evaluateTargets(targets);
+  max_potential = max_error = 0.0;
+  for (std::size_t i = 0; i < targets.size(); i++) {
+    long double expected = pairLoop(sources, targets[i]);
+    max_potential = std::max(max_potential, std::abs(double(expected)));
+    max_error =
+        std::max(max_error, std::abs(double(at_targets[i] - expected)));
+  }
+  double target_error = max_error / max_potential;
+
+  DirectSumSample sample = direct.sampleSources(100, 3);
+  double sample_diff = 0.0;
+  for (std::size_t s = 0; s < sample.indices.size(); s++) {
+    sample_diff = std::max(sample_diff,
+                           std::abs(sample.potentials[s] -
+                                    potentials[sample.indices[s]]));
+  }
+
+  std::vector<PotentialGradient> gradients =
+      direct.evaluateSourcesWithGradient();
+  double max_gradient = 0.0, gradient_error = 0.0, potential_diff = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    Vector2 expected = Vector2::zeros();
+    for (const Point &source : sources) {
+      expected += GravityKernel::gradient(source, sources[i].position);
+    }
+    max_gradient = std::max(max_gradient, expected.norm());
+    gradient_error = std::max(gradient_error,
+                              (gradients[i].gradient - expected).norm());
+    potential_diff = std::max(potential_diff,
+                              std::abs(gradients[i].potential -
+                                       potentials[i]));
+  }
+
+  std::cout << "N = " << num_sources << ", block 37, tile 101, 3 threads"
+            << std::endl;
+  std::cout << "Source potentials max relative error: " << source_error
+            << std::endl;
+  std::cout << "Target potentials max relative error: " << target_error
+            << std::endl;
+  std::cout << "Sample (" << sample.indices.size()
+            << ") max difference from full: " << sample_diff << std::endl;
+  std::cout << "Gradient max relative error: "
+            << gradient_error / max_gradient << std::endl;
+  std::cout << "Gradient pass potential max difference: " << potential_diff
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include "../src/fixedorder.h"
+#include "../src/local.h"
+#include "../src/multipole.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Fixed-order kernels, through the dispatching expansion methods and through
+// MultipoleExpansionP/LocalExpansionP, against the runtime-order loops for
+// p = 1..36; also the by-value M2M and M2L on the shared translation tables,
+// serially and from several threads at once
+double relativeDifference(std::span<const Complex> a,
+                          std::span<const Complex> b) {
+  double difference = 0.0, magnitude = 0.0;
+  for (std::size_t k = 0; k < a.size(); k++) {
+    difference = std::max(difference, std::abs(a[k] - b[k]));
+    magnitude = std::max(magnitude, std::abs(b[k]));
+  }
+  return difference / magnitude;
+}
+
+int main() {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(-0.5, 0.5);
+
+  // sources in the unit box about the origin; the translations use
+  // well-separated neighbor offsets as in the trees
+  int num_sources = 21;
+  std::vector<double> xs, ys, strengths;
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    xs.push_back(dist(gen));
+    ys.push_back(dist(gen));
+    strengths.push_back(dist(gen) + 0.5);
+    sources.push_back(Point(Vector2(xs[i], ys[i]), strengths[i]));
+  }
+  Complex child_shift(0.5, -0.5);
+  Complex m2l_shift(3.0, -2.0);
+  Vector2 target(0.3, -0.2);
+
+  double max_p2m = 0.0, max_m2m = 0.0, max_m2l = 0.0, max_l2l = 0.0;
+  double max_l2p = 0.0, max_by_value = 0.0;
+  Vector2 m2l_target(-m2l_shift.real(), -m2l_shift.imag());
+  std::vector<std::vector<Complex>> serial_m2l;
+  for (int p = 1; p <= 36; p++) {
+    MultipoleExpansion fixed(p, Vector2::zeros());
+    MultipoleExpansion dynamic(p, Vector2::zeros());
+    fixed.buildExpansion(xs.data(), ys.data(), strengths.data(), num_sources);
+    dynamic.buildExpansionDynamic(xs.data(), ys.data(), strengths.data(),
+                                  num_sources);
+    max_p2m = std::max(max_p2m,
+                       relativeDifference(fixed.coeffs, dynamic.coeffs));
+    MultipoleExpansion from_points(p, Vector2::zeros());
+    from_points.buildExpansion(sources);
+    max_p2m = std::max(max_p2m,
+                       relativeDifference(from_points.coeffs, dynamic.coeffs));
+
+    std::vector<Complex> a(p + 1), b(p + 1);
+    dynamic.M2MInto(child_shift, a);
+    dynamic.M2MIntoDynamic(child_shift, b);
+    max_m2m = std::max(max_m2m, relativeDifference(a, b));
+    MultipoleExpansion shifted = dynamic.M2M(child_shift);
+    max_by_value =
+        std::max(max_by_value, relativeDifference(shifted.coeffs, b));
+
+    LocalExpansion local(p, Vector2::zeros());
+    LocalExpansion local_dynamic(p, Vector2::zeros());
+    dynamic.M2LInto(m2l_shift, local.coeffs);
+    dynamic.M2LIntoDynamic(m2l_shift, local_dynamic.coeffs);
+    max_m2l = std::max(max_m2l,
+                       relativeDifference(local.coeffs, local_dynamic.coeffs));
+    LocalExpansion by_value(p, m2l_target);
+    by_value.M2L(dynamic);
+    max_by_value =
+        std::max(max_by_value,
+                 relativeDifference(by_value.coeffs, local_dynamic.coeffs));
+    serial_m2l.emplace_back(by_value.coeffs.begin(), by_value.coeffs.end());
+
+    std::fill(a.begin(), a.end(), 0.0);
+    std::fill(b.begin(), b.end(), 0.0);
+    local.L2LInto(child_shift, a);
+    local.L2LIntoDynamic(child_shift, b);
+    max_l2l = std::max(max_l2l, relativeDifference(a, b));
+
+    double value = local.evaluateDynamic(target);
+    max_l2p = std::max(max_l2p, std::abs(local.evaluate(target) - value) /
+                                    std::abs(value));
+  }
+
+  // the templated types directly, at p = 17
+  MultipoleExpansionP<17> multipole(Vector2::zeros());
+  multipole.buildExpansion(sources);
+  MultipoleExpansion dynamic(17, Vector2::zeros());
+  dynamic.buildExpansionDynamic(xs.data(), ys.data(), strengths.data(),
+                                num_sources);
+  LocalExpansionP<17> local(Vector2::zeros());
+  LocalExpansion local_dynamic(17, Vector2::zeros());
+  multipole.M2LInto(m2l_shift, local.coeffs);
+  dynamic.M2LIntoDynamic(m2l_shift, local_dynamic.coeffs);
+  double value = local_dynamic.evaluateDynamic(target);
+  double max_types = std::max(
+      {relativeDifference(multipole.coeffs, dynamic.coeffs),
+       relativeDifference(local.coeffs, local_dynamic.coeffs),
+       std::abs(local.evaluate(target) - value) / std::abs(value)});
+
+  // every order's M2L by value from 4 threads, against the serial results
+  std::vector<double> thread_diff(4, 0.0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      for (int p = 36; p >= 1; p--) {
+        MultipoleExpansion multipole(p, Vector2::zeros());
+        multipole.buildExpansionDynamic(xs.data(), ys.data(),
+                                        strengths.data(), num_sources);
+        LocalExpansion by_value(p, m2l_target);
+        by_value.M2L(multipole);
+        thread_diff[t] = std::max(
+            thread_diff[t],
+            relativeDifference(by_value.coeffs, serial_m2l[p - 1]));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Max relative difference from runtime-order loops, p = 1..36"
+            << std::endl;
+  std::cout << "P2M: " << max_p2m << std::endl;
+  std::cout << "M2M: " << max_m2m << std::endl;
+  std::cout << "M2L: " << max_m2l << std::endl;
+  std::cout << "L2L: " << max_l2l << std::endl;
+  std::cout << "L2P: " << max_l2p << std::endl;
+  std::cout << "MultipoleExpansionP/LocalExpansionP<17>: " << max_types
+            << std::endl;
+  std::cout << "M2M/M2L by value: " << max_by_value << std::endl;
+  std::cout << "M2L by value from 4 threads, max difference from serial: "
+            << *std::max_element(thread_diff.begin(), thread_diff.end())
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "../src/fmmtree3.h"
+#include "../src/local3.h"
+#include "../src/multipole3.h"
+#include "../src/point3.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// The 3D octree tree against a direct sum of 1 / r: the translations one at
+// a time, then whole trees at several orders, with threads and at points
+// that are not sources.
+int main() {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  // P2M, M2M, M2L and L2L chained between boxes of a uniform tree
+  std::cout << "Translations, error of the last expansion in the chain:"
+            << std::endl;
+  for (int p : {4, 8, 16}) {
+    Vector3 leaf(0.125, 0.125, 0.125);
+    Vector3 parent(0.25, 0.25, 0.25);
+    Vector3 far(0.25, 1.25, 0.75);
+    Vector3 near_far(0.375, 1.125, 0.625);
+    std::vector<Point3> sources;
+    for (int i = 0; i < 100; i++) {
+      Vector3 offset(dist(gen), dist(gen), dist(gen));
+      sources.push_back(
+          Point3(leaf + (offset - Vector3(0.5, 0.5, 0.5)) * 0.25,
+                 dist(gen) - 0.5));
+    }
+    Vector3 target =
+        near_far + Vector3(dist(gen), dist(gen), dist(gen)) * 0.1;
+    double direct = 0.0;
+    for (const Point3 &source : sources) {
+      direct += CoulombKernel::potential(source, target);
+    }
+
+    MultipoleExpansion3 p2m(p, leaf);
+    p2m.buildExpansion(sources);
+    MultipoleExpansion3 m2m(p, parent);
+    p2m.M2MInto(leaf - parent, m2m.coeffs);
+    LocalExpansion3 m2l(p, far);
+    m2m.M2LInto(parent - far, m2l.coeffs);
+    LocalExpansion3 l2l(p, near_far);
+    m2l.L2LInto(far - near_far, l2l.coeffs);
+    std::cout << "p = " << p << ": P2M " << std::abs(p2m.evaluate(target) -
+                                                      direct)
+              << ", M2M " << std::abs(m2m.evaluate(target) - direct)
+              << ", M2L " << std::abs(m2l.evaluate(target) - direct)
+              << ", L2L " << std::abs(l2l.evaluate(target) - direct)
+              << std::endl;
+  }
+
+  int num_sources = 20000;
+  int num_samples = 200;
+  std::vector<Point3> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(
+        Point3(Vector3(dist(gen), dist(gen), dist(gen)), dist(gen)));
+  }
+  auto direct = [&](Vector3 point) {
+    double result = 0.0;
+    for (const Point3 &source : sources) {
+      result += CoulombKernel::potential(source, point);
+    }
+    return result;
+  };
+  std::vector<double> reference(num_samples);
+  for (int i = 0; i < num_samples; i++) {
+    reference[i] = direct(sources[i].position);
+  }
+
+  std::cout << "N = " << num_sources << ", height 3, " << num_samples
+            << " sampled sources" << std::endl;
+  std::vector<double> serial;
+  for (int p : {4, 8, 12, 16}) {
+    FmmTree3<CoulombKernel> tree(p, sources, 3);
+    std::vector<double> potentials = tree.evaluateSources();
+    double max_error = 0.0;
+    for (int i = 0; i < num_samples; i++) {
+      max_error = std::max(max_error, std::abs(potentials[i] - reference[i]) /
+                                          std::abs(reference[i]));
+    }
+    std::size_t longest = 0;
+    for (const auto *node : tree.level(3)) {
+      longest = std::max(longest, node->interaction_list.size());
+    }
+    std::cout << "p = " << p << ", max relative error: " << max_error
+              << " (longest interaction list " << longest << ")"
+              << std::endl;
+    if (p == 8) {
+      serial = potentials;
+    }
+  }
+
+  FmmOptions options;
+  options.num_threads = 4;
+  FmmTree3<CoulombKernel> tree(8, sources, 3, options);
+  std::vector<double> threaded = tree.evaluateSources();
+  double difference = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    difference = std::max(difference, std::abs(threaded[i] - serial[i]));
+  }
+  std::cout << "4 threads, max difference from serial: " << difference
+            << std::endl;
+
+  double max_error = 0.0;
+  for (int i = 0; i < 20; i++) {
+    Vector3 point(dist(gen), dist(gen), dist(gen));
+    double expected = direct(point);
+    max_error = std::max(max_error, std::abs(tree.evaluate(point) - expected) /
+                                        std::abs(expected));
+  }
+  std::cout << "p = 8, evaluate at other points, max relative error: "
+            << max_error << std::endl;
+
+  return 0;
+}
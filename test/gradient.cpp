@@ -0,0 +1,75 @@
+#include "../src/adaptivetree.h"
+#include "../src/directsum.h"
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+// max relative error of the gradients, relative to the largest reference
+// gradient so that near-zero fields do not dominate
+double gradientError(const std::vector<PotentialGradient> &results,
+                     const std::vector<PotentialGradient> &reference) {
+  double max_norm = 0.0;
+  double max_error = 0.0;
+  for (std::size_t i = 0; i < results.size(); i++) {
+    max_norm = std::max(max_norm, reference[i].gradient.norm());
+    max_error = std::max(
+        max_error, (results[i].gradient - reference[i].gradient).norm());
+  }
+  return max_error / max_norm;
+}
+
+double potentialError(const std::vector<PotentialGradient> &results,
+                      const std::vector<PotentialGradient> &reference) {
+  double max_error = 0.0;
+  for (std::size_t i = 0; i < results.size(); i++) {
+    max_error = std::max(max_error,
+                         std::abs(results[i].potential -
+                                  reference[i].potential) /
+                             std::abs(reference[i].potential));
+  }
+  return max_error;
+}
+
+int main() {
+  int num_sources = 10000;
+  int p = 10;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+
+  std::vector<PotentialGradient> reference_results =
+      DirectSum<GravityKernel>(sources).evaluateSourcesWithGradient();
+
+  int height = 4;
+  NaiveFmmTree<GravityKernel> fmm_tree(p, sources, height);
+  std::vector<PotentialGradient> fmm_results =
+      fmm_tree.evaluateSourcesWithGradient();
+
+  AdaptiveFmmTree<GravityKernel> adaptive_tree(p, sources, 32);
+  std::vector<PotentialGradient> adaptive_results =
+      adaptive_tree.evaluateSourcesWithGradient();
+
+  std::cout << "Uniform potential max relative error: "
+            << potentialError(fmm_results, reference_results) << std::endl;
+  std::cout << "Uniform gradient max relative error: "
+            << gradientError(fmm_results, reference_results) << std::endl;
+  std::cout << "Adaptive potential max relative error: "
+            << potentialError(adaptive_results, reference_results)
+            << std::endl;
+  std::cout << "Adaptive gradient max relative error: "
+            << gradientError(adaptive_results, reference_results)
+            << std::endl;
+
+  return 0;
+}
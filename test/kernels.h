@@ -1,6 +1,10 @@
 #include "../src/local.h"
+#include "../src/local3.h"
 #include "../src/multipole.h"
+#include "../src/multipole3.h"
+#include "../src/p2p.h"
 #include "../src/point.h"
+#include "../src/point3.h"
 #include "../src/vector.h"
 
 class GravityKernel {
@@ -13,6 +17,69 @@ public:
     return source.strength * std::log(delta.norm());
   }
 
+  // gradient of potential(source, point) with respect to point
+  static Vector2 gradient(const Point &source, Vector2 point) {
+    Vector2 delta = point - source.position;
+    if (delta == Vector2::zeros()) {
+      return Vector2::zeros();
+    }
+    return delta * (source.strength / delta.norm2());
+  }
+
+  // out[i] += sum_j potential(source j, target i) over a block of targets and
+  // a block of sources, vectorized (see logP2P for the tolerance)
+  static void p2p_batch(const double *sx, const double *sy,
+                        const double *strength, std::size_t ns,
+                        const double *tx, const double *ty, double *out,
+                        std::size_t nt) {
+    logP2P(sx, sy, strength, ns, tx, ty, out, nt);
+  }
+
+  // p2p_batch for num_rhs strength blocks, sharing each log between them
+  static void p2p_multi_batch(const double *sx, const double *sy,
+                              const double *strength, std::size_t ns,
+                              std::size_t num_rhs, const double *tx,
+                              const double *ty, double *out, std::size_t nt) {
+    logP2PMulti(sx, sy, strength, ns, num_rhs, tx, ty, out, nt);
+  }
+
+  // p2p_batch that also accumulates the gradient into gx and gy
+  static void p2p_gradient_batch(const double *sx, const double *sy,
+                                 const double *strength, std::size_t ns,
+                                 const double *tx, const double *ty,
+                                 double *potential, double *gx, double *gy,
+                                 std::size_t nt) {
+    logP2PGradient(sx, sy, strength, ns, tx, ty, potential, gx, gy, nt);
+  }
+
   using Multipole = MultipoleExpansion;
   using Local = LocalExpansion;
 };
+
+// GravityKernel with multipole coefficients of type MultipoleT and local
+// coefficients of type LocalT; the near field stays in double
+template <class MultipoleT, class LocalT>
+class GravityKernelWith : public GravityKernel {
+public:
+  using Multipole = BasicMultipoleExpansion<MultipoleT>;
+  using Local = BasicLocalExpansion<LocalT>;
+};
+
+using FloatGravityKernel = GravityKernelWith<float, float>;
+// float multipoles and translations, accumulated into double locals
+using MixedGravityKernel = GravityKernelWith<float, double>;
+
+// 1 / r potential of point charges in 3D, for FmmTree3
+class CoulombKernel {
+public:
+  static double potential(const Point3 &source, Vector3 point) {
+    Vector3 delta = source.position - point;
+    if (delta == Vector3::zeros()) {
+      return 0.0;
+    }
+    return source.strength / delta.norm();
+  }
+
+  using Multipole = MultipoleExpansion3;
+  using Local = LocalExpansion3;
+};
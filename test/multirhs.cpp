@@ -0,0 +1,80 @@
+#include "../src/directsum.h"
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Multi-RHS evaluation over one geometry against one tree per strength
+// vector, and the first right-hand side against a direct sum
+int main() {
+  int num_sources = 5000;
+  int num_rhs = 8;
+  int height = 4;
+  int p = 10;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  std::vector<Vector2> positions;
+  for (int i = 0; i < num_sources; i++) {
+    positions.push_back(Vector2(dist(gen), dist(gen)));
+  }
+  std::vector<std::vector<double>> strengths(num_rhs);
+  for (std::vector<double> &strength : strengths) {
+    for (int i = 0; i < num_sources; i++) {
+      strength.push_back(dist(gen) - 0.5);
+    }
+  }
+
+  auto withStrengths = [&](const std::vector<double> &strength) {
+    std::vector<Point> sources;
+    for (int i = 0; i < num_sources; i++) {
+      sources.push_back(Point(positions[i], strength[i]));
+    }
+    return sources;
+  };
+
+  NaiveFmmTree<GravityKernel> fmm_tree(p, withStrengths(strengths[0]),
+                                       height);
+  std::vector<std::vector<double>> multi = fmm_tree.evaluateSources(strengths);
+
+  // relative to the largest potential, as mixed-sign strengths give
+  // potentials near zero
+  double max_diff = 0.0;
+  for (int r = 0; r < num_rhs; r++) {
+    NaiveFmmTree<GravityKernel> single_tree(p, withStrengths(strengths[r]),
+                                            height);
+    std::vector<double> single = single_tree.evaluateSources();
+    double max_potential = 0.0;
+    double diff = 0.0;
+    for (int i = 0; i < num_sources; i++) {
+      max_potential = std::max(max_potential, std::abs(single[i]));
+      diff = std::max(diff, std::abs(multi[r][i] - single[i]));
+    }
+    max_diff = std::max(max_diff, diff / max_potential);
+  }
+
+  std::vector<double> reference_potentials =
+      DirectSum<GravityKernel>(withStrengths(strengths[0]))
+          .evaluateSources();
+  double max_potential = 0.0;
+  double max_error = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    max_potential = std::max(max_potential, std::abs(reference_potentials[i]));
+    max_error =
+        std::max(max_error, std::abs(multi[0][i] - reference_potentials[i]));
+  }
+
+  std::cout << "Right-hand sides: " << num_rhs << std::endl;
+  std::cout << "Max difference from single-RHS trees: " << max_diff
+            << std::endl;
+  std::cout << "Max error against direct sum: " << max_error / max_potential
+            << std::endl;
+
+  return 0;
+}
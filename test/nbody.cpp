@@ -1,4 +1,6 @@
+#include "../src/directsum.h"
 #include "../src/fmmtree.h"
+#include "../src/planner.h"
 #include "../src/point.h"
 #include "../src/vector.h"
 #include "kernels.h"
@@ -7,23 +9,6 @@
 #include <random>
 #include <vector>
 
-template <class Kernel>
-std::vector<double> reference(const std::vector<Point> &sources) {
-  int num_sources = sources.size();
-  std::vector<double> potentials(num_sources);
-
-  for (int i = 0; i < num_sources; i++) {
-    for (int j = 0; j < num_sources; j++) {
-      if (i == j) {
-        continue;
-      }
-
-      potentials[i] += Kernel::potential(sources[j], sources[i].position);
-    }
-  }
-  return potentials;
-}
-
 int main() {
   int num_sources = 10000;
   std::vector<Point> sources;
@@ -37,12 +22,13 @@ int main() {
     sources.push_back(rand_point);
   }
 
-  int height = ceil(std::log(num_sources) / std::log(4));
-  int p = 5;
-  NaiveFmmTree<GravityKernel> fmm_tree(p, sources, height);
+  double tolerance = 1e-5;
+  FmmPlan plan = FmmPlanner<GravityKernel>::plan(sources, tolerance);
+  NaiveFmmTree<GravityKernel> fmm_tree(plan, sources);
 
   std::vector<double> fmm_potentials = fmm_tree.evaluateSources();
-  std::vector<double> reference_potentials = reference<GravityKernel>(sources);
+  std::vector<double> reference_potentials =
+      DirectSum<GravityKernel>(sources).evaluateSources();
 
   double max_error = 0.0;
   double sum_error = 0.0;
@@ -53,6 +39,8 @@ int main() {
     sum_error += error;
   }
 
+  std::cout << "Tolerance: " << tolerance << ", p = " << plan.p
+            << ", height = " << plan.height << std::endl;
   std::cout << "Max relative error: " << max_error << std::endl;
   std::cout << "Average relative error: " << sum_error / num_sources
             << std::endl;
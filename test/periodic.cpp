@@ -0,0 +1,187 @@
+#include "../src/fmmtree.h"
+#include "../src/lattice.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Periodic trees against a sum over the images of the cell, in square shells
+// of images about it. The 3x3 block of cells is summed pair by pair and the
+// farther shells through the cell's multipole expansion at order 50, which
+// is exact to rounding there; the shell sums converge as 1/K^2 in the number
+// of shells K, so the reference is extrapolated from K = 64, 128 and 256,
+// which leaves it good to a few 1e-7 (about 1e-7 from 512 shells).
+// Shells leave the field of the cell's dipole moment D, which the periodic
+// potential does not have: the reference adds pi Re(conj(D) (z - c)) / L^2.
+// Also the lattice sums against direct sums over shells, the jump in the
+// potential across the cell boundary, the schedules and batched M2L, and the
+// rejection of a charged cell.
+int main() {
+  std::cout << std::setprecision(3);
+  std::cout << "Lattice sums, recursion minus 400 shells:";
+  for (int n = 8; n <= 20; n += 4) {
+    double direct = 0.0;
+    for (int k = 1; k <= 400; k++) {
+      for (int y = -k; y <= k; y++) {
+        for (int x = -k; x <= k; x++) {
+          if (std::max(std::abs(x), std::abs(y)) == k) {
+            direct += std::pow(Complex(x, y), -n).real();
+          }
+        }
+      }
+    }
+    std::cout << " " << LatticeSumOperator::latticeSum(n) - direct;
+  }
+  std::cout << std::endl;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  int num_sources = 2000;
+  int num_targets = 20;
+  Box2 cell(Vector2(0.5, 0.5), 0.5);
+  std::vector<Point> sources;
+  double mean = 0.0;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+    mean += sources.back().strength / num_sources;
+  }
+  for (Point &source : sources) {
+    source.strength -= mean;
+  }
+
+  // shell sums at the first num_targets sources
+  MultipoleExpansion cell_multipole(50, cell.center);
+  cell_multipole.scale = cell.half_side;
+  cell_multipole.buildExpansion(sources);
+  std::vector<int> checkpoints = {64, 128, 256};
+  std::vector<std::vector<double>> partial(checkpoints.size(),
+                                           std::vector<double>(num_targets));
+  for (int t = 0; t < num_targets; t++) {
+    Vector2 target = sources[t].position;
+    double sum = 0.0;
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        Vector2 shift(dx, dy);
+        for (const Point &source : sources) {
+          sum += GravityKernel::potential(
+              Point(source.position + shift, source.strength), target);
+        }
+      }
+    }
+    std::size_t next = 0;
+    for (int k = 2; k <= checkpoints.back(); k++) {
+      for (int y = -k; y <= k; y++) {
+        for (int x = -k; x <= k; x++) {
+          if (std::max(std::abs(x), std::abs(y)) == k) {
+            sum += cell_multipole.evaluate(target - Vector2(x, y));
+          }
+        }
+      }
+      if (k == checkpoints[next]) {
+        partial[next++][t] = sum;
+      }
+    }
+  }
+  Complex dipole = 0.0;
+  for (const Point &source : sources) {
+    dipole += source.strength *
+              Complex(source.position.x - 0.5, source.position.y - 0.5);
+  }
+  // Richardson on the 1/K^2 and 1/K^3 terms of the tail
+  std::vector<double> expected(num_targets);
+  std::vector<double> unextrapolated(num_targets);
+  double max_potential = 0.0;
+  for (int t = 0; t < num_targets; t++) {
+    double a = (4.0 * partial[1][t] - partial[0][t]) / 3.0;
+    double b = (4.0 * partial[2][t] - partial[1][t]) / 3.0;
+    Complex z(sources[t].position.x - 0.5, sources[t].position.y - 0.5);
+    double field = std::numbers::pi * (std::conj(dipole) * z).real();
+    expected[t] = 2.0 * b - a + field;
+    unextrapolated[t] = partial[2][t] + field;
+    max_potential = std::max(max_potential, std::abs(expected[t]));
+  }
+
+  auto error = [&](const std::vector<double> &potentials) {
+    double result = 0.0;
+    for (int t = 0; t < num_targets; t++) {
+      result = std::max(result, std::abs(potentials[t] - expected[t]));
+    }
+    return result / max_potential;
+  };
+  std::vector<double> free_space(num_targets);
+  {
+    NaiveFmmTree<GravityKernel> tree(20, sources, 4);
+    std::vector<double> potentials = tree.evaluateSources();
+    free_space.assign(potentials.begin(), potentials.begin() + num_targets);
+  }
+  std::cout << "N = " << num_sources << ", cell side 1" << std::endl;
+  std::cout << "Free-space tree against the periodic sum: "
+            << error(free_space) << std::endl;
+  std::cout << "Reference extrapolation, change from 256 shells: "
+            << error(unextrapolated) << std::endl;
+
+  FmmOptions options;
+  options.periodic_cell = cell;
+  for (int p : {10, 20, 30}) {
+    NaiveFmmTree<GravityKernel> tree(p, sources, 4, options);
+    std::vector<double> potentials = tree.evaluateSources();
+    potentials.resize(num_targets);
+    std::cout << "p = " << p << ", height 4, max relative error: "
+              << error(potentials) << std::endl;
+  }
+
+  FmmOptions scaled = options;
+  scaled.scaled = true;
+  FmmOptions batched = scaled;
+  batched.m2l = M2LMode::Batched;
+  FmmOptions graph = scaled;
+  graph.schedule = FmmSchedule::TaskGraph;
+  for (auto [name, variant] :
+       {std::pair{"scaled", scaled}, std::pair{"batched", batched},
+        std::pair{"task graph", graph}}) {
+    NaiveFmmTree<GravityKernel> tree(20, sources, 3, variant);
+    std::vector<double> potentials = tree.evaluateSources();
+    potentials.resize(num_targets);
+    std::cout << "p = 20, height 3, " << name
+              << " max relative error: " << error(potentials) << std::endl;
+  }
+
+  // across the boundary the potential should move by about the gradient
+  // times the 2e-9 step
+  NaiveFmmTree<GravityKernel> tree(20, sources, 4, options);
+  double jump = 0.0;
+  for (int i = 0; i < 100; i++) {
+    double y = dist(gen);
+    jump = std::max(
+        jump, std::abs(tree.evaluate(Vector2(1.0 - 1e-9, y)) -
+                       tree.evaluate(Vector2(1e-9, y))));
+    jump = std::max(
+        jump, std::abs(tree.evaluate(Vector2(y, 1.0 - 1e-9)) -
+                       tree.evaluate(Vector2(y, 1e-9))));
+  }
+  std::cout << "Max jump across the cell boundary: " << jump / max_potential
+            << std::endl;
+  std::cout << "Shifted by one cell, max difference: "
+            << std::abs(tree.evaluate(Vector2(0.3, 0.7)) -
+                        tree.evaluate(Vector2(1.3, -0.3)))
+            << std::endl;
+
+  sources[0].strength += 1.0;
+  try {
+    NaiveFmmTree<GravityKernel> charged(10, sources, 3, options);
+    std::cout << "Charged cell was not rejected" << std::endl;
+  } catch (const std::invalid_argument &e) {
+    std::cout << "Rejected: " << e.what() << std::endl;
+  }
+
+  return 0;
+}
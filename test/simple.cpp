@@ -1,3 +1,4 @@
+#include "../src/directsum.h"
 #include "../src/fmmtree.h"
 #include "../src/point.h"
 #include "../src/vector.h"
@@ -7,17 +8,6 @@
 #include <random>
 #include <vector>
 
-template <class Kernel>
-double reference(const std::vector<Point> &sources, const Vector2 &point) {
-  double result = 0.0;
-
-  for (const Point &source : sources) {
-    result += Kernel::potential(source, point);
-  }
-
-  return result;
-}
-
 int main() {
   std::random_device rd;
   std::mt19937 gen(rd());
@@ -41,7 +31,8 @@ int main() {
 
     Vector2 test_point(0.5, 0.5);
     double fmm_result = fmm_tree.evaluate(test_point);
-    double reference_result = reference<GravityKernel>(sources, test_point);
+    double reference_result =
+        DirectSum<GravityKernel>(sources).evaluate(test_point);
 
     double relative_error =
         std::abs(fmm_result - reference_result) / std::abs(reference_result);
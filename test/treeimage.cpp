@@ -0,0 +1,145 @@
+#include "../src/fmmtree.h"
+#include "../src/point.h"
+#include "../src/vector.h"
+#include "kernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Trees saved and mapped back, with and without expansions and with batched
+// M2L, against the tree they were saved from: source potentials, potentials
+// at arbitrary points and an update on the loaded tree. Also the time of a
+// fresh build against a load, and the errors for a truncated and a
+// mismatched image.
+double maxDifference(const std::vector<double> &a,
+                     const std::vector<double> &b) {
+  double difference = 0.0;
+  for (std::size_t i = 0; i < a.size(); i++) {
+    difference = std::max(difference, std::abs(a[i] - b[i]));
+  }
+  return difference;
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main() {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  int num_sources = 100000;
+  int height = 6;
+  int p = 12;
+  std::vector<Point> sources;
+  for (int i = 0; i < num_sources; i++) {
+    sources.push_back(Point(Vector2(dist(gen), dist(gen)), dist(gen)));
+  }
+  std::vector<Vector2> points;
+  for (int i = 0; i < 100; i++) {
+    points.push_back(Vector2(dist(gen), dist(gen)));
+  }
+
+  std::string path =
+      (std::filesystem::temp_directory_path() / "fmm_treeimage_test.bin")
+          .string();
+
+  for (bool batched : {false, true}) {
+    FmmOptions options;
+    options.scaled = batched;
+    options.m2l = batched ? M2LMode::Batched : M2LMode::Direct;
+
+    auto start = std::chrono::steady_clock::now();
+    NaiveFmmTree<GravityKernel> built(p, sources, height, options);
+    double build_time = seconds(start);
+    std::vector<double> expected = built.evaluateSources();
+    std::vector<double> expected_points = built.evaluateTargets(points);
+
+    for (bool expansions : {true, false}) {
+      built.save(path, expansions);
+      start = std::chrono::steady_clock::now();
+      NaiveFmmTree<GravityKernel> loaded(path, options);
+      double load_time = seconds(start);
+
+      double source_diff = maxDifference(loaded.evaluateSources(), expected);
+      double point_diff =
+          maxDifference(loaded.evaluateTargets(points), expected_points);
+
+      std::cout << (batched ? "scaled, batched M2L" : "direct M2L")
+                << (expansions ? ", with expansions" : ", geometry only")
+                << ": " << std::filesystem::file_size(path) / 1048576.0
+                << " MiB, build " << build_time << " s, load " << load_time
+                << " s" << std::endl;
+      std::cout << "  max difference, sources " << source_diff << ", points "
+                << point_diff << std::endl;
+    }
+  }
+
+  // the same update on the built and the loaded tree
+  NaiveFmmTree<GravityKernel> built(p, sources, height);
+  built.save(path);
+  NaiveFmmTree<GravityKernel> loaded(path);
+  std::vector<Vector2> positions;
+  std::vector<double> strengths;
+  for (const Point &source : sources) {
+    positions.push_back(source.position + Vector2(0.01, -0.01) * dist(gen));
+    strengths.push_back(source.strength);
+  }
+  built.update(positions, strengths);
+  loaded.update(positions, strengths);
+  std::cout << "Update max difference: "
+            << maxDifference(loaded.evaluateSources(),
+                             built.evaluateSources())
+            << std::endl;
+  // the loaded tree wrote to its private mapping only
+  NaiveFmmTree<GravityKernel> reloaded(path);
+  std::vector<double> original =
+      NaiveFmmTree<GravityKernel>(p, sources, height).evaluateSources();
+  std::cout << "Reloaded after update, max difference from saved: "
+            << maxDifference(reloaded.evaluateSources(), original)
+            << std::endl;
+
+  // an image whose near-list offsets decrease, a truncated image and a file
+  // that is not one are rejected
+  auto load = [&] {
+    try {
+      NaiveFmmTree<GravityKernel> broken(path);
+      std::cout << "Malformed image loaded" << std::endl;
+    } catch (const std::runtime_error &error) {
+      std::cout << "Rejected: " << error.what() << std::endl;
+    }
+  };
+  {
+    FmmTreeImageHeader header;
+    std::fstream image(path, std::ios::in | std::ios::out | std::ios::binary);
+    image.read(reinterpret_cast<char *>(&header), sizeof(header));
+    // node 0's list ends past every later node's start
+    uint64_t end = ~uint64_t(0);
+    auto near = static_cast<std::size_t>(FmmTreeImageSection::NearOffsets);
+    image.seekp(header.offsets[near] + sizeof(uint64_t));
+    image.write(reinterpret_cast<const char *>(&end), sizeof(end));
+  }
+  load();
+  built.save(path);
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    load();
+    std::ofstream(path) << "not a tree image, but long enough to hold a "
+                           "header of one, padded out to well over one "
+                           "hundred and fifty bytes for the header check to "
+                           "reach the magic comparison rather than stopping "
+                           "at the size";
+  }
+  std::remove(path.c_str());
+
+  return 0;
+}